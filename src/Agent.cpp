@@ -14,12 +14,6 @@ using namespace std;
 
 void Agent::computeNewVelocity(VODump* dump)
 {
-#ifdef USE_MY_TRIG
-    if (!mtrig::g_wasInited) {
-        mtrig::build_table();
-        mtrig::g_wasInited = true;
-    }
-#endif
     m_voStore.clear();
     vector<VelocityObstacle>& velocityObstacles = m_voStore;
 	velocityObstacles.reserve(m_neighbors.c.size());
@@ -0,0 +1,49 @@
+#include "AllocCount.h"
+
+#ifdef NAV_COUNT_ALLOCS
+
+#include <cstdlib>
+#include <new>
+
+static thread_local size_t t_allocCount = 0;
+
+size_t navAllocCount()
+{
+    return t_allocCount;
+}
+
+void* operator new(size_t size)
+{
+    ++t_allocCount;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+// debug counting of heap allocations, compile with NAV_COUNT_ALLOCS to enable.
+// replaces the global operator new so it should only be defined in debug and test builds
+#ifdef NAV_COUNT_ALLOCS
+
+// number of calls to operator new on the calling thread since it started. other threads, like other
+// simulations of the batch runner, don't change it. the workers of a ThreadPool sum theirs in workerAllocCount()
+size_t navAllocCount();
+
+// steps Document::doStep may allocate in after something changed before it is checked
+#define ALLOC_WARMUP_STEPS 10
+
+#endif
@@ -0,0 +1,272 @@
+#include "BatchRunner.h"
+#include "Except.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+void BatchRunner::loadScene(const string& path)
+{
+    ifstream ifs(path);
+    CHECK(ifs.good(), "Can't open scene " + path);
+    stringstream ss;
+    ss << ifs.rdbuf();
+    setSceneText(ss.str());
+}
+
+string BatchRunner::convertOldScene(const string& text)
+{
+    stringstream out;
+    vector<Vec2> goals, agents, queryAgents; // queryAgents go to the end point
+    vector<int> agentGoals;
+    Vec2 end;
+    bool hasEnd = false;
+    istringstream is(text);
+    string line;
+    while (getline(is, line))
+    {
+        // the command may be glued to the first number as in "goal200 -200"
+        size_t cmdEnd = 0;
+        while (cmdEnd < line.size() && isalpha((unsigned char)line[cmdEnd]))
+            ++cmdEnd;
+        const string cmd = line.substr(0, cmdEnd);
+        istringstream ls(line.substr(cmdEnd));
+        Vec2 p;
+        ls >> p.x >> p.y;
+        const bool hasPoint = !ls.fail();
+        if (cmd == "polyline") {
+            out << "p,\n";
+            continue;
+        }
+        CHECK(cmd.empty() || hasPoint, "Old scene line without a point: " + line);
+        if (cmd == "v")
+            out << "v," << p.x << "," << p.y << ",\n";
+        else if (cmd == "goal")
+            goals.push_back(p);
+        else if (cmd == "agent") {
+            int goal = -1;
+            ls >> goal;
+            agents.push_back(p);
+            agentGoals.push_back(ls.fail() ? -1 : goal);
+        }
+        else if (cmd == "start" || cmd == "prob")
+            queryAgents.push_back(p);
+        else if (cmd == "end") {
+            end = p;
+            hasEnd = true;
+        }
+        else
+            CHECK(cmd.empty(), "Unknown old scene command " + cmd);
+    }
+
+    for(const auto& g: goals)
+        out << "g," << g.x << "," << g.y << "," << OLD_SCENE_GOAL_RADIUS << "," << (int)GOAL_POINT << ",\n";
+    const int endGoal = hasEnd ? (int)goals.size() : -1;
+    if (hasEnd)
+        out << "g," << end.x << "," << end.y << "," << OLD_SCENE_GOAL_RADIUS << "," << (int)GOAL_POINT << ",\n";
+    auto writeAgent = [&](const Vec2& p, int goal) {
+        CHECK(goal < (int)goals.size() || goal == endGoal, "Old scene agent of a goal that does not exist");
+        out << "a," << p.x << "," << p.y << "," << goal << ",0,0," << OLD_SCENE_AGENT_RADIUS << "," << OLD_SCENE_AGENT_SPEED << ",\n";
+    };
+    for(size_t i = 0; i < agents.size(); ++i)
+        writeAgent(agents[i], agentGoals[i]);
+    for(const auto& p: queryAgents)
+        writeAgent(p, endGoal);
+    return out.str();
+}
+
+void BatchRunner::setSceneText(const string& text)
+{
+    m_sceneText = isOldScene(text) ? convertOldScene(text) : text;
+
+    // the triangulation depends only on the map, not on the parameters of the runs
+    Document doc;
+    istringstream is(m_sceneText);
+    map<string, string> imported;
+    doc.deserialize(is, imported);
+    CHECK(!doc.m_agents.empty(), "Scene has no agents");
+    doc.m_mapdef.makeBoxPoly();
+    doc.runTriangulate();
+    CHECK(doc.m_navLive, "Scene triangulation failed");
+    // without a mesh the agents get no plans and stand, every run would report them all at their goals
+    CHECK(!doc.m_mesh.m_vtx.empty(), "Scene has no map");
+
+    auto tri = make_shared<Mesh>();
+    tri->assignTri(doc.m_mesh);
+    m_navKey = doc.m_navKey;
+    m_navDefinition = doc.m_navDefinition;
+    m_tri = tri;
+}
+
+template<typename T>
+static string joinValue(const char* key, T v) {
+    stringstream ss;
+    ss << key << "=" << v;
+    return ss.str();
+}
+
+void BatchRunner::addSweep(const vector<float>& neighborDistFactor, const vector<int>& maxNeighbors,
+                           const vector<float>& timeHorizon, const vector<float>& timeHorizonObst,
+                           const vector<float>& goalRadiusScale)
+{
+    for(float ndf: neighborDistFactor)
+    for(int mn: maxNeighbors)
+    for(float th: timeHorizon)
+    for(float tho: timeHorizonObst)
+    for(float grs: goalRadiusScale)
+    {
+        BatchRun run;
+        run.params.neighborDistFactor = ndf;
+        run.params.maxNeighbors = mn;
+        run.params.timeHorizon = th;
+        run.params.timeHorizonObst = tho;
+        run.params.goalRadiusScale = grs;
+        run.name = joinValue("ndf", ndf) + " " + joinValue("mn", mn) + " " + joinValue("th", th) + " " +
+                   joinValue("tho", tho) + " " + joinValue("grs", grs);
+        m_runs.push_back(run);
+    }
+}
+
+vector<BatchMetrics> BatchRunner::run(int maxSteps, int numThreads)
+{
+    CHECK(m_tri, "No scene loaded");
+    vector<BatchMetrics> results(m_runs.size());
+
+    // runs only share m_tri which they read. each of them steps its own simulator on one thread
+    RVO::ThreadPool pool;
+    pool.setNumThreads(numThreads);
+    pool.parallelFor((int)m_runs.size(), 1, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i)
+            results[i] = runOne(m_runs[i], maxSteps);
+    });
+    return results;
+}
+
+// pairs of agents that overlap after the step, of all the agents including the ones that sleep. the simulator's
+// neighbor lists are not used since they depend on the parameters that the runs compare. sweeps along x, order
+// is a buffer of the run
+static int countCollisions(const Document& doc, vector<int>& order)
+{
+    const auto& agents = doc.m_agents;
+    order.resize(agents.size());
+    float maxRadius = 0.0f;
+    for(size_t i = 0; i < agents.size(); ++i) {
+        order[i] = (int)i;
+        maxRadius = max(maxRadius, agents[i]->m_radius);
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) { return agents[a]->m_position.x < agents[b]->m_position.x; });
+
+    int count = 0;
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        const RVO::Agent* a = agents[order[i]];
+        const float reach = a->m_radius + maxRadius;
+        for(size_t j = i + 1; j < order.size(); ++j)
+        {
+            const RVO::Agent* b = agents[order[j]];
+            if (b->m_position.x - a->m_position.x >= reach)
+                break;
+            const float minDist = (a->m_radius + b->m_radius) * (1.0f - BATCH_COLLISION_SLACK);
+            if (distSq(a->m_position, b->m_position) < minDist * minDist)
+                ++count;
+        }
+    }
+    return count;
+}
+
+BatchMetrics BatchRunner::runOne(const BatchRun& run, int maxSteps) const
+{
+    BatchMetrics m;
+    m.name = run.name;
+    m.params = run.params;
+    try {
+        Document doc;
+        doc.m_agentParams = run.params;
+        doc.m_navCache.setSharedTri(m_navKey, m_navDefinition, m_tri);
+        const unsigned int eventMask = RVO::eventBit(RVO::EVENT_REPLAN) | RVO::eventBit(RVO::EVENT_PLAN_FAILED) | RVO::eventBit(RVO::EVENT_LP3_FALLBACK);
+        doc.m_sim.setEventMask(eventMask); // before the scene makes the first plans
+        vector<RVO::Event> events;
+        vector<int> collisionOrder;
+        istringstream is(m_sceneText);
+        map<string, string> imported;
+        doc.deserialize(is, imported);
+        doc.m_mapdef.makeBoxPoly();
+        doc.runTriangulate();
+        CHECK(doc.m_navLive, "Scene triangulation failed");
+
+        float msSum = 0.0f;
+        for(int step = 0; step < maxSteps; ++step)
+        {
+            auto start = chrono::steady_clock::now();
+            bool reached = doc.doStep(FIXED_STEP_TIME, true, step);
+            float ms = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+            msSum += ms;
+            m.stepMsMax = max(m.stepMsMax, ms);
+            m.collisions += countCollisions(doc, collisionOrder);
+            m.steps = step + 1;
+            // every step so that the rings don't fill
+            events.clear();
+            doc.m_sim.drainEvents(eventMask, events);
+            for(const auto& e: events) {
+                m.replans += (e.type == RVO::EVENT_REPLAN);
+                m.planFailures += (e.type == RVO::EVENT_PLAN_FAILED);
+                m.lp3Fallbacks += (e.type == RVO::EVENT_LP3_FALLBACK);
+            }
+            if (reached) {
+                m.allReachedTime = m.steps * FIXED_STEP_TIME;
+                break;
+            }
+        }
+        m.stepMsAvg = (m.steps > 0) ? msSum / m.steps : 0.0f;
+    }
+    catch(const exception& e) {
+        m.error = e.what();
+    }
+    return m;
+}
+
+void BatchRunner::writeCsv(ostream& os, const vector<BatchMetrics>& results)
+{
+    os << "name,neighborDistFactor,maxNeighbors,timeHorizon,timeHorizonObst,goalRadiusScale,steps,allReachedTime,collisions,replans,planFailures,lp3Fallbacks,stepMsAvg,stepMsMax,error\n";
+    for(const auto& m: results) {
+        string error = m.error;
+        replace(error.begin(), error.end(), ',', ';');
+        os << m.name << "," << m.params.neighborDistFactor << "," << m.params.maxNeighbors << "," << m.params.timeHorizon << ","
+           << m.params.timeHorizonObst << "," << m.params.goalRadiusScale << "," << m.steps << "," << m.allReachedTime << ","
+           << m.collisions << "," << m.replans << "," << m.planFailures << "," << m.lp3Fallbacks << "," << m.stepMsAvg << "," << m.stepMsMax << "," << error << "\n";
+    }
+}
+
+static string jsonString(const string& s)
+{
+    string r = "\"";
+    for(char c: s) {
+        if (c == '"' || c == '\\')
+            r += '\\';
+        if (c == '\n') {
+            r += "\\n";
+            continue;
+        }
+        r += c;
+    }
+    return r + "\"";
+}
+
+void BatchRunner::writeJson(ostream& os, const vector<BatchMetrics>& results)
+{
+    os << "[\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const auto& m = results[i];
+        os << "  {\"name\": " << jsonString(m.name)
+           << ", \"neighborDistFactor\": " << m.params.neighborDistFactor << ", \"maxNeighbors\": " << m.params.maxNeighbors
+           << ", \"timeHorizon\": " << m.params.timeHorizon << ", \"timeHorizonObst\": " << m.params.timeHorizonObst
+           << ", \"goalRadiusScale\": " << m.params.goalRadiusScale
+           << ", \"steps\": " << m.steps << ", \"allReachedTime\": " << m.allReachedTime << ", \"collisions\": " << m.collisions
+           << ", \"replans\": " << m.replans << ", \"planFailures\": " << m.planFailures << ", \"lp3Fallbacks\": " << m.lp3Fallbacks
+           << ", \"stepMsAvg\": " << m.stepMsAvg << ", \"stepMsMax\": " << m.stepMsMax
+           << ", \"error\": " << jsonString(m.error) << "}" << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
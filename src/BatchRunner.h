@@ -0,0 +1,82 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Document.h"
+
+using namespace std;
+
+// one simulation of a batch
+struct BatchRun
+{
+    string name;
+    AgentParams params;
+};
+
+// what a run measured
+struct BatchMetrics
+{
+    string name;
+    AgentParams params;
+    int steps = 0; // that ran
+    float allReachedTime = -1.0f; // simulated seconds until all agents with goals reached them, -1 if they did not
+    int collisions = 0; // pairs of agents that overlapped more than BATCH_COLLISION_SLACK, summed over the steps
+    int replans = 0; // plans made, including the first ones
+    int planFailures = 0;
+    int lp3Fallbacks = 0; // agent steps where the ORCA constraints had no solution
+    float stepMsAvg = 0.0f;
+    float stepMsMax = 0.0f;
+    string error; // empty if the run completed
+};
+
+// part of the sum of radiuses two agents may overlap without it counting as a collision
+#define BATCH_COLLISION_SLACK 0.05f
+
+// the scenes of tests/ are in the format of the first version, which had no agent sizes or speeds or goal radiuses.
+// these are what Document::init_test makes its agents and goal with
+#define OLD_SCENE_AGENT_RADIUS 15.0f
+#define OLD_SCENE_AGENT_SPEED 1.0f
+#define OLD_SCENE_GOAL_RADIUS 50.0f
+
+// runs variants of one scene without a display, each in its own Document. the scene is
+// triangulated once and every run takes a copy of the triangulation instead of making it again
+class BatchRunner
+{
+public:
+    // reads the scene file and builds its navigation. throws Exception on failure
+    void loadScene(const string& path);
+    // text in the old format is converted first, see convertOldScene
+    void setSceneText(const string& text);
+    // a scene of the first version (no commas) in the current format. "polyline" and "v x y" make the map,
+    // "goal x y" the goals, "agent x y [goal]" an agent that stands still without the goal index. the path query from
+    // "start x y" to "end x y" and the probed agent of "prob x y" become agents going to the end
+    static string convertOldScene(const string& text);
+    static bool isOldScene(const string& text) {
+        return text.find(',') == string::npos;
+    }
+
+    void addRun(const BatchRun& run) {
+        m_runs.push_back(run);
+    }
+    // one run for every combination of the values, named by them
+    void addSweep(const vector<float>& neighborDistFactor, const vector<int>& maxNeighbors,
+                  const vector<float>& timeHorizon, const vector<float>& timeHorizonObst,
+                  const vector<float>& goalRadiusScale);
+
+    // every run steps until all agents reached their goals or maxSteps. runs are spread on numThreads
+    vector<BatchMetrics> run(int maxSteps, int numThreads);
+
+    static void writeCsv(ostream& os, const vector<BatchMetrics>& results);
+    static void writeJson(ostream& os, const vector<BatchMetrics>& results);
+
+private:
+    BatchMetrics runOne(const BatchRun& run, int maxSteps) const;
+
+    string m_sceneText;
+    NavCache::TKey m_navKey = 0;
+    string m_navDefinition;
+    shared_ptr<const Mesh> m_tri; // read by all the runs
+    vector<BatchRun> m_runs;
+};
@@ -3,15 +3,33 @@
 #include "Objects.h"
 
 #include <algorithm>
+#include <cfloat>
 #include <string.h>
 
 #define MAX_IN_LEAF 5
 
-static bool compX(const Object* a, const Object* b) {
-    return a->m_position.x < b->m_position.x;
-}
-static bool compY(const Object* a, const Object* b) {
-    return a->m_position.y < b->m_position.y;
+// by the center of the bounds, the sum is twice the center. a functor so that nth_element inlines it
+struct CompCenter {
+    int axis;
+    bool operator()(const BihTree::Item& a, const BihTree::Item& b) const {
+        return a.minp.v[axis] + a.maxp.v[axis] < b.minp.v[axis] + b.maxp.v[axis];
+    }
+};
+
+void BihTree::build(std::vector<Object*>& objs)
+{
+    m_nodes.clear();
+    m_items.resize(objs.size());
+    for(size_t i = 0; i < objs.size(); ++i) {
+        const Object* o = objs[i];
+        m_items[i].minp = o->m_position - o->size * 0.5f;
+        m_items[i].maxp = o->m_position + o->size * 0.5f;
+        m_items[i].obj = objs[i];
+    }
+    if (m_items.empty())
+        return;
+    m_nodes.reserve(m_items.size()); // wild guess
+    buildRec(0, m_items.size(), 1);
 }
 
 
@@ -31,23 +49,14 @@ BihTree::NodeRef BihTree::buildRec(int begin, int end, int axis)
 
     int mid = begin + (end - begin)/2;
 
-    if (axis == 0)
-        std::nth_element(m_obj.begin() + begin, m_obj.begin() + mid, m_obj.begin() + end, compX);
-    else
-        std::nth_element(m_obj.begin() + begin, m_obj.begin() + mid, m_obj.begin() + end, compY);
+    std::nth_element(m_items.begin() + begin, m_items.begin() + mid, m_items.begin() + end, CompCenter{axis});
 
-    float maxOfLeft = m_obj[begin]->m_position.v[axis] + m_obj[begin]->size.v[axis] * 0.5;
-    for(int i = begin + 1; i < mid; ++i) {
-        float v = m_obj[i]->m_position.v[axis] + m_obj[i]->size.v[axis];
-        if (v > maxOfLeft)
-            maxOfLeft = v;
-    }
-    float minOfRight = m_obj[mid]->m_position.v[axis] - m_obj[mid]->size.v[axis] * 0.5;
-    for(int i = mid + 1; i < end; ++i) {
-        float v = m_obj[i]->m_position.v[axis] - m_obj[i]->size.v[axis] * 0.5;
-        if (v < minOfRight)
-            minOfRight = v;
-    }
+    float maxOfLeft = -FLT_MAX;
+    for(int i = begin; i < mid; ++i)
+        maxOfLeft = std::max(maxOfLeft, m_items[i].maxp.v[axis]);
+    float minOfRight = FLT_MAX;
+    for(int i = mid; i < end; ++i)
+        minOfRight = std::min(minOfRight, m_items[i].minp.v[axis]);
     n->axis = axis;
     n->maxOfLeft = maxOfLeft;
     n->minOfRight = minOfRight;
@@ -76,34 +85,3 @@ float BihTree::avgNodeSize()
    float avg = sum/count;
    return avg;
 }
-
-void BihTree::recQuery(NodeRef noderef, QueryState& qs) 
-{
-    Node* node = &m_nodes[noderef];
-    if (node->left == 0) { // its a leaf
-        for(int i = node->beginObj; i < node->endObj; ++i) {
-            qs.callback(m_obj[i]);
-        }
-        return;
-    }
-
-    float qcoord = qs.coord.v[node->axis];
-    float qmax = qcoord + qs.radius;
-    float qmin = qcoord - qs.radius;
-    if (qmax < node->minOfRight) { // need only left
-        recQuery(node->left, qs);
-    }
-    else if (qmin > node->maxOfLeft) { // need only right
-        recQuery(node->right, qs);
-    }
-    else {
-        recQuery(node->left, qs);
-        recQuery(node->right, qs);
-    }
-
-}
-
-void BihTree::query(const Vec2& coord, float radius, const std::function<void(Object*)>& callback) {
-    QueryState qs{coord, radius, callback};
-    recQuery(0, qs);
-}
@@ -1,6 +1,8 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "Vec2.h"
 
@@ -21,6 +23,13 @@ private:
     };
 
 public:
+    typedef std::pair<float, Object*> TNeighbor; // distance squared and the object
+    // the bounds of an object are next to it so that a leaf is tested without touching the objects
+    struct Item {
+        Vec2 minp, maxp;
+        Object* obj;
+    };
+
     BihTree()
     {}
     ~BihTree() {
@@ -28,27 +37,149 @@ public:
     }
     NodeRef buildRec(int begin, int end, int axis);
 
-    void build(std::vector<Object*>& objs)
-    {
-        m_obj = objs;
-        m_nodes.clear();
-        m_nodes.reserve(m_obj.size()); // wild guess
-        buildRec(0, m_obj.size(), 1);
-    }
+    void build(std::vector<Object*>& objs);
 
-    struct QueryState {
-        Vec2 coord; 
-        float radius;
-        std::function<void(Object*)> callback;
-    };
-    void recQuery(NodeRef node, QueryState& qs);
-    void query(const Vec2& coord, float radius, const std::function<void(Object*)>& callback);
+    // calls visit(Object*) for every object whose bounds are in the radius of coord.
+    // the visitor is inlined, visit can return false to stop the query
+    template<typename F>
+    void query(const Vec2& coord, float radius, F&& visit) const;
+
+    // the k objects nearest to coord that are in the radius, nearest first, in out. returns their number.
+    // distSq(Object*, float boundsDistSq) gives the distance squared of an object, FLT_MAX to skip it.
+    // the radius shrinks to the k-th distance found so far, so that most of the far subtrees are not visited
+    template<typename D>
+    int nearest(const Vec2& coord, float radius, int k, std::vector<TNeighbor>& out, D&& distSq) const;
+    // with the distance to the bounds of the objects
+    int nearest(const Vec2& coord, float radius, int k, std::vector<TNeighbor>& out) const {
+        return nearest(coord, radius, k, out, [](Object*, float bd) { return bd; });
+    }
 
     float avgNodeSize();
 
 private:
+    // return false if the visitor stopped the query
+    template<typename F>
+    bool queryRec(NodeRef noderef, const Vec2& coord, float radius, F& visit) const;
+    template<typename D>
+    void nearestRec(NodeRef noderef, const Vec2& coord, int k, std::vector<TNeighbor>& out, float& rangeSq, D& distSq) const;
+
+    static float boundsDistSq(const Item& b, const Vec2& p) {
+        float dx = std::max(0.0f, std::max(b.minp.x - p.x, p.x - b.maxp.x));
+        float dy = std::max(0.0f, std::max(b.minp.y - p.y, p.y - b.maxp.y));
+        return dx * dx + dy * dy;
+    }
 
-    std::vector<Object*> m_obj; // needs to be a copy of the objects list since we're going to rearrange in (nth_element)
+    std::vector<Item> m_items; // the objects in the order of the leaves, rearranged by nth_element
     std::vector<Node> m_nodes;
 
-};
\ No newline at end of file
+};
+
+namespace BihDetail {
+    // a visitor that returns void never stops the query
+    template<typename F, typename R>
+    struct Visit {
+        static bool call(F& visit, Object* obj) {
+            return visit(obj);
+        }
+    };
+    template<typename F>
+    struct Visit<F, void> {
+        static bool call(F& visit, Object* obj) {
+            visit(obj);
+            return true;
+        }
+    };
+}
+
+template<typename F>
+bool BihTree::queryRec(NodeRef noderef, const Vec2& coord, float radius, F& visit) const
+{
+    typedef decltype(visit((Object*)nullptr)) TResult;
+    const Node& node = m_nodes[noderef];
+    if (node.left == 0) { // its a leaf
+        const float radiusSq = radius * radius;
+        for(int i = node.beginObj; i < node.endObj; ++i) {
+            if (boundsDistSq(m_items[i], coord) > radiusSq)
+                continue;
+            if (!BihDetail::Visit<F, TResult>::call(visit, m_items[i].obj))
+                return false;
+        }
+        return true;
+    }
+
+    float qcoord = coord.v[node.axis];
+    float qmax = qcoord + radius;
+    float qmin = qcoord - radius;
+    if (qmax < node.minOfRight) // need only left
+        return queryRec(node.left, coord, radius, visit);
+    if (qmin > node.maxOfLeft) // need only right
+        return queryRec(node.right, coord, radius, visit);
+    return queryRec(node.left, coord, radius, visit) && queryRec(node.right, coord, radius, visit);
+}
+
+template<typename F>
+void BihTree::query(const Vec2& coord, float radius, F&& visit) const
+{
+    if (!m_nodes.empty())
+        queryRec(0, coord, radius, visit);
+}
+
+template<typename D>
+void BihTree::nearestRec(NodeRef noderef, const Vec2& coord, int k, std::vector<TNeighbor>& out, float& rangeSq, D& distSq) const
+{
+    const Node& node = m_nodes[noderef];
+    if (node.left == 0)
+    {
+        for(int i = node.beginObj; i < node.endObj; ++i)
+        {
+            const Item& item = m_items[i];
+            float bd = boundsDistSq(item, coord);
+            if (bd >= rangeSq)
+                continue;
+            float d = distSq(item.obj, bd);
+            if (d >= rangeSq)
+                continue;
+            // insertion into the sorted list, the farthest falls off when it is full
+            if ((int)out.size() < k)
+                out.push_back(TNeighbor(d, item.obj));
+            size_t j = out.size() - 1;
+            while (j != 0 && d < out[j - 1].first) {
+                out[j] = out[j - 1];
+                --j;
+            }
+            out[j] = TNeighbor(d, item.obj);
+            if ((int)out.size() == k)
+                rangeSq = out.back().first;
+        }
+        return;
+    }
+
+    // distances of coord from the sides of the children, negative inside. the near child is visited first so
+    // that the radius may have shrunk enough to skip the far one
+    float qcoord = coord.v[node.axis];
+    float dLeft = qcoord - node.maxOfLeft;
+    float dRight = node.minOfRight - qcoord;
+    if (dLeft <= dRight) {
+        if (dLeft <= 0.0f || dLeft * dLeft < rangeSq)
+            nearestRec(node.left, coord, k, out, rangeSq, distSq);
+        if (dRight <= 0.0f || dRight * dRight < rangeSq)
+            nearestRec(node.right, coord, k, out, rangeSq, distSq);
+    }
+    else {
+        if (dRight <= 0.0f || dRight * dRight < rangeSq)
+            nearestRec(node.right, coord, k, out, rangeSq, distSq);
+        if (dLeft <= 0.0f || dLeft * dLeft < rangeSq)
+            nearestRec(node.left, coord, k, out, rangeSq, distSq);
+    }
+}
+
+template<typename D>
+int BihTree::nearest(const Vec2& coord, float radius, int k, std::vector<TNeighbor>& out, D&& distSq) const
+{
+    out.clear();
+    if (m_nodes.empty() || k <= 0)
+        return 0;
+    float rangeSq = radius * radius;
+    nearestRec(0, coord, k, out, rangeSq, distSq);
+    return (int)out.size();
+}
@@ -0,0 +1,166 @@
+#include "Checkpoint.h"
+
+shared_ptr<const SimCheckpoint::PlanState> SimCheckpoint::savePlan(const Plan& plan)
+{
+    auto ps = make_shared<PlanState>();
+    ps->serial = plan.m_serial;
+    ps->segs = plan.m_segs;
+    ps->endp = plan.m_endp;
+    ps->order.reserve(plan.m_d.size());
+    for(const ISubGoal* sg: plan.m_d) {
+        if (sg == &plan.m_endp)
+            ps->order.push_back(-1);
+        else
+            ps->order.push_back((int)(static_cast<const SegmentSubGoal*>(sg) - plan.m_segs.data()));
+    }
+    return ps;
+}
+
+void SimCheckpoint::restorePlan(const PlanState& ps, Plan& plan)
+{
+    plan.m_segs.clear();
+    plan.m_segs.reserve(ps.segs.size()); // the pointers in m_d are to the elements
+    plan.m_segs.insert(plan.m_segs.end(), ps.segs.begin(), ps.segs.end());
+    plan.m_endp = ps.endp;
+    plan.m_d.clear();
+    for(int index: ps.order)
+        plan.m_d.push_back((index < 0) ? static_cast<ISubGoal*>(&plan.m_endp) : &plan.m_segs[index]);
+    plan.m_serial = ps.serial; // same content as when it was saved
+}
+
+void SimCheckpoint::save(const Document& doc, const SimCheckpoint* prev)
+{
+    const auto& agents = doc.m_agents;
+    m_agents.resize(agents.size());
+    m_plans.resize(agents.size());
+    m_bytes = m_agents.size() * sizeof(AgentState) + m_plans.size() * sizeof(m_plans[0]);
+    for(size_t i = 0; i < agents.size(); ++i)
+    {
+        const RVO::Agent* a = agents[i];
+        AgentState& s = m_agents[i];
+        s.handle = a->handle_;
+        s.position = a->m_position;
+        s.velocity = a->m_velocity;
+        s.newVelocity = a->newVelocity_;
+        s.prefVelocity = a->prefVelocity_;
+        s.orientation = a->m_orientation;
+        s.radius = a->m_radius;
+        s.neighborDist = a->neighborDist_;
+        s.maxSpeed = a->maxSpeed_;
+        s.timeHorizon = a->timeHorizon_;
+        s.timeHorizonObst = a->timeHorizonObst_;
+        s.maxNeighbors = a->maxNeighbors_;
+        s.endGoalPos = a->m_endGoalPos;
+        s.endGoalId = a->m_endGoalId;
+        s.indexInPlan = a->m_indexInPlan;
+        s.hasCurGoal = a->m_curGoalPos != nullptr;
+        s.following = a->m_following;
+        s.formationTarget = a->m_formationGoal.p;
+        s.prefSpeed = a->m_prefSpeed;
+        s.reached = a->m_reached;
+        s.asleep = a->m_asleep;
+        s.goalIsReachable = a->m_goalIsReachable;
+        s.lastGoalDists = a->m_lastGoalDists;
+        s.stopUpdate = a->m_stopUpdate;
+        s.stopDist = a->m_stopDist;
+        s.progressIndex = a->m_progressIndex;
+        s.progressDist = a->m_progressDist;
+        s.stuckSteps = a->m_stuckSteps;
+        s.replanBackoff = a->m_replanBackoff;
+        s.replanWait = a->m_replanWait;
+
+        // agents only replan now and then, most plans are the ones of the previous checkpoint.
+        // serials are unique so an equal serial is the same content
+        if (prev != nullptr && i < prev->m_plans.size() && prev->m_plans[i]->serial == a->m_plan.m_serial) {
+            m_plans[i] = prev->m_plans[i];
+            continue;
+        }
+        if (!m_plans[i] || m_plans[i]->serial != a->m_plan.m_serial)
+            m_plans[i] = savePlan(a->m_plan);
+        m_bytes += sizeof(PlanState) + m_plans[i]->segs.size() * sizeof(SegmentSubGoal) + m_plans[i]->order.size() * sizeof(int);
+    }
+
+    m_goals.resize(doc.m_goals.size());
+    m_goalMinDist.resize(doc.m_goals.size());
+    for(size_t i = 0; i < doc.m_goals.size(); ++i) {
+        m_goals[i] = doc.m_goals[i]->serial;
+        m_goalMinDist[i] = doc.m_goals[i]->minDistForStop;
+    }
+    m_bytes += m_goals.size() * (sizeof(m_goals[0]) + sizeof(float));
+    m_groups = doc.m_groups;
+    for(const auto& g: m_groups)
+        m_bytes += sizeof(AgentGroup) + g.followers.size() * (sizeof(RVO::AgentHandle) + sizeof(Vec2));
+
+    m_globalTime = doc.m_sim.globalTime_;
+    m_rng = doc.m_sim.rng_;
+    m_throttle = doc.m_sim.throttle();
+    m_stepDebt = doc.m_stepDebt;
+    m_advanceFrame = doc.m_advanceFrame;
+}
+
+bool SimCheckpoint::restore(Document& doc) const
+{
+    if (m_agents.size() != doc.m_agents.size() || m_goals.size() != doc.m_goals.size())
+        return false;
+    for(size_t i = 0; i < m_agents.size(); ++i)
+        if (m_agents[i].handle != doc.m_agents[i]->handle_)
+            return false;
+    for(size_t i = 0; i < m_goals.size(); ++i)
+        if (m_goals[i] != doc.m_goals[i]->serial)
+            return false;
+
+    for(size_t i = 0; i < m_agents.size(); ++i)
+    {
+        RVO::Agent* a = doc.m_agents[i];
+        const AgentState& s = m_agents[i];
+        a->m_position = s.position;
+        a->m_velocity = s.velocity;
+        a->newVelocity_ = s.newVelocity;
+        a->prefVelocity_ = s.prefVelocity;
+        a->m_orientation = s.orientation;
+        a->m_radius = s.radius;
+        a->neighborDist_ = s.neighborDist;
+        a->maxSpeed_ = s.maxSpeed;
+        a->timeHorizon_ = s.timeHorizon;
+        a->timeHorizonObst_ = s.timeHorizonObst;
+        a->maxNeighbors_ = s.maxNeighbors;
+        a->m_endGoalPos = s.endGoalPos;
+        a->m_endGoalId = s.endGoalId;
+        a->m_reached = s.reached;
+        a->m_asleep = s.asleep;
+        a->m_goalIsReachable = s.goalIsReachable;
+        a->m_lastGoalDists = s.lastGoalDists;
+        a->m_stopUpdate = s.stopUpdate;
+        a->m_stopDist = s.stopDist;
+        a->m_progressIndex = s.progressIndex;
+        a->m_progressDist = s.progressDist;
+        a->m_stuckSteps = s.stuckSteps;
+        a->m_replanBackoff = s.replanBackoff;
+        a->m_replanWait = s.replanWait;
+
+        if (a->m_plan.m_serial != m_plans[i]->serial)
+            restorePlan(*m_plans[i], a->m_plan);
+        a->m_indexInPlan = s.indexInPlan;
+        a->m_following = s.following;
+        a->m_formationGoal.p = s.formationTarget;
+        a->m_prefSpeed = s.prefSpeed;
+        if (s.following)
+            a->m_curGoalPos = &a->m_formationGoal;
+        else
+            a->m_curGoalPos = s.hasCurGoal ? a->m_plan.m_d[s.indexInPlan] : nullptr;
+    }
+
+    for(size_t i = 0; i < m_goals.size(); ++i)
+        doc.m_goals[i]->minDistForStop = m_goalMinDist[i];
+    doc.m_groups = m_groups;
+
+    doc.m_sim.globalTime_ = m_globalTime;
+    doc.m_sim.rng_ = m_rng;
+    doc.m_sim.setThrottle(m_throttle);
+    // the neighbor lists are of the positions before the restore
+    doc.m_sim.resetNeighborLists();
+    doc.m_stepDebt = m_stepDebt;
+    doc.m_advanceFrame = m_advanceFrame;
+    doc.resetStepWarmup();
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Document.h"
+
+using namespace std;
+
+// the mutable state of a Document's simulation, for going back to it and stepping again exactly as before.
+// the agents, goals and map must be the same ones it was saved from, edits are not undone by it.
+// plans are shared between checkpoints as long as the agent did not replan, so a checkpoint is mostly
+// a flat copy of the agents
+class SimCheckpoint
+{
+public:
+    // prev is an earlier checkpoint of the same document whose plans can be shared, or null
+    void save(const Document& doc, const SimCheckpoint* prev);
+    // false and nothing is changed if the document has other agents or goals than when it was saved
+    bool restore(Document& doc) const;
+
+    bool empty() const {
+        return m_agents.empty() && m_goals.empty();
+    }
+    // not counting the plans that are shared with other checkpoints
+    size_t bytes() const {
+        return m_bytes;
+    }
+
+private:
+    struct AgentState
+    {
+        RVO::AgentHandle handle; // the address of a removed agent can be reused by a new one, the handle can't
+        Vec2 position;
+        Vec2 velocity;
+        Vec2 newVelocity;
+        Vec2 prefVelocity;
+        float orientation;
+        float radius;
+        float neighborDist;
+        float maxSpeed;
+        float timeHorizon;
+        float timeHorizonObst;
+        int maxNeighbors;
+        GoalDef endGoalPos;
+        Goal* endGoalId; // one of the goals of the document, restore checks that they are the same ones
+        int indexInPlan;
+        bool hasCurGoal;
+        bool following;
+        Vec2 formationTarget;
+        float prefSpeed;
+        bool reached;
+        bool asleep;
+        bool goalIsReachable;
+        RVO::CyclicBuffer<float, 4> lastGoalDists;
+        float stopUpdate;
+        float stopDist;
+        int progressIndex;
+        float progressDist;
+        int stuckSteps;
+        int replanBackoff;
+        int replanWait;
+    };
+
+    struct PlanState
+    {
+        unsigned long long serial = 0;
+        vector<SegmentSubGoal> segs;
+        PointSubGoal endp;
+        vector<int> order; // of Plan::m_d, index in segs or -1 for endp
+    };
+
+    static shared_ptr<const PlanState> savePlan(const Plan& plan);
+    static void restorePlan(const PlanState& ps, Plan& plan);
+
+    vector<AgentState> m_agents; // same order as Document::m_agents
+    vector<shared_ptr<const PlanState>> m_plans;
+    vector<unsigned long long> m_goals; // Goal::serial, same order as Document::m_goals
+    vector<float> m_goalMinDist;
+    vector<AgentGroup> m_groups;
+
+    float m_globalTime = 0.0f;
+    minstd_rand m_rng;
+    int m_throttle = 0;
+    float m_stepDebt = 0.0f;
+    int m_advanceFrame = 0;
+
+    size_t m_bytes = 0;
+};
@@ -3,6 +3,9 @@
 #include "Agent.h"
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <tuple>
 
 #define SHOW_MARKERS
 
@@ -52,276 +55,418 @@ void Document::init_circle()
 int runTriC(const string& cmd, vector<Vec2>& out);
 
 
-//Vec2 g1,g2;
+void runTri(MapDef* mapdef, Mesh& out);
 
-class SubGoalFromSegment : public ISubGoalMaker
+// add another set of vertices to the mesh with this radius, if its the first time we see it
+void Document::addAgentRadius(float radius)
 {
-public:
-    SubGoalFromSegment(Segment* s) :m_seg(s) 
-    {}
-    virtual void makeSubGoal(float keepDist, const Vec2& goingTo, Plan& addto) {
-        Vec2 a, b;
-        m_seg->justExtPoints(keepDist, &a, &b); // TBD superflous b
-        Vec2 outv = a - m_seg->a; // from segment point outside
-        Vec2 toNext = goingTo - m_seg->a;
-        //g1 = outv; g2 = toNext;
-        bool rev = det(outv, toNext) > 0;
-        addto.addSeg(a, m_seg->dpa, rev); // always take the first, that's how they are built
-        // dpa is not normalized, but it's close to 1 and the length of the SubGoalSegment does not need to be accurate
-    }
-
-    virtual Vec2 makePathRef(float keepDist) {
-        Vec2 a, b;
-        m_seg->justExtPoints(keepDist, &a, &b); // TBD superflous b
-        return a;
+    if (m_mesh.m_vtx.empty())
+        return;
+    if (m_mesh.m_altVtxPosByRadius.find(radius) != m_mesh.m_altVtxPosByRadius.end())
+        return;
+    vector<Vec2>& altVtx = m_mesh.m_altVtxPosByRadius[radius];
+    altVtx.resize(m_mesh.m_vtx.size());
+    for(int i = 0; i < m_mesh.m_vtx.size(); ++i) {
+        if (m_perimeter.hasVertex(i))
+            altVtx[i] = m_perimeter.makePathRef(i, radius);
     }
+}
 
-    Segment* m_seg;
-};
-
+bool checkSelfIntersect(vector<Vec3>& vtx, vector<int>& pl);
 
-class SubGoalFromPointSeg : public ISubGoalMaker
+void Document::runTriangulate()
 {
-public:
-    SubGoalFromPointSeg(PointSegment* ps) :m_pnseg(ps)
-    {}
-    virtual void makeSubGoal(float keepDist, const Vec2& goingTo, Plan& addto) 
+    resetStepWarmup();
+    string definition = NavCache::definitionOf(m_mapdef);
+    NavCache::TKey key = NavCache::keyOf(definition);
+    if (!m_navLive || key != m_navKey || definition != m_navDefinition)
     {
-        Vec2 a, b;
-        m_pnseg->justExtPoints(keepDist, &a, &b);
-        // don't know which order to put them, middle will be enough?
-        Vec2 mid = (a + b)*0.5f - m_pnseg->b;
-        Vec2 toNext = goingTo - m_pnseg->b;
-        if (det(mid, toNext) < 0) { // check which side of the mid line we're coming from and decide what order should the points be
-            addto.addSeg(a, m_pnseg->dpa, false);
-            addto.addSeg(b, m_pnseg->dpb, false);
-        }  // dpa,dpb are not normalized, but close enough, see above
-        else {
-            addto.addSeg(b, m_pnseg->dpb, true); // rev true since if we're coming from this size, determining the isPassed half-plane is reveresed
-            addto.addSeg(a, m_pnseg->dpa, true);
+        stashNav(); // leaves the document with no navigation build
+        NavBuild* cached = m_navCache.take(key, definition);
+        if (cached != nullptr) {
+            restoreNav(cached);
         }
-        //addto.push_back( SubGoal(mid) );
-    }
+        else {
+            if (!m_navCache.loadTri(key, definition, m_mesh)) {
+                runTri(&m_mapdef, m_mesh);
+                m_navCache.saveTri(key, definition, m_mesh);
+            }
 
-    virtual Vec2 makePathRef(float keepDist)
-    {
-        Vec2 a, b;
-        m_pnseg->justExtPoints(keepDist, &a, &b);
-        Vec2 mid = (a + b)*0.5f;
-        return mid;
-    }
+            m_mesh.connectTri(); // also creates permiters
 
-    PointSegment* m_pnseg;
-};
+            // segments for planner
+            m_perimeter.build(m_mesh);
+
+            // sim obstacles
+            vector<Vec2> ob;
+            for(const auto& loop: m_perimeter.m_loops) {
+                m_perimeter.obstacleVertices(loop, ob);
+                m_sim.addObstacle(ob);
+            }
 
+            m_sim.processObstacles();
+        }
+        m_navKey = key;
+        m_navDefinition.swap(definition);
+        m_navLive = true;
+    }
 
+    // redo the radiuses
+    m_mesh.m_altVtxPosByRadius.clear();
+    vector<float> possibleRadiuses;
+    for(auto agent: m_agents)
+        possibleRadiuses.push_back(agent->m_radius);
+    for(float radius: possibleRadiuses) {
+        addAgentRadius(radius);
+    }
 
-#define ANTI_OVERLAP_FACTOR 0.0 //0.1
 
+    //------------------------------------
 
-// return the intersection point of lines L1=a+tv L2=b+ku
-Vec2 lineIntersect(const Vec2& a, const Vec2& v, const Vec2& b, const Vec2& u)
-{
-    float k = (v.x*(b.y-a.y) + v.y*(a.x-b.x))/(u.x*v.y - u.y*v.x);
-    return b+k*u;
+    // agents of a scene stand in groups, their plans share the corridor searches
+    updatePlans(m_agents);
 }
 
 
-class MultiSegMaker 
+// collects the vertices the path passes through, the path is calculated with the
+// position the vertex has for the radius of the agent
+class PlanSketchSink : public IPathSink
 {
 public:
-    MultiSegMaker(vector<Vertex*>& v, Document* doc, MultiSegment* ms)
-        :m_v(v), m_doc(doc), m_ms(ms)
+    PlanSketchSink(vector<Vertex*>& planSketch, const PerimeterStore& perimeter, float radius)
+        :m_planSketch(planSketch), m_perimeter(perimeter), m_radius(radius)
     {}
-
-    Segment* addSegment(const Vec2& a, const Vec2& b, const Vec2& dpa, const Vec2& dpb, int vtxIndex)
-    {
-        auto s = new Segment(a, b, dpa, dpb, m_doc->m_objs.size(), m_ms);
-        m_doc->m_objs.push_back(s);
-        if (vtxIndex >= 0)
-            m_doc->m_seggoals[vtxIndex] = new SubGoalFromSegment(s);
-        return s;
-    }
-    void addPSegment(const Vec2& b, const Vec2& dpa, const Vec2& dpb, int vtxIndex)
-    {
-        auto ps = new PointSegment(b, dpa, dpb, m_doc->m_objs.size());
-        m_doc->m_objs.push_back(ps);
-        m_doc->m_seggoals[vtxIndex] = new SubGoalFromPointSeg(ps);
+    virtual void output(Vertex* v) override {
+        if (v->index == m_prevVtxIndex)
+            return; // string pull may produce the same vertex multiple times, ignore it
+        m_prevVtxIndex = v->index;
+        m_planSketch.push_back(v);
     }
-
-    void makeSegments()
-    {
-        Segment beforeFirst;
-        Segment* prevSeg = &beforeFirst;
-        for(int i = 0; i < m_v.size(); ++i)
-        {
-            const Vec2& a = get(i - 1);
-            const Vec2& b = get(i);
-            const Vec2& c = get(i + 1);
-            Vec2 ab = b - a;
-            Vec2 bc = c - b;
-            Vec2 nab = normalize(ab);
-            Vec2 nbc = normalize(bc);
-            Vec2 dp1 = Vec2(-nab.y, nab.x); // perp to ab
-            Vec2 dp2 = Vec2(-nbc.y, nbc.x); // perp to bc
-            if (dot(ab, bc) < 0) // sharp angle - use the 45 points and add a point segment between
-            {
-                Vec2 dpa = dp1 - nab;
-                Vec2 dpb1 = dp1 + nab;
-                Vec2 dpb1_m = dp1 + nab * (1.0 + ANTI_OVERLAP_FACTOR); 
-                // slightly more, to have overlap between the segment VO and the point VO to avoid floating point problems
-
-                Vec2 dpb2 = dp2 - nbc;
-                Vec2 dpb2_m = dp2 - nbc * (1.0 + ANTI_OVERLAP_FACTOR);
-                Vec2 dpc = dp2 + nbc;
-
-                prevSeg->dpb = dpb1_m;
-
-                addPSegment(b, dpb1, dpb2, m_v[i]->index);
-                prevSeg = addSegment(b, c, dpb2_m, dpc, -1); // PointSegment takes precedence for representing this vertex in m_seggoals
-            }
-            else
-            {
-                Vec2 mid;
-                if (det(ab, bc) != 0) {
-                    Vec2 near_b1 = b + dp1; // near b with distanct perpendicular to ab
-                    Vec2 near_b2 = b + dp2; // near b with distanct perpendicular to bc
-                    mid = lineIntersect(near_b1, nab, near_b2, nbc);
-                    mid = mid - b;
-                }
-                else { // collinear
-                    mid = dp2;
-                }
-
-                //Vec2 amid = normalize(nab - nbc) * SQRT_2;
-                prevSeg->dpb = mid + nab * ANTI_OVERLAP_FACTOR; // avoid overlap
-                prevSeg = addSegment(b, c, mid, mid, m_v[i]->index);
-            }
-            
-
+    virtual Vec2 getPos(Vertex* v) override {
+        if (v->index < 0) { // means its the end dummy vertex
+            return v->p;
         }
-        prevSeg->dpb = beforeFirst.dpb;
-
-    }
-
-    const Vec2& get(int i) {
-        int sz = m_v.size();
-        return m_v[(i + sz)% sz]->p;
+        if (!m_perimeter.hasVertex(v->index))
+            return v->p; // vertex that is not part of a parimiter
+        return m_perimeter.makePathRef(v->index, m_radius);
     }
 
-    vector<Vertex*>& m_v; // vertices of polyline
-    Document* m_doc;
-    MultiSegment* m_ms;
-
+private:
+    vector<Vertex*>& m_planSketch;
+    const PerimeterStore& m_perimeter;
+    float m_radius;
+    int m_prevVtxIndex = -2;
 };
 
+#ifdef NAV_COUNT_ALLOCS
+// the buffers plans are made in, when one of them grows making the plans allocated
+static size_t planCapacity(const Document& doc, RVO::Agent* const* agents, size_t count)
+{
+    size_t capacity = doc.m_corridor.capacity() + doc.m_planSketch.capacity() + doc.m_pathMaker.m_leftPath.capacity() + doc.m_pathMaker.m_rightPath.capacity() +
+                      doc.m_mesh.m_astarQueue.capacity() + doc.m_planJobs.capacity();
+    for(size_t i = 0; i < count; ++i)
+        capacity += agents[i]->m_plan.m_d.capacity() + agents[i]->m_plan.m_segs.capacity();
+    return capacity;
+}
+#endif
 
-void runTri(MapDef* mapdef, Mesh& out);
+// assumnes Agent::setEndGoal was called for this agent
+void Document::updatePlan(RVO::Agent* agent)
+{
+    updatePlans(&agent, 1);
+}
 
-// add another set of vertices to the mesh with this radius, if its the first time we see it
-void Document::addAgentRadius(float radius)
+void Document::updatePlans(const vector<RVO::Agent*>& agents)
 {
-    if (m_mesh.m_vtx.empty())
-        return;
-    if (m_mesh.m_altVtxPosByRadius.find(radius) != m_mesh.m_altVtxPosByRadius.end())
-        return;
-    vector<Vec2>& altVtx = m_mesh.m_altVtxPosByRadius[radius];
-    altVtx.resize(m_mesh.m_vtx.size());
-    for(int i = 0; i < m_mesh.m_vtx.size(); ++i) {
-        if (m_seggoals[i] != nullptr)
-            altVtx[i] = m_seggoals[i]->makePathRef(radius);
-    }
+    updatePlans(agents.data(), agents.size());
 }
 
-bool checkSelfIntersect(vector<Vec3>& vtx, vector<int>& pl);
+void Document::updatePlans(RVO::Agent* const* agents, size_t count)
+{
+#ifdef NAV_COUNT_ALLOCS
+    size_t capacity = planCapacity(*this, agents, count);
+    makePlans(agents, count);
+    if (planCapacity(*this, agents, count) != capacity)
+        m_planBuffersGrew = true;
+#else
+    makePlans(agents, count);
+#endif
+}
 
-void Document::runTriangulate()
+bool Document::startPlan(RVO::Agent* agent, Triangle*& startTri, Triangle*& endTri)
 {
-    vector<Vec2> gt;
-    m_mesh.clear();
-    runTri(&m_mapdef, m_mesh);
+    agent->m_following = false; // updateGroups puts it back in its formation when it is near its slot
+    agent->m_prefSpeed = 1.0f;
+    agent->resetProgress();
+    if (agent->m_asleep)
+        agent->wake(); // the goal or the agent moved
+    if (m_mesh.m_vtx.empty())
+        return false;
+    if (!agent->m_endGoalPos.p.isValid())
+        return false;
 
-    m_mesh.connectTri(); // also creates permiters
+    // find start and end triangles
+    auto it = m_mesh.m_altVtxPosByRadius.find(agent->m_radius);
+    CHECK(it != m_mesh.m_altVtxPosByRadius.end(), "unexpected radius");
+    auto& posReference = it->second;
+    startTri = m_mesh.findContaining(agent->m_position, posReference, startTri);
+    endTri = m_mesh.findContaining(agent->m_endGoalPos.p, posReference, endTri);
 
-    clearObst();
+    agent->m_plan.clear();
+    agent->m_goalIsReachable = false;
+    if (!endTri || !startTri || startTri == endTri)
+    {
+        agent->setTrivialPlan(startTri == endTri);
+        pushPlanEvent(agent);
+        return false;
+    }
+    return true;
+}
 
-    // segments for planner
-    m_multisegs.clear();
-    m_multisegs.resize(m_mesh.m_perimiters.size()); // elements will not change address
-    m_seggoals.clear();
-    m_seggoals.resize(m_mesh.m_vtx.size());
+void Document::makePlans(RVO::Agent* const* agents, size_t count)
+{
+    m_planJobs.clear();
 
-    for(int i = 0; i < m_mesh.m_perimiters.size(); ++i)
+    // agents of a wave are usually next to each other so the previous triangles are tried first
+    Triangle *startHint = nullptr, *endHint = nullptr;
+    for(size_t i = 0; i < count; ++i)
     {
-        auto& poly = m_mesh.m_perimiters[i];
-        int sz = poly.m_d.size();
-        MultiSegMaker ms(poly.m_d, this, &m_multisegs[i]); 
-        ms.makeSegments();
+        PlanJob job{startHint, endHint, agents[i]};
+        bool search = startPlan(job.agent, job.startTri, job.endTri);
+        if (job.startTri != nullptr)
+            startHint = job.startTri;
+        if (job.endTri != nullptr)
+            endHint = job.endTri;
+        if (search)
+            m_planJobs.push_back(job);
     }
 
+    const Triangle* tri0 = m_mesh.m_tri.data();
+    auto key = [&](const PlanJob& j) { return make_tuple(j.agent->m_radius, j.agent->neighborDist_, j.startTri - tri0, j.endTri - tri0); };
+    sort(m_planJobs.begin(), m_planJobs.end(), [&](const PlanJob& a, const PlanJob& b) { return key(a) < key(b); });
 
-    // sim obstacles
-    m_sim.clearObstacles();
-    for(const auto& pr: m_mesh.m_perimiters) {
-        vector<Vec2> ob;
-        ob.reserve(pr.m_d.size());
-        for(int i = pr.m_d.size()-1; i >= 0; --i)  {
-            ob.push_back(pr.m_d[i]->p);
-        } // sim needs to get them CW but here there are CCW
-        m_sim.addObstacle(ob);
+    for(size_t begin = 0, end = 0; begin < m_planJobs.size(); begin = end)
+    {
+        // the middle of points in a triangle is in the triangle
+        Vec2 startMid, endMid;
+        for(end = begin; end < m_planJobs.size() && key(m_planJobs[end]) == key(m_planJobs[begin]); ++end) {
+            startMid += m_planJobs[end].agent->m_position;
+            endMid += m_planJobs[end].agent->m_endGoalPos.p;
+        }
+        startMid /= (float)(end - begin);
+        endMid /= (float)(end - begin);
+
+        const PlanJob& first = m_planJobs[begin];
+        m_corridor.clear();
+        bool found = m_mesh.edgesAstarSearch(startMid, endMid, first.startTri, first.endTri, m_corridor, first.agent->m_radius, first.agent->neighborDist_);
+        for(size_t i = begin; i < end; ++i)
+            planCorridor(m_planJobs[i].agent, found ? &m_corridor : nullptr);
     }
+}
 
-    m_sim.processObstacles();
-
+// where the corridor of the leader goes from where it is, prev if it is not going anywhere
+static Vec2 corridorHeading(const RVO::Agent* leader, const Vec2& prev)
+{
+    if (leader->m_curGoalPos == nullptr)
+        return prev;
+    Vec2 dir = leader->m_curGoalPos->getDest(leader->m_position) - leader->m_position;
+    if (absSq(dir) < 0.0001f)
+        return prev;
+    return normalize(dir);
+}
 
-    // redo the radiuses
-    m_mesh.m_altVtxPosByRadius.clear();
-    vector<float> possibleRadiuses;
-    for(auto agent: m_agents)
-        possibleRadiuses.push_back(agent->m_radius);
-    for(float radius: possibleRadiuses) {
-        addAgentRadius(radius);
-    }
+static void joinFormation(RVO::Agent* agent, const Vec2& slot)
+{
+    agent->m_following = true;
+    agent->m_prefSpeed = GROUP_CATCHUP_SPEED;
+    agent->m_formationGoal.p = slot;
+    agent->m_curGoalPos = &agent->m_formationGoal;
+}
 
+static void removeFollower(AgentGroup& g, size_t i)
+{
+    g.followers[i] = g.followers.back();
+    g.followers.pop_back();
+    g.slots[i] = g.slots.back();
+    g.slots.pop_back();
+}
 
-    //------------------------------------
+// the follower in the front slot becomes the leader
+static void promoteFrontFollower(AgentGroup& g)
+{
+    size_t front = 0;
+    for(size_t i = 1; i < g.slots.size(); ++i)
+        if (g.slots[i].x > g.slots[front].x)
+            front = i;
+    g.leader = g.followers[front];
+    removeFollower(g, front);
+}
 
-    for(auto agent: m_agents)
+void Document::leaveGroups(const vector<RVO::AgentHandle>& agents)
+{
+    auto leaving = [&](const RVO::AgentHandle& h) { return find(agents.begin(), agents.end(), h) != agents.end(); };
+    for(size_t gi = 0; gi < m_groups.size(); )
     {
-        updatePlan(agent); 
+        AgentGroup& g = m_groups[gi];
+        for(size_t i = 0; i < g.followers.size(); ) {
+            if (leaving(g.followers[i]))
+                removeFollower(g, i);
+            else
+                ++i;
+        }
+        if (leaving(g.leader) && !g.followers.empty()) {
+            promoteFrontFollower(g);
+            updatePlan(m_sim.getAgent(g.leader));
+        }
+        if (g.followers.empty()) {
+            RVO::Agent* leader = m_sim.getAgent(g.leader);
+            if (leader != nullptr)
+                leader->m_prefSpeed = 1.0f;
+            m_groups.erase(m_groups.begin() + gi);
+            continue;
+        }
+        ++gi;
     }
 }
 
-
-// assumnes Agent::setEndGoal was called for this agent
-void Document::updatePlan(RVO::Agent* agent)
+int Document::addGroup(const vector<RVO::AgentHandle>& agents)
 {
-    if (m_mesh.m_vtx.empty())
-        return;
-    if (!agent->m_endGoalPos.p.isValid())
-        return;
-    const Vec2& startp = agent->m_position;
-    const Vec2& endp = agent->m_endGoalPos.p;
+    resetStepWarmup();
+    leaveGroups(agents);
+    RVO::Agent* leader = nullptr;
+    float leaderDistSq = FLT_MAX;
+    for(const auto& h: agents) {
+        RVO::Agent* a = m_sim.getAgent(h);
+        if (a == nullptr || a->m_endGoalId == nullptr)
+            continue;
+        float d = distSq(a->m_position, a->m_endGoalPos.p);
+        if (d < leaderDistSq) {
+            leader = a;
+            leaderDistSq = d;
+        }
+    }
+    CHECK(leader != nullptr, "A group needs an agent with a goal");
+    updatePlan(leader);
+
+    AgentGroup group;
+    group.leader = leader->handle_;
+    group.heading = corridorHeading(leader, normalize(leader->m_endGoalPos.p - leader->m_position));
+    const Vec2 side(-group.heading.y, group.heading.x);
+
+    // the followers that are furthest ahead take the front rows, in each row the ones on the left take the left slots
+    vector<RVO::Agent*> followers;
+    float maxRadius = leader->m_radius;
+    for(const auto& h: agents) {
+        RVO::Agent* a = m_sim.getAgent(h);
+        if (a == nullptr || a == leader)
+            continue;
+        if (a->m_endGoalId != leader->m_endGoalId) {
+            updatePlan(a); // not in the group, goes on its own
+            continue;
+        }
+        followers.push_back(a);
+        maxRadius = max(maxRadius, a->m_radius);
+    }
+    group.spacing = maxRadius * GROUP_SLOT_SPACING;
+    const Vec2 origin = leader->m_position;
+    sort(followers.begin(), followers.end(), [&](const RVO::Agent* a, const RVO::Agent* b) {
+        return (a->m_position - origin) * group.heading > (b->m_position - origin) * group.heading;
+    });
+    // rows as wide as the formation is deep
+    const int cols = max(1, (int)std::ceil(std::sqrt((float)followers.size())));
+    for(int rowStart = 0, row = 1; rowStart < (int)followers.size(); rowStart += cols, ++row)
+    {
+        const int rowEnd = min((int)followers.size(), rowStart + cols);
+        sort(followers.begin() + rowStart, followers.begin() + rowEnd, [&](const RVO::Agent* a, const RVO::Agent* b) {
+            return (a->m_position - origin) * side > (b->m_position - origin) * side;
+        });
+        for(int i = rowStart; i < rowEnd; ++i) {
+            RVO::Agent* a = followers[i];
+            Vec2 slot(-row * group.spacing, ((rowEnd - rowStart - 1) * 0.5f - (i - rowStart)) * group.spacing);
+            group.followers.push_back(a->handle_);
+            group.slots.push_back(slot);
+            if (a->m_asleep)
+                a->wake();
+            joinFormation(a, origin + group.heading * slot.x + side * slot.y);
+        }
+    }
 
-    // find start and end triangles
-    auto it = m_mesh.m_altVtxPosByRadius.find(agent->m_radius);
-    CHECK(it != m_mesh.m_altVtxPosByRadius.end(), "unexpected radius");
-    auto posReference = it->second;
-    Triangle* startTri = m_mesh.findContaining(startp, posReference);
-    Triangle* endTri = m_mesh.findContaining(endp, posReference);
+    m_groups.push_back(move(group));
+    return (int)m_groups.size() - 1;
+}
 
-    agent->m_plan.clear();
-    agent->m_goalIsReachable = false;
-    if (!endTri || !startTri || startTri == endTri) 
+void Document::updateGroups()
+{
+    for(size_t gi = 0; gi < m_groups.size(); )
     {
-        agent->setTrivialPlan(startTri == endTri);
-        return;
+        AgentGroup& g = m_groups[gi];
+        RVO::Agent* leader = m_sim.getAgent(g.leader);
+
+        // followers that were removed or sent to another goal leave the group
+        for(size_t i = 0; i < g.followers.size(); ) {
+            RVO::Agent* f = m_sim.getAgent(g.followers[i]);
+            if (f != nullptr && (leader == nullptr || f->m_endGoalId == leader->m_endGoalId)) {
+                ++i;
+                continue;
+            }
+            if (f != nullptr && f->m_following)
+                updatePlan(f);
+            removeFollower(g, i);
+        }
+        // the follower in the front slot takes the place of a leader that was removed
+        if (leader == nullptr && !g.followers.empty()) {
+            promoteFrontFollower(g);
+            leader = m_sim.getAgent(g.leader);
+            updatePlan(leader);
+        }
+        if (g.followers.empty()) {
+            if (leader != nullptr)
+                leader->m_prefSpeed = 1.0f;
+            m_groups.erase(m_groups.begin() + gi);
+            continue;
+        }
+
+        // followers find their own way to the goal once the leader stopped
+        const bool leaderStopped = leader->m_reached || leader->m_asleep || leader->m_curGoalPos == nullptr;
+        // the formation turns gradually so the slots in the back rows don't swing away from their followers at corners
+        Vec2 heading = corridorHeading(leader, g.heading);
+        if (heading * g.heading > 0.0f)
+            heading = normalize(g.heading + (heading - g.heading) * GROUP_TURN_RATE);
+        g.heading = heading;
+        const Vec2 side(-g.heading.y, g.heading.x);
+        float maxLagSq = 0.0f;
+        for(size_t i = 0; i < g.followers.size(); ++i)
+        {
+            RVO::Agent* f = m_sim.getAgent(g.followers[i]);
+            if (f->m_asleep || f->m_reached)
+                continue;
+            const Vec2 slot = leader->m_position + g.heading * g.slots[i].x + side * g.slots[i].y;
+            const float dSq = distSq(f->m_position, slot);
+            if (f->m_following) {
+                if (leaderStopped || dSq > sqr(GROUP_SEPARATE_SLOTS * g.spacing))
+                    updatePlan(f);
+                else {
+                    f->m_formationGoal.p = slot;
+                    maxLagSq = max(maxLagSq, dSq);
+                }
+            }
+            else if (!leaderStopped && dSq < sqr(GROUP_REJOIN_SLOTS * g.spacing)) {
+                joinFormation(f, slot);
+            }
+        }
+        leader->m_prefSpeed = (maxLagSq > sqr(GROUP_REJOIN_SLOTS * g.spacing)) ? GROUP_WAIT_SPEED : 1.0f;
+        ++gi;
     }
+}
 
-    // find corridor
-    vector<Triangle*> corridor;
-    if (m_mesh.edgesAstarSearch(startp, endp, startTri, endTri, corridor, agent->m_radius))
+// the plan of the agent along the corridor from its start triangle to its end triangle, or towards the goal if it is null
+void Document::planCorridor(RVO::Agent* agent, const vector<Triangle*>* corridorp)
+{
+    const Vec2& startp = agent->m_position;
+    const Vec2& endp = agent->m_endGoalPos.p;
+    if (corridorp != nullptr)
     {
+        const vector<Triangle*>& corridor = *corridorp;
         //for(auto* t: corridor)
         //    if (t->highlight == 0)
         //        t->highlight = 3;
@@ -329,26 +474,10 @@ void Document::updatePlan(RVO::Agent* agent)
         agent->m_plan.reserve(corridor.size() * 2); // size of the corridor is the max it can get to, every triangle can add 2 point if the angle is sharp
 
         // make path from corridor
-        int prevVtxIndex = -2;
-        vector<Vertex*> planSketch;
-        PathMaker::TOutputCallback outf([&](Vertex* v) {
-            if (v->index == prevVtxIndex)
-                return; // string pull may produce the same vertex multiple times, ignore it
-            prevVtxIndex = v->index;
-            planSketch.push_back(v);
-        });
-        PathMaker::TGetPosCallback posf([&](Vertex* v)->Vec2 {
-            if (v->index < 0) { // means its the end dummy vertex
-                return v->p;
-            }
-            auto* subGoalMaker = m_seggoals[v->index];
-            if (subGoalMaker == nullptr)
-                return v->p; // vertex that is not part of a parimiter
-                             //CHECK(subGoalMaker != nullptr, "null subGoalMaker");
-            return subGoalMaker->makePathRef(agent->m_radius);
-        });
-        PathMaker pm(outf, posf);
-        pm.makePath(corridor, startp, endp);
+        vector<Vertex*>& planSketch = m_planSketch;
+        planSketch.clear();
+        PlanSketchSink sink(planSketch, m_perimeter, agent->m_radius);
+        m_pathMaker.makePath(corridor, startp, endp, &sink);
 
         // make the actual plan when all vertices are known since we need to reference the next vertex
         //Vec2 prevInPath = startp;
@@ -359,20 +488,17 @@ void Document::updatePlan(RVO::Agent* agent)
                 agent->m_plan.setEnd(v->p, agent->m_endGoalPos.radius);
             }
             else {
-                auto* subGoalMaker = m_seggoals[v->index];
                 Vec2 nextPosInPath;
-                if (subGoalMaker == nullptr)
+                if (!m_perimeter.hasVertex(v->index))
                     continue; // vertex that is not part of a parimiter
 
-                //CHECK(subGoalMaker != nullptr, "null subGoalMaker");
-
                 int nextIndex = planSketch[i+1]->index;
-                if (nextIndex < 0 || m_seggoals[nextIndex] == nullptr) // vertex that is not part of a parimiter
+                if (nextIndex < 0 || !m_perimeter.hasVertex(nextIndex)) // vertex that is not part of a parimiter
                     nextPosInPath = planSketch[i+1]->p;
                 else 
-                    nextPosInPath = m_seggoals[nextIndex]->makePathRef(agent->m_radius);
+                    nextPosInPath = m_perimeter.makePathRef(nextIndex, agent->m_radius);
 
-                subGoalMaker->makeSubGoal(agent->m_radius, nextPosInPath, agent->m_plan);
+                m_perimeter.makeSubGoal(v->index, agent->m_radius, nextPosInPath, agent->m_plan);
 
             }   
 
@@ -394,33 +520,55 @@ void Document::updatePlan(RVO::Agent* agent)
         agent->m_indexInPlan = 0;
         agent->m_curGoalPos = agent->m_plan.m_d[agent->m_indexInPlan];
     }
+    pushPlanEvent(agent);
+}
+
+void Document::pushPlanEvent(const RVO::Agent* agent)
+{
+    if (agent->m_goalIsReachable)
+        m_sim.pushEvent(RVO::EVENT_REPLAN, agent->handle_, (float)agent->m_plan.m_d.size());
+    else
+        m_sim.pushEvent(RVO::EVENT_PLAN_FAILED, agent->handle_, 0.0f);
+}
 
+// if the live build is not complete (triangulation failed) its leftovers are discarded
+void Document::stashNav()
+{
+    auto* b = new NavBuild;
+    b->mesh.swap(m_mesh);
+    b->perimeter.swap(m_perimeter);
+    m_sim.swapObstacles(b->obstacleStore, b->obstacles, b->obstacleTree);
+    if (m_navLive)
+        m_navCache.put(m_navKey, m_navDefinition, b);
+    else
+        delete b;
+    m_navLive = false;
+}
 
+void Document::restoreNav(NavBuild* b)
+{
+    // called after stashNav() so all of these are empty
+    m_mesh.swap(b->mesh);
+    m_perimeter.swap(b->perimeter);
+    m_sim.swapObstacles(b->obstacleStore, b->obstacles, b->obstacleTree);
+    delete b;
 }
 
 void Document::clearAllObj()
 {
+    stashNav(); // in case the same map is loaded again
     for(auto* obj: m_objs)
         delete obj;
     m_objs.clear();
     //m_agents.clear();
     m_sim.clear();
+    m_groups.clear();
     m_prob = nullptr;
 }
 
 void Document::clearObst()
 {
-    auto it = m_objs.begin();
-    while (it != m_objs.end()) 
-    {
-        Object* o = *it;
-        if (dynamic_cast<Segment*>(o) != nullptr || dynamic_cast<PointSegment*>(o) != nullptr) {
-            delete o;
-            it = m_objs.erase(it);
-        }
-        else
-            ++it;
-    }
+    m_perimeter.clear();
 }
 
 Goal* Document::addGoal(const Vec2& p, float radius, EGoalType type) {
@@ -431,6 +579,12 @@ Goal* Document::addGoal(const Vec2& p, float radius, EGoalType type) {
     return ptr;
 }
 void Document::removeGoal(Goal* g) {
+    // its agents keep going to where it was but don't point to it
+    for(const auto& h: g->agents) {
+        RVO::Agent* a = m_sim.getAgent(h);
+        if (a != nullptr && a->m_endGoalId == g)
+            a->m_endGoalId = nullptr;
+    }
     auto it = m_goals.begin();
     while(it != m_goals.end()) {
         if (it->get() == g) 
@@ -443,23 +597,25 @@ void Document::removeGoal(Goal* g) {
 RVO::Agent* Document::addAgent(const Vec2& pos, Goal* g, float radius, float maxSpeed)
 {
     CHECK(maxSpeed > 0, "unexpected negative maxSpeed");
+    resetStepWarmup();
     //OUT("addAgent " << pos << " " << g << " " << radius << " " << prefSpeed << " " << maxSpeed);
     RVO::Agent* a = new RVO::Agent(m_agents.size(), pos,
         (g != nullptr)?g->def : GoalDef(), // goal 
-        radius * NEI_DIST_RADIUS_FACTOR, //30 for r=15, 15 for r=6, // 400 nei dist
-        10, // max nei
-        5.0f, // timeHorizon
-        5.0f, // timeHorizonObst
+        radius * m_agentParams.neighborDistFactor, //30 for r=15, 15 for r=6, // 400 nei dist
+        m_agentParams.maxNeighbors,
+        m_agentParams.timeHorizon,
+        m_agentParams.timeHorizonObst,
         radius, // 15 radius
         maxSpeed); // max speed
                //a->m_velocity = Vec2(0, 1);
     //m_objs.push_back(a);
-    m_agents.push_back(a);
+    m_sim.addAgent(a);
  //   if (m_agents.size() == 1)
  //       m_prob = a;
 
     if (g != nullptr) {
-        g->agents.push_back(a);
+        a->m_endGoalId = g; // so that it knows when it reached the goal and can sleep
+        g->agents.push_back(a->handle_);
     }
 
     addAgentRadius(radius);
@@ -467,17 +623,80 @@ RVO::Agent* Document::addAgent(const Vec2& pos, Goal* g, float radius, float max
     return a;
 }
 
+void Document::addAgents(const vector<Vec2>& positions, const vector<float>& radiuses, const vector<float>& maxSpeeds, Goal* g,
+                         vector<RVO::AgentHandle>* handles)
+{
+    const size_t count = positions.size();
+    CHECK(radiuses.size() == count || radiuses.size() == 1, "addAgents needs a radius for every position or one for all");
+    CHECK(maxSpeeds.size() == count || maxSpeeds.size() == 1, "addAgents needs a speed for every position or one for all");
+    if (count == 0)
+        return;
+    resetStepWarmup();
+
+    m_sim.reserveAgents(m_agents.size() + count);
+    if (g != nullptr)
+        g->agents.reserve(g->agents.size() + count);
+    if (handles != nullptr)
+        handles->reserve(handles->size() + count);
+
+    // a wave has few radiuses, mostly in runs
+    float prevRadius = -1.0f;
+    for(float radius: radiuses) {
+        if (radius != prevRadius)
+            addAgentRadius(radius);
+        prevRadius = radius;
+    }
 
+    m_spawned.clear();
+    m_spawned.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        const float radius = radiuses[(radiuses.size() == 1) ? 0 : i];
+        const float maxSpeed = maxSpeeds[(maxSpeeds.size() == 1) ? 0 : i];
+        CHECK(maxSpeed > 0, "unexpected negative maxSpeed");
+        RVO::Agent* a = new RVO::Agent(m_agents.size(), positions[i],
+            (g != nullptr) ? g->def : GoalDef(),
+            radius * m_agentParams.neighborDistFactor,
+            m_agentParams.maxNeighbors,
+            m_agentParams.timeHorizon,
+            m_agentParams.timeHorizonObst,
+            radius,
+            maxSpeed);
+        m_sim.addAgent(a);
+        if (g != nullptr) {
+            a->m_endGoalId = g;
+            g->agents.push_back(a->handle_);
+        }
+        if (handles != nullptr)
+            handles->push_back(a->handle_);
+        m_spawned.push_back(a);
+    }
 
+    if (g != nullptr)
+        updatePlans(m_spawned);
+}
 
-// ----------------------------------------------
-
-/*
-void Document::clearSegMinDist()
+void Document::removeAgent(RVO::AgentHandle h)
 {
-    for(auto& ms: m_multisegs)
-        ms.clear();
-}*/
+    RVO::Agent* a = m_sim.getAgent(h);
+    if (a == nullptr)
+        return;
+    resetStepWarmup();
+    if (a->m_endGoalId != nullptr) {
+        auto& goalAgents = a->m_endGoalId->agents;
+        auto it = find(goalAgents.begin(), goalAgents.end(), h);
+        if (it != goalAgents.end()) {
+            *it = goalAgents.back();
+            goalAgents.pop_back();
+        }
+    }
+    m_sim.removeAgent(h);
+}
+
+
+
+
+// ----------------------------------------------
 
 bool Document::shouldReplan(RVO::Agent* agent)
 {
@@ -489,7 +708,7 @@ bool Document::shouldReplan(RVO::Agent* agent)
     for(auto& ra: agent->agentNeighbors_) 
     {
         hasAgentsNei = true;
-        auto* a = ra.second;
+        auto* a = m_agents[ra.second];
         if (a->m_endGoalId != agent->m_endGoalId)
             allSameGoal = false;
 
@@ -503,35 +722,90 @@ bool Document::shouldReplan(RVO::Agent* agent)
     return false;
 }
 
-#define REPLAN_VEL_THRESH (0.1)
+// replan the agents that are stuck, the ones stuck the longest first. at most m_replanBudget in a step so that
+// a crowd that stalls at a choke point does not replan all at once. an agent that is still stuck after
+// a replan waits twice as long for the next one
+void Document::scheduleReplans()
+{
+    m_replanQueue.reserve(m_agents.size());
+    m_replanQueue.clear();
+    for(int index: m_sim.activeAgents_) {
+        auto* agent = m_agents[index];
+        // on the last leg the agent goes straight to the goal, a new plan would be the same
+        if (agent->isStuck() && agent->m_replanWait == 0 && !agent->m_reached && !agent->m_following && agent->m_indexInPlan + 1 < (int)agent->m_plan.m_d.size())
+            m_replanQueue.push_back(agent);
+    }
+    size_t count = min(m_replanQueue.size(), (size_t)max(0, m_replanBudget));
+    partial_sort(m_replanQueue.begin(), m_replanQueue.begin() + count, m_replanQueue.end(), [](const RVO::Agent* a, const RVO::Agent* b) {
+        return (a->m_stuckSteps != b->m_stuckSteps) ? a->m_stuckSteps > b->m_stuckSteps : a->id_ < b->id_;
+    });
+    for(size_t i = 0; i < count; ++i)
+    {
+        auto* agent = m_replanQueue[i];
+        int backoff = min(max(STUCK_STEPS, agent->m_replanBackoff * 2), REPLAN_MAX_BACKOFF);
+        if (shouldReplan(agent))
+            updatePlan(agent);
+        else
+            agent->resetProgress(); // held by agents of other goals, a new plan would not help
+        agent->m_replanBackoff = backoff;
+        agent->m_replanWait = backoff;
+    }
+}
 
 // returns true if nothing changed
 bool Document::doStep(float deltaTime, bool doUpdate, int dbg_frameNum)
+{
+#ifdef NAV_COUNT_ALLOCS
+    // the buffers of the step grow while the agents first meet their neighbors and obstacles,
+    // after that every step should reuse them. the Verlet lists also grow when a crowd gets denser than before
+    // and the plan buffers when a replan is longer than any plan before. the workers of the step count their own
+    size_t allocsBefore = navAllocCount() + m_sim.workerAllocCount();
+    m_planBuffersGrew = false;
+    bool ret = stepAgents(deltaTime, doUpdate, dbg_frameNum);
+    if (++m_stepsSinceChange > ALLOC_WARMUP_STEPS && !m_sim.candidateListsGrew() && !m_planBuffersGrew)
+        CHECK(navAllocCount() + m_sim.workerAllocCount() == allocsBefore, "doStep allocated after warm-up");
+    return ret;
+#else
+    return stepAgents(deltaTime, doUpdate, dbg_frameNum);
+#endif
+}
+
+bool Document::stepAgents(float deltaTime, bool doUpdate, int)
 {
     if (deltaTime <= 0.0f)
         return false;
     if (m_agents.size() == 0)
         return true;
 
+    // before the agents are collected since separated followers get a plan
+    if (!m_groups.empty())
+        updateGroups();
+
    // BihTree m_bihTree(m_objs);
  //   m_bihTree.build(m_objs);
 
-    m_sim.kdTree_.buildAgentTree();
+    m_sim.prepareStep();
 
-    for(auto* agent: m_agents)
+    // agents only write their own state in these loops so they are split between the threads.
+    // only the active agents are stepped, the sleeping ones and the ones without a goal stand still
+    const vector<int>& active = m_sim.activeAgents_;
+    m_sim.threadPool_.parallelForWorker((int)active.size(), AGENTS_CHUNK_SIZE, [&](int worker, int begin, int end)
     {
-        if (agent->m_curGoalPos == nullptr)
-            continue;
-        agent->computePreferredVelocity(deltaTime);
+        RVO::AgentScratch& scratch = m_sim.agentScratch_[worker];
+        for(int i = begin; i < end; ++i)
+        {
+            auto* agent = m_agents[active[i]];
+            agent->computePreferredVelocity(deltaTime);
 
-        agent->computeNeighbors(m_sim.kdTree_);
+            agent->computeNeighbors(m_sim, scratch);
 
-      /*  VODump* vod = nullptr;
-        if (m_debugVoDump != nullptr && agent == m_prob)
-            vod = m_debugVoDump;
-*/
-        agent->computeNewVelocity(deltaTime);
-    }
+          /*  VODump* vod = nullptr;
+            if (m_debugVoDump != nullptr && agent == m_prob)
+                vod = m_debugVoDump;
+    */
+            agent->computeNewVelocity(m_sim.agentStore_, deltaTime, scratch);
+        }
+    });
 
 
 
@@ -541,28 +815,38 @@ bool Document::doStep(float deltaTime, bool doUpdate, int dbg_frameNum)
     if (!doUpdate)
         return false;
 
+    m_sim.threadPool_.parallelForWorker((int)active.size(), AGENTS_CHUNK_SIZE, [&](int worker, int begin, int end)
+    {
+        RVO::AgentScratch& scratch = m_sim.agentScratch_[worker];
+        RVO::EventRing& events = *scratch.events;
+        scratch.updated.clear();
+        for(int i = begin; i < end; ++i)
+        {
+            auto* agent = m_agents[active[i]];
+            if (agent->m_reached)
+                continue;
+
+            agent->update(deltaTime, events);
+            scratch.updated.push_back(agent);
+            //cout << agent << " POS=" << agent->m_position << " VEL=" << agent->m_velocity << " RCH=" << agent->m_reached << endl;
+        }
+        RVO::Agent::updateOrientations(scratch.updated.data(), (int)scratch.updated.size(), deltaTime, scratch);
+    });
+
+    for (int index: active)
+    {
+        auto* agent = m_agents[index];
+        agent->commitGoalUpdate();
+        m_sim.updateSleep(agent);
+    }
+    scheduleReplans();
+
     bool reachedGoals = true;
     for (auto* agent: m_agents) 
     {
         if (agent->m_curGoalPos == nullptr)
             continue;
-        if (agent->m_reached)
-            continue;
-
-        agent->update(deltaTime);
-        //cout << agent << " POS=" << agent->m_position << " VEL=" << agent->m_velocity << " RCH=" << agent->m_reached << endl;
         reachedGoals &= agent->m_reached;
-
-        // detect need to replay
-        auto velSq = absSq(agent->m_velocity);
-   /*     if (!agent->m_reached && velSq < REPLAN_VEL_THRESH * REPLAN_VEL_THRESH)  // TBD-conflics with goal reach resolution
-        {
-            cout << "what-replan " << agent->m_reached << endl;
-            if (shouldReplan(agent)) {
-                OUT("f" << dbg_frameNum << " Agent " << agent->id_ << " replan");
-                updatePlan(agent);
-            }
-        }*/
     }
 
     //m_globalTime += deltaTime;
@@ -570,6 +854,55 @@ bool Document::doStep(float deltaTime, bool doUpdate, int dbg_frameNum)
 }
 
 
+#define MAX_STEP_DEBT (4)
+
+static float msSince(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+}
+
+AdvanceReport Document::advance(float realTime, float cpuBudgetMs)
+{
+    AdvanceReport report;
+    const auto start = chrono::steady_clock::now();
+    m_stepDebt += realTime;
+
+    // the small slack is for the float error of adding up the time
+    while (m_stepDebt > FIXED_STEP_TIME * 0.999f)
+    {
+        // at least one step so that a scene that is too big still moves
+        if (report.steps > 0 && msSince(start) + m_stepMs > cpuBudgetMs)
+            break;
+        const auto stepStart = chrono::steady_clock::now();
+        report.reachedGoals = doStep(FIXED_STEP_TIME, true, m_advanceFrame++);
+        const float ms = msSince(stepStart);
+        m_stepMs = (m_stepMs == 0.0f) ? ms : (m_stepMs * 0.8f + ms * 0.2f);
+        m_stepDebt -= FIXED_STEP_TIME;
+        ++report.steps;
+    }
+    m_stepDebt = max(m_stepDebt, 0.0f);
+
+    int due = (int)(m_stepDebt / FIXED_STEP_TIME + 0.001f);
+    if (due > MAX_STEP_DEBT) {
+        report.skippedSteps = due - MAX_STEP_DEBT;
+        m_stepDebt -= report.skippedSteps * FIXED_STEP_TIME;
+    }
+
+    // lower the detail when the next call, with the same realTime, is not expected to fit the budget
+    // and raise it back when it fits well below. the gap is so that it does not flip every frame
+    float nextMs = m_stepMs * ((m_stepDebt + realTime) / FIXED_STEP_TIME);
+    int throttle = m_sim.throttle();
+    if (report.skippedSteps > 0 || nextMs > cpuBudgetMs)
+        ++throttle;
+    else if (nextMs < cpuBudgetMs * 0.25f)
+        --throttle;
+    m_sim.setThrottle(throttle);
+
+    report.throttle = m_sim.throttle();
+    report.stepMs = m_stepMs;
+    return report;
+}
+
+
 void Document::serialize(ostream& os)
 {
     set<string> wroteImport;
@@ -581,6 +914,11 @@ void Document::serialize(ostream& os)
         os << "i," << kv.second << ",\n";
     }
 
+    if (m_sim.broadphaseType() == RVO::BROADPHASE_GRID)
+        os << "o,broadphase,grid,\n";
+    if (m_replanBudget != REPLAN_BUDGET)
+        os << "o,replan_budget," << m_replanBudget << ",\n";
+
     int count = 0;
     for(const auto& pl : m_mapdef.m_pl) {
         if (pl->m_d.size() == 0)
@@ -599,15 +937,18 @@ void Document::serialize(ostream& os)
         os << "b," << b->v[0]->p.x << "," << b->v[0]->p.y << "," << b->v[2]->p.x << "," << b->v[2]->p.y << ",\n";
     }
 
-    map<RVO::Agent*, int> agentToGoal;
+    vector<int> agentToGoal(m_agents.size(), -1); // by index of the agent
     for(int i = 0; i < m_goals.size(); ++i) {
         auto& g = m_goals[i];
-        for(auto* ag: g->agents)
-            agentToGoal[ag] = i;
+        for(const auto& h: g->agents) {
+            auto* ag = m_sim.getAgent(h);
+            if (ag != nullptr)
+                agentToGoal[ag->id_] = i;
+        }
         os << "g," << g->def.p.x << "," << g->def.p.y << "," << g->def.radius << "," << g->def.type << ",\n";
     }
     for(auto* agent: m_agents)
-        os << "a," << agent->m_position.x << "," << agent->m_position.y << "," << ((agentToGoal.find(agent) != agentToGoal.end())?agentToGoal[agent]:-1)
+        os << "a," << agent->m_position.x << "," << agent->m_position.y << "," << agentToGoal[agent->id_]
            << "," << agent->m_velocity.x << "," << agent->m_velocity.y << "," << agent->m_radius << "," << agent->maxSpeed_ << ",\n";
 
     //cout << "Saved " << count << " vertices, " << m_doc->m_mapdef.m_pl.size() << " polylines" << endl;
@@ -616,6 +957,37 @@ void Document::serialize(ostream& os)
 
 #define MULT_FACTOR 1
 
+// consecutive agents of a scene that go to the same goal, added together with addAgents
+struct SceneWave
+{
+    void add(Goal* g, const Vec2& pos, const Vec2& vel, float radius, float maxSpeed, Document& doc) {
+        if (g != goal)
+            flush(doc);
+        goal = g;
+        positions.push_back(pos);
+        velocities.push_back(vel);
+        radiuses.push_back(radius);
+        maxSpeeds.push_back(maxSpeed);
+    }
+    void flush(Document& doc) {
+        if (positions.empty())
+            return;
+        handles.clear();
+        doc.addAgents(positions, radiuses, maxSpeeds, goal, &handles);
+        for(size_t i = 0; i < handles.size(); ++i)
+            doc.m_sim.getAgent(handles[i])->m_velocity = velocities[i];
+        positions.clear();
+        velocities.clear();
+        radiuses.clear();
+        maxSpeeds.clear();
+    }
+
+    Goal* goal = nullptr;
+    vector<Vec2> positions, velocities;
+    vector<float> radiuses, maxSpeeds;
+    vector<RVO::AgentHandle> handles;
+};
+
 void Document::readStream(istream& is, map<string, string>& imported, const string& module)
 {
     // see http://stackoverflow.com/questions/7302996/changing-the-delimiter-for-cin-c
@@ -624,11 +996,14 @@ void Document::readStream(istream& is, map<string, string>& imported, const stri
     is.imbue(locale(cin.getloc(), new ctype<char>(bar.data()))); // treat comma as a space, locale will delete it
 
     int count = 0;
+    SceneWave wave;
     while (!is.eof()) 
     {
         string h;
         is >> h;
         //OUT("CMD `" << h << "`");
+        if (h[0] != 'a')
+            wave.flush(*this); // keeps the order of the agents of imported files
         if (h[0] == 'p') {
             m_mapdef.add(module);
         }
@@ -649,7 +1024,7 @@ void Document::readStream(istream& is, map<string, string>& imported, const stri
             v *= MULT_FACTOR;
             if (is.fail())
                 break;
-            addGoal(v, radius, (EGoalType)type);
+            addGoal(v, radius * m_agentParams.goalRadiusScale, (EGoalType)type);
         }
         else if (h[0] == 'a') {
             Vec2 pos, vel;
@@ -663,8 +1038,7 @@ void Document::readStream(istream& is, map<string, string>& imported, const stri
                 break;
             if (goali >= (int)m_goals.size() || radius <= 0.0f)
                 break;
-            auto* a = addAgent(pos, (goali >= 0)?(m_goals[goali].get()):nullptr, radius, ms);
-            a->m_velocity = vel;
+            wave.add((goali >= 0)?(m_goals[goali].get()):nullptr, pos, vel, radius, ms, *this);
         }
         else if (h[0] == 'b') {
             Vec2 p1, p2;
@@ -673,8 +1047,23 @@ void Document::readStream(istream& is, map<string, string>& imported, const stri
                 break;
             m_mapdef.addBox(p1, p2);
         }
+        else if (h[0] == 'o') { // scene option
+            string key, value;
+            is >> key >> value;
+            if (is.fail())
+                break;
+            if (key == "broadphase") {
+                CHECK(value == "kdtree" || value == "grid", "Unknown broadphase " + value);
+                m_sim.setBroadphase((value == "grid") ? RVO::BROADPHASE_GRID : RVO::BROADPHASE_KDTREE);
+            }
+            else if (key == "replan_budget") {
+                m_replanBudget = atoi(value.c_str());
+            }
+            else
+                OUT("Unknown option " << key);
+        }
         else if (h[0] == 'e') {
-            return;
+            break;
         }
         else if (h[0] == 'i') {
             string name;
@@ -689,14 +1078,19 @@ void Document::readStream(istream& is, map<string, string>& imported, const stri
         }
 
     }
+    wave.flush(*this);
 }
 
 void Document::deserialize(istream& is, map<string, string>& imported)
 {
-    srand(0); // random pertrub in goals to be consistent
     m_mapdef.clear();
     clearAllObj();
     m_goals.clear();
+    m_sim.setBroadphase(RVO::BROADPHASE_KDTREE); // unless the scene has an option for it
+    m_sim.setThrottle(0);
+    m_replanBudget = REPLAN_BUDGET;
+    m_stepDebt = 0.0f;
+    m_stepMs = 0.0f;
 
     readStream(is, imported, "");
 
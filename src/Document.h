@@ -8,7 +8,10 @@
 #include "rvo2/Agent.h"
 #include "Objects.h"
 #include "Mesh.h"
+#include "Perimeter.h"
 #include "BihTree.h"
+#include "NavCache.h"
+#include "AllocCount.h"
 
 #include "rvo2/RVOSimulator.h"
 
@@ -17,18 +20,53 @@ class Agent;
 struct VODump;
 
 
-class ISubGoalMaker
+// simulated seconds of a step of Document::advance
+#define FIXED_STEP_TIME (0.25f)
+
+// what Document::advance did
+struct AdvanceReport
 {
-public:
-    virtual ~ISubGoalMaker() {}
-    // add points to the path that. PointSegment adds 2 goal segments for a sharp corner 
-    // normal segment adds 1 goal segment
-    virtual void makeSubGoal(float keepDist, const Vec2& comingFrom, Plan& addto) = 0;
-    // return a single "representative" point for this vertex so that extracting the path from the corridor would be accurate
-    virtual Vec2 makePathRef(float keepDist) = 0;
+    int steps = 0; // fixed steps that ran
+    int skippedSteps = 0; // steps that were due but dropped since they did not fit the budget
+    int throttle = 0; // avoidance detail the steps ran with, see RVOSimulator::setThrottle
+    float stepMs = 0.0f; // estimated cost of a step
+    bool reachedGoals = false; // what the last doStep returned
 };
 
+// distance between the slots of a formation, in the largest radius of the group
+#define GROUP_SLOT_SPACING (2.5f)
+// a follower that is this many slot spacings from its slot plans on its own, and joins the formation again when it is closer than GROUP_REJOIN_SLOTS
+#define GROUP_SEPARATE_SLOTS (6.0f)
+#define GROUP_REJOIN_SLOTS (2.0f)
+// preferred speed of followers that catch up with their slot, and of a leader that waits for a follower that is behind
+#define GROUP_CATCHUP_SPEED (1.5f)
+#define GROUP_WAIT_SPEED (0.5f)
+// stuck agents replanned in a step, the others wait for the next steps
+#define REPLAN_BUDGET 4
+// most steps between the replans of an agent that stays stuck
+#define REPLAN_MAX_BACKOFF 320
+// part of the turn of the leader's corridor the formation takes every step
+#define GROUP_TURN_RATE (0.05f)
+
+// agents that move together. only the leader plans, the followers keep slots in a formation behind it
+struct AgentGroup
+{
+    RVO::AgentHandle leader;
+    vector<RVO::AgentHandle> followers;
+    vector<Vec2> slots; // of the followers, x forward along the leader's corridor and y to its left
+    Vec2 heading = Vec2(1.0f, 0.0f); // direction of the leader's corridor, kept while the leader stops
+    float spacing = 0.0f;
+};
 
+// what addAgent makes the agents with, and the scale of the goals a scene is read with
+struct AgentParams
+{
+    float neighborDistFactor = NEI_DIST_RADIUS_FACTOR; // neighbor distance in radiuses
+    int maxNeighbors = 10;
+    float timeHorizon = 5.0f;
+    float timeHorizonObst = 5.0f;
+    float goalRadiusScale = 1.0f;
+};
 
 class Document 
 {
@@ -44,17 +82,57 @@ public:
     void clearObst();
     void clearAllObj();
 
+    // move the live navigation build to the cache / from a cached build
+    void stashNav();
+    void restoreNav(NavBuild* b);
+
     RVO::Agent* addAgent(const Vec2& pos, Goal* g, float radius/* = 15.0*/, float maxSpeed/* = -1.0f*/);
+    // a wave of agents that go to the same goal, or stand if it is null. radiuses and maxSpeeds have a value
+    // per position or one value for all. their plans are made together with updatePlans. handles may be null
+    void addAgents(const vector<Vec2>& positions, const vector<float>& radiuses, const vector<float>& maxSpeeds, Goal* g,
+                   vector<RVO::AgentHandle>* handles);
+    // O(1) in the number of agents, the last agent takes the index of the removed one
+    void removeAgent(RVO::AgentHandle h);
     void addAgentRadius(float radius);
     
     Goal* addGoal(const Vec2& p, float radius, EGoalType type);
     void removeGoal(Goal* g);
 
-    void clearSegMinDist();
     bool doStep(float deltaTime, bool doUpdate, int dbg_frameNum);
+    bool stepAgents(float deltaTime, bool doUpdate, int dbg_frameNum);
+    // advance the simulation by realTime seconds in fixed steps of FIXED_STEP_TIME, in about cpuBudgetMs
+    // of cpu. when the steps do not fit, the time that is due is carried to the next call up to MAX_STEP_DEBT
+    // steps and dropped after that, and the avoidance detail is lowered until they fit again
+    AdvanceReport advance(float realTime, float cpuBudgetMs);
+    // something changed that the step buffers may need to grow for. not for replans, doStep must not allocate for them
+    void resetStepWarmup() {
+#ifdef NAV_COUNT_ALLOCS
+        m_stepsSinceChange = 0;
+#endif
+    }
 
     void updatePlan(RVO::Agent* agent);
+    // a group of agents that have the same goal, the one closest to the goal leads. returns the index in m_groups.
+    // the agents leave the groups they were in. only the leader is planned, the followers may have been
+    // sent to the goal without a plan
+    int addGroup(const vector<RVO::AgentHandle>& agents);
+    // takes the agents out of their groups, a group that loses its leader is led by its front follower
+    void leaveGroups(const vector<RVO::AgentHandle>& agents);
+    // move the formation slots with the leaders. followers that got separated plan on their own until they are back
+    void updateGroups();
+    // like updatePlan for every agent, agents that start in the same triangle and end in the same triangle
+    // with the same radius and neighbor distance share one corridor search
+    void updatePlans(const vector<RVO::Agent*>& agents);
+    void updatePlans(RVO::Agent* const* agents, size_t count);
+    void makePlans(RVO::Agent* const* agents, size_t count); // of updatePlans
+    // resets the progress of the agent and finds the triangles it starts and ends in, they are tried first when
+    // they are not null. false when there is no corridor to search, the plan is made then if there is a map
+    bool startPlan(RVO::Agent* agent, Triangle*& startTri, Triangle*& endTri);
+    void planCorridor(RVO::Agent* agent, const vector<Triangle*>* corridor);
+    // EVENT_REPLAN or EVENT_PLAN_FAILED of the plan that was just made
+    void pushPlanEvent(const RVO::Agent* agent);
     bool shouldReplan(RVO::Agent* agent);
+    void scheduleReplans();
 
     void serialize(ostream& os);
     void deserialize(istream& is, map<string, string>& imported);
@@ -69,11 +147,16 @@ public:
     vector<Object*> m_objs; // owning
     BihTree m_bihTree;
 
-    vector<MultiSegment> m_multisegs; 
-    vector<ISubGoalMaker*> m_seggoals; // save size as m_mesh.m_vtx. for every vertex, get goals that are away from it
+    PerimeterStore m_perimeter; // of m_mesh, the sub-goals of the vertices and the obstacles
 
     Mesh m_mesh;
     vector<unique_ptr<Goal>> m_goals;
+    vector<AgentGroup> m_groups;
+
+    NavCache m_navCache;
+    NavCache::TKey m_navKey = 0; // key of the MapDef the live build was made from
+    string m_navDefinition; // NavCache::definitionOf the MapDef the live build was made from
+    bool m_navLive = false; // is there a complete live build
 
     // display
     vector<Vertex*> m_markers;
@@ -81,6 +164,34 @@ public:
 
     VODump* m_debugVoDump = nullptr; 
 
+    AgentParams m_agentParams;
+
+    // state of advance()
+    float m_stepDebt = 0.0f; // simulated time that is due and was not stepped yet
+    float m_stepMs = 0.0f; // moving average of the cpu time of a step, 0 before the first one
+    int m_advanceFrame = 0;
+
+    int m_replanBudget = REPLAN_BUDGET; // most stuck agents replanned in a step
+
+    // scratch of updatePlan, reused so that planning does not allocate
+    vector<Triangle*> m_corridor;
+    vector<Vertex*> m_planSketch;
+    PathMaker m_pathMaker;
+    vector<RVO::Agent*> m_spawned; // scratch of addAgents
+    vector<RVO::Agent*> m_replanQueue; // scratch of scheduleReplans
+    // an agent whose corridor makePlans searches
+    struct PlanJob {
+        Triangle* startTri;
+        Triangle* endTri;
+        RVO::Agent* agent;
+    };
+    vector<PlanJob> m_planJobs; // scratch of makePlans
+
+#ifdef NAV_COUNT_ALLOCS
+    int m_stepsSinceChange = 0; // doStep must not allocate after ALLOC_WARMUP_STEPS of these
+    bool m_planBuffersGrew = false; // a plan of this step was longer than the buffers of the plans ever were
+#endif
+
 
     RVO::RVOSimulator m_sim;
 };
@@ -0,0 +1,185 @@
+#include "FrameStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static size_t blockBytes(const vector<uint8_t>& data, const vector<uint32_t>& offsets) {
+    return data.capacity() + offsets.capacity() * sizeof(uint32_t);
+}
+
+// small values of either sign take few bytes
+static uint64_t zigzag(int64_t v) {
+    return (v < 0) ? ((uint64_t)(-(v + 1)) << 1) | 1 : (uint64_t)v << 1;
+}
+static int64_t unzigzag(uint64_t v) {
+    return (v & 1) ? -(int64_t)(v >> 1) - 1 : (int64_t)(v >> 1);
+}
+
+static void putVarint(vector<uint8_t>& data, uint64_t v) {
+    while (v >= 0x80) {
+        data.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    data.push_back((uint8_t)v);
+}
+static uint64_t getVarint(const uint8_t*& p) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        v |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= (uint64_t)(*p++) << shift;
+    return v;
+}
+
+void FrameStore::clear()
+{
+    m_blocks.clear();
+    m_endFrame = 0;
+    m_bytes = 0;
+    m_last.clear();
+    m_decodedFrame = -1;
+}
+
+void FrameStore::setMemoryLimit(size_t bytes)
+{
+    m_limit = bytes;
+    while (m_bytes > m_limit && m_blocks.size() > 1) {
+        m_bytes -= blockBytes(m_blocks.front().data, m_blocks.front().offsets);
+        m_blocks.pop_front();
+    }
+    if (m_decodedFrame < firstFrame())
+        m_decodedFrame = -1;
+}
+
+void FrameStore::quantize(const vector<AgentState>& agents, vector<TQuant>& out)
+{
+    out.resize(agents.size() * 4);
+    for(size_t i = 0; i < agents.size(); ++i) {
+        out[i * 4] = (TQuant)std::lround(agents[i].pos.x * FRAME_POS_QUANT);
+        out[i * 4 + 1] = (TQuant)std::lround(agents[i].pos.y * FRAME_POS_QUANT);
+        out[i * 4 + 2] = (TQuant)std::lround(agents[i].vel.x * FRAME_VEL_QUANT);
+        out[i * 4 + 3] = (TQuant)std::lround(agents[i].vel.y * FRAME_VEL_QUANT);
+    }
+}
+
+void FrameStore::startBlock(int numAgents)
+{
+    m_blocks.push_back(Block());
+    Block& b = m_blocks.back();
+    b.firstFrame = m_endFrame;
+    b.numAgents = numAgents;
+    b.offsets.reserve(KEYFRAME_INTERVAL);
+}
+
+void FrameStore::push(const vector<AgentState>& agents)
+{
+    quantize(agents, m_cur);
+
+    // a delta needs the same agents as the frame before it
+    if (m_blocks.empty() || m_blocks.back().numAgents != (int)agents.size() || m_blocks.back().offsets.size() >= KEYFRAME_INTERVAL)
+        startBlock((int)agents.size());
+    Block& b = m_blocks.back();
+    size_t before = blockBytes(b.data, b.offsets);
+
+    b.offsets.push_back((uint32_t)b.data.size());
+    if (b.offsets.size() == 1) {
+        size_t at = b.data.size();
+        b.data.resize(at + m_cur.size() * sizeof(TQuant));
+        if (!m_cur.empty())
+            memcpy(&b.data[at], m_cur.data(), m_cur.size() * sizeof(TQuant));
+    }
+    else {
+        // an agent that did not move is one 0 byte. otherwise the first value has a bit that marks it
+        for(size_t i = 0; i < m_cur.size(); i += 4) {
+            int64_t d[4];
+            for(int k = 0; k < 4; ++k)
+                d[k] = (int64_t)m_cur[i + k] - m_last[i + k];
+            if (d[0] == 0 && d[1] == 0 && d[2] == 0 && d[3] == 0) {
+                b.data.push_back(0);
+                continue;
+            }
+            putVarint(b.data, (zigzag(d[0]) << 1) | 1);
+            for(int k = 1; k < 4; ++k)
+                putVarint(b.data, zigzag(d[k]));
+        }
+    }
+    m_bytes += blockBytes(b.data, b.offsets) - before;
+
+    m_last.swap(m_cur);
+    ++m_endFrame;
+    setMemoryLimit(m_limit);
+}
+
+void FrameStore::decodeDelta(const Block& b, int i)
+{
+    const uint8_t* p = b.data.data() + b.offsets[i];
+    for(size_t a = 0; a < m_decoded.size(); a += 4) {
+        uint64_t first = getVarint(p);
+        if (first == 0)
+            continue;
+        m_decoded[a] += (TQuant)unzigzag(first >> 1);
+        for(int k = 1; k < 4; ++k)
+            m_decoded[a + k] += (TQuant)unzigzag(getVarint(p));
+    }
+}
+
+bool FrameStore::get(int f, vector<AgentState>& out)
+{
+    if (f < firstFrame() || f >= m_endFrame)
+        return false;
+    auto it = upper_bound(m_blocks.begin(), m_blocks.end(), f, [](int f, const Block& b) { return f < b.firstFrame; });
+    const Block& b = *(it - 1);
+
+    // continue from the last decoded frame if it is before f in the same block
+    int i = 0;
+    if (m_decodedFrame >= b.firstFrame && m_decodedFrame <= f) {
+        i = m_decodedFrame - b.firstFrame;
+    }
+    else {
+        m_decoded.resize(b.numAgents * 4);
+        if (b.numAgents > 0)
+            memcpy(m_decoded.data(), b.data.data(), m_decoded.size() * sizeof(TQuant));
+    }
+    for(++i; i <= f - b.firstFrame; ++i)
+        decodeDelta(b, i);
+    m_decodedFrame = f;
+
+    out.resize(b.numAgents);
+    for(int a = 0; a < b.numAgents; ++a) {
+        out[a].pos = Vec2(m_decoded[a * 4] / FRAME_POS_QUANT, m_decoded[a * 4 + 1] / FRAME_POS_QUANT);
+        out[a].vel = Vec2(m_decoded[a * 4 + 2] / FRAME_VEL_QUANT, m_decoded[a * 4 + 3] / FRAME_VEL_QUANT);
+    }
+    return true;
+}
+
+void FrameStore::truncate(int f)
+{
+    if (f >= m_endFrame)
+        return;
+    if (f <= firstFrame()) {
+        clear();
+        m_endFrame = f;
+        return;
+    }
+    while (m_blocks.back().firstFrame >= f) {
+        m_bytes -= blockBytes(m_blocks.back().data, m_blocks.back().offsets);
+        m_blocks.pop_back();
+    }
+    Block& b = m_blocks.back();
+    size_t before = blockBytes(b.data, b.offsets);
+    int keep = f - b.firstFrame;
+    b.data.resize(b.offsets[keep]);
+    b.offsets.resize(keep);
+    m_bytes += blockBytes(b.data, b.offsets) - before;
+    m_endFrame = f;
+
+    // the next push is a delta from frame f - 1
+    if (m_decodedFrame >= f)
+        m_decodedFrame = -1;
+    vector<AgentState> last;
+    get(f - 1, last);
+    m_last = m_decoded;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Vec2.h"
+
+using namespace std;
+
+// frames between keyframes, a frame is decoded from the keyframe before it
+#define KEYFRAME_INTERVAL 32
+// positions and velocities are stored in steps of 1/FRAME_POS_QUANT and 1/FRAME_VEL_QUANT
+#define FRAME_POS_QUANT 64.0f
+#define FRAME_VEL_QUANT 256.0f
+#define FRAME_STORE_DEFAULT_BYTES (64 * 1024 * 1024)
+
+// recorded agent states for rewinding the display. the frames are grouped in blocks of a keyframe
+// with the quantized states and the deltas of the following frames from the frame before them.
+// the oldest blocks are dropped when the store is over its memory limit, so the first frame moves forward
+class FrameStore
+{
+public:
+    struct AgentState {
+        Vec2 pos;
+        Vec2 vel;
+    };
+
+    void clear();
+    void setMemoryLimit(size_t bytes);
+
+    // frame numbers keep counting from the start of the recording, also after old frames were dropped
+    int firstFrame() const {
+        return m_blocks.empty() ? m_endFrame : m_blocks.front().firstFrame;
+    }
+    int endFrame() const {
+        return m_endFrame;
+    }
+    size_t bytes() const {
+        return m_bytes;
+    }
+
+    // append frame endFrame()
+    void push(const vector<AgentState>& agents);
+    // drop the frames from frame f on
+    void truncate(int f);
+    // false if f is not stored. faster when the frames are read in order
+    bool get(int f, vector<AgentState>& out);
+
+private:
+    typedef int32_t TQuant;
+    struct Block {
+        int firstFrame = 0;
+        int numAgents = 0;
+        vector<uint8_t> data; // the keyframe, then the deltas
+        vector<uint32_t> offsets; // of every frame in data
+    };
+
+    static void quantize(const vector<AgentState>& agents, vector<TQuant>& out);
+    void startBlock(int numAgents);
+    // apply the deltas of frame at index i of the block to m_decoded
+    void decodeDelta(const Block& b, int i);
+
+    deque<Block> m_blocks;
+    int m_endFrame = 0;
+    size_t m_bytes = 0;
+    size_t m_limit = FRAME_STORE_DEFAULT_BYTES;
+
+    vector<TQuant> m_last; // quantized state of the last pushed frame, 4 values per agent
+    vector<TQuant> m_cur;
+
+    vector<TQuant> m_decoded; // state of frame m_decodedFrame, continued by the next get()
+    int m_decodedFrame = -1;
+};
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+
+#include "rvo2/Definitions.h"
+
 
 #define NEI_DIST_RADIUS_FACTOR (2.0f)
 // changing this factor also changes how narrow a tri-to-segment corridor the agent can pass
@@ -76,6 +81,26 @@ public:
     float radiusSq;
 };
 
+// the slot of a follower in the formation of its group. moves with the leader, set every step by Document::updateGroups
+class FormationSubGoal : public ISubGoal
+{
+public:
+    virtual Vec2 getDest(const Vec2& comingFrom) const {
+        return p;
+    }
+    virtual bool isPassed(const Vec2& amAt) const {
+        return false; // the end goal decides when the follower stops
+    }
+    virtual bool isPoint() const {
+        return false;
+    }
+    virtual Vec2 representPoint() const {
+        return p;
+    }
+
+    Vec2 p;
+};
+
 template<typename T>
 void iswap(T& a, T& b) {
     T c = a;
@@ -93,15 +118,23 @@ public:
 
         m_segs.push_back(SegmentSubGoal(a, b, rev ? -1 : 1));
         m_d.push_back(&m_segs.back());
+        touch();
     }
     void setEnd(const Vec2& p, float radius) {
         m_endp = PointSubGoal(p, radius);
         m_d.push_back(&m_endp);
+        touch();
     }
     void clear() {
         m_segs.clear();
         m_d.clear();
         m_endp = PointSubGoal();
+        touch();
+    }
+    // give the content a new serial. unique in the process so that documents in different threads don't mix them
+    void touch() {
+        static std::atomic<unsigned long long> s_nextSerial(1);
+        m_serial = s_nextSerial++;
     }
     void reserve(int size) {
         m_d.reserve(size);
@@ -111,6 +144,7 @@ public:
     std::vector<ISubGoal*> m_d; // pointers to m_planData and m_planEnd;
     std::vector<SegmentSubGoal> m_segs;
     PointSubGoal m_endp;
+    unsigned long long m_serial = 0; // changes whenever the content changes, SimCheckpoint shares the plans that did not
 
     // should not copy since it contains pointers to content
     Plan(const Plan&) = delete;
@@ -182,10 +216,18 @@ public:
     Goal(const Vec2& _p, float r, EGoalType t) : def(_p, r, t)
     {}
     GoalDef def;
-    std::vector<RVO::Agent*> agents; // agents that have this goal
+    std::vector<RVO::AgentHandle> agents; // agents that have this goal
+    // unique in the process, a goal that is allocated where a removed one was has another serial
+    const unsigned long long serial = nextSerial();
 
     // for a POINT goal, this is the distance an agent can be in to be allowed to stop
     // it is updated as agents gather around the point
     float minDistForStop = 0.0; 
+
+private:
+    static unsigned long long nextSerial() {
+        static std::atomic<unsigned long long> s_nextSerial(1);
+        return s_nextSerial++;
+    }
 };
 
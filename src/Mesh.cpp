@@ -1,5 +1,6 @@
 #include "Mesh.h"
 #include "Except.h"
+#include <algorithm>
 #include <map>
 #include <queue>
 #include <iostream>
@@ -11,9 +12,9 @@ using namespace std;
 typedef pair<Vertex*, Vertex*> VPair;
 
 // map (from,to) -> halfedge
-map<VPair, HalfEdge*> unpaired; // TBD - global
+typedef map<VPair, HalfEdge*> TUnpaired;
 
-void seekPair(Vertex* v1, Vertex* v2, HalfEdge* add) {
+static void seekPair(TUnpaired& unpaired, Vertex* v1, Vertex* v2, HalfEdge* add) {
     VPair ko(v2, v1);
     auto it = unpaired.find(ko);
     if (it != unpaired.end()) {
@@ -31,9 +32,18 @@ void seekPair(Vertex* v1, Vertex* v2, HalfEdge* add) {
 }
 
 
+void Mesh::assignTri(const Mesh& o)
+{
+    clear();
+    m_vtx = o.m_vtx; // reserved by the copy, triangles point into it
+    m_tri.reserve(o.m_tri.size());
+    for(const auto& t: o.m_tri)
+        addTri(&m_vtx[t.v[0] - o.m_vtx.data()], &m_vtx[t.v[1] - o.m_vtx.data()], &m_vtx[t.v[2] - o.m_vtx.data()]);
+}
+
 void Mesh::connectTri()
 {
-    unpaired.clear();
+    TUnpaired unpaired;
     m_perimiters.clear();
     
     m_he.clear();
@@ -72,9 +82,9 @@ void Mesh::connectTri()
         h1->next = h2;
         h2->next = h0;
 
-        seekPair(t.v[0], t.v[1], h0);
-        seekPair(t.v[1], t.v[2], h1);
-        seekPair(t.v[2], t.v[0], h2);
+        seekPair(unpaired, t.v[0], t.v[1], h0);
+        seekPair(unpaired, t.v[1], t.v[2], h1);
+        seekPair(unpaired, t.v[2], t.v[0], h2);
     }
 
     // go over half edges, create triangles links
@@ -166,12 +176,13 @@ Triangle* Mesh::findContaining(const Vec2& p, vector<Vec2>& posRef)
     return nullptr;
 }
 
-struct PrioNode
+// points that are looked up one after the other are often in the same triangle
+Triangle* Mesh::findContaining(const Vec2& p, vector<Vec2>& posRef, Triangle* hint)
 {
-    PrioNode(HalfEdge* _h, float _p) :h(_h), prio(_p) {}
-    HalfEdge* h;
-    float prio = 0.0f;
-};
+    if (hint != nullptr && isPointInTri(p, *hint, posRef))
+        return hint;
+    return findContaining(p, posRef);
+}
 
 bool lessPrioNode(const PrioNode& a, const PrioNode& b) {
     return a.prio > b.prio;
@@ -182,20 +193,19 @@ float distm(const Vec2& a, const Vec2& b) {
     return std::sqrt(distSq(a, b));
 }
 
-bool Mesh::edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle* start, Triangle* end, vector<Triangle*>& corridor, float agetnRadius)
+bool Mesh::edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle* start, Triangle* end, vector<Triangle*>& corridor, float agetnRadius, float neighborDist)
 {
     if (start == end)
         return false;
-    priority_queue<PrioNode, vector<PrioNode>, decltype(lessPrioNode)*> tq(lessPrioNode);
+    vector<PrioNode>& tq = m_astarQueue; // a heap with lessPrioNode
+    tq.clear();
     HalfEdge* dummy = (HalfEdge*)0xff; // dummy cameFrom to mark the start edge
-    vector<HalfEdge*> destEdges; // max 3 possible dest edges
-    destEdges.reserve(3);
-    vector<float> destCost; // used when selecting the best dest reached out of possible 3
-    destCost.reserve(3);
-
+    HalfEdge* destEdges[3]; // max 3 possible dest edges
+    float destCost[3]; // used when selecting the best dest reached out of possible 3
+    int numDest = 0;
 
-    vector<Vec2> midPntOverride;
-    midPntOverride.reserve(6); // don't reallocate, that will change addresses
+    Vec2 midPntOverride[6]; // HalfEdges point to these
+    int numOverride = 0;
     
     // set up start edges and dest edges. 
     // Start from end and go to start so its easy to connect the cameFrom pointers
@@ -205,24 +215,25 @@ bool Mesh::edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle*
         if (sh->opposite) // if it doesn't have an opposite, it can't be reached so its not a destination
         { 
             // fix mid point of start triangle to be closer to the real target
-            midPntOverride.push_back(project(startPos, sh->from->p, sh->to->p)); // project to the line of the edge
-            sh->curMidPntPtr = &midPntOverride.back();
+            midPntOverride[numOverride] = project(startPos, sh->from->p, sh->to->p); // project to the line of the edge
+            sh->curMidPntPtr = &midPntOverride[numOverride++];
             sh->opposite->curMidPntPtr = sh->curMidPntPtr;
-            destEdges.push_back(sh);
-            destCost.push_back(FLT_MAX);
+            destEdges[numDest] = sh;
+            destCost[numDest++] = FLT_MAX;
             //cout << "END " << sh->index << endl;
         }
         auto h = end->h[i]->opposite;
         if (h) 
         {
-            midPntOverride.push_back(project(endPos, h->from->p, h->to->p)); // fix mid point of end triangle to be closer to the real target
-            h->curMidPntPtr = &midPntOverride.back();
+            midPntOverride[numOverride] = project(endPos, h->from->p, h->to->p); // fix mid point of end triangle to be closer to the real target
+            h->curMidPntPtr = &midPntOverride[numOverride++];
             if (h->opposite)
                 h->opposite->curMidPntPtr = h->curMidPntPtr;
             h->costSoFar = distm(endPos, *h->curMidPntPtr);
             h->cameFrom = dummy;
             float heur = distm(*h->curMidPntPtr, startPos);
-            tq.push(PrioNode(h, h->costSoFar + heur));
+            tq.push_back(PrioNode(h, h->costSoFar + heur));
+            push_heap(tq.begin(), tq.end(), lessPrioNode);
             //cout << "START " << h->index << endl;
         }
     }
@@ -235,24 +246,25 @@ bool Mesh::edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle*
     // this limitation stems from the fact that the VOs we make for a polyline does not have round corners (which will be hard to simulate) see narrow_worst_cast.txt
     float edgeLenCheck = sqr(agetnRadius * SQRT_2 * 2);
     // in the point-to-segment case the distance to check is one half radius*SQRT_2 - the half near the point
-    // and the other half is radius*nei_dist since that's the distance where an agent find it going to bump into a wall and stop
+    // and the other half is the neighbor distance since that's the distance where an agent find it going to bump into a wall and stop
     // (the simulation of a "chopped" VO)
-    float triMidCheck = sqr(agetnRadius * SQRT_2 + agetnRadius * NEI_DIST_RADIUS_FACTOR);
+    float triMidCheck = sqr(agetnRadius * SQRT_2 + neighborDist);
     while (!tq.empty() ) 
     {
-        PrioNode curn = tq.top();
+        pop_heap(tq.begin(), tq.end(), lessPrioNode);
+        PrioNode curn = tq.back();
         HalfEdge* cur = curn.h;
-        tq.pop();    
+        tq.pop_back();
         //cout << "POPED " << cur->index << endl;
 
         // was any dest edge reached?
-        auto dsit = std::find(destEdges.begin(), destEdges.end(), cur);
-        if (dsit != destEdges.end()) 
+        auto dsit = std::find(destEdges, destEdges + numDest, cur);
+        if (dsit != destEdges + numDest) 
         {
-            destCost[dsit - destEdges.begin()] = curn.prio;
+            destCost[dsit - destEdges] = curn.prio;
             ++destReached;
             //cout << "  Reached " << cur->index << " " << curn.prio << endl;
-            if (destReached > destEdges.size())
+            if (destReached > numDest)
                 break;
             continue; // need to find more ways to get there
         }
@@ -283,15 +295,16 @@ bool Mesh::edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle*
             n->costSoFar = costToThis;
             n->cameFrom = cur;
             float heur = n->costSoFar + distm(*n->curMidPntPtr, startPos);
-            tq.push(PrioNode(n, heur));
+            tq.push_back(PrioNode(n, heur));
+            push_heap(tq.begin(), tq.end(), lessPrioNode);
         }
     }
 
     bool reached = (destReached != 0);
     if (reached)
     {
-        auto dit = min_element(destCost.begin(), destCost.end());
-        HalfEdge *firsth = destEdges[dit - destCost.begin()];
+        auto dit = min_element(destCost, destCost + numDest);
+        HalfEdge *firsth = destEdges[dit - destCost];
         HalfEdge *h = firsth;
         // find the length of the corridor
         int len = 0;
@@ -355,7 +368,7 @@ void PathMaker::stringPull(const vector<VtxWrap>& portalsRight, const vector<Vtx
 
 
     // Add start point.
-    //m_outputCall(portalApex.v);
+    //m_sink->output(portalApex.v);
 
 
     for (int i = 1; i < portalsRight.size(); ++i)
@@ -375,7 +388,7 @@ void PathMaker::stringPull(const vector<VtxWrap>& portalsRight, const vector<Vtx
             else
             {
                 // Right over left, insert left to path and restart scan from portal left point.
-                m_outputCall(portalLeft.v);
+                m_sink->output(portalLeft.v);
 
                 // Make current left the new apex.
                 portalApex = portalLeft;
@@ -403,7 +416,7 @@ void PathMaker::stringPull(const vector<VtxWrap>& portalsRight, const vector<Vtx
             else
             {
                 // Left over right, insert right to path and restart scan from portal right point.
-                m_outputCall(portalRight.v);
+                m_sink->output(portalRight.v);
 
                 // Make current right the new apex.
                 portalApex = portalRight;
@@ -420,7 +433,7 @@ void PathMaker::stringPull(const vector<VtxWrap>& portalsRight, const vector<Vtx
         }
     }
     // Append last point to path.
-    m_outputCall(portalsRight.back().v);
+    m_sink->output(portalsRight.back().v);
 }
 
 
@@ -449,31 +462,31 @@ void commonVtx(Triangle* a, Triangle* b, Vertex** right, Vertex** left)
 }
 
 
-void PathMaker::makePath(const vector<Triangle*>& tripath, const Vec2& start, const Vec2& end)
+void PathMaker::makePath(const vector<Triangle*>& tripath, const Vec2& start, const Vec2& end, IPathSink* sink)
 {
     if (tripath.size() == 0)
         return;
+    m_sink = sink;
     m_startDummy = Vertex(-1, start);
     m_endDummy = Vertex(-1, end);
     VtxWrap startWrap(&m_startDummy, start), endWrap(&m_endDummy, end);
 
-    vector<VtxWrap> leftPath, rightPath;
-    leftPath.reserve(tripath.size() + 1);
-    rightPath.reserve(tripath.size() + 1);
+    m_leftPath.clear();
+    m_rightPath.clear();
 
-    leftPath.push_back(startWrap);
-    rightPath.push_back(startWrap);
+    m_leftPath.push_back(startWrap);
+    m_rightPath.push_back(startWrap);
     for (int i = 0; i < tripath.size() - 1; ++i) {
         Vertex *right, *left;
         commonVtx(tripath[i], tripath[i + 1], &right, &left);
-        leftPath.push_back(VtxWrap(left, m_getPos(left)));
-        rightPath.push_back(VtxWrap(right, m_getPos(right)));
+        m_leftPath.push_back(VtxWrap(left, sink->getPos(left)));
+        m_rightPath.push_back(VtxWrap(right, sink->getPos(right)));
     }
 
-    leftPath.push_back(endWrap);
-    rightPath.push_back(endWrap);
+    m_leftPath.push_back(endWrap);
+    m_rightPath.push_back(endWrap);
 
-    stringPull(rightPath, leftPath);
+    stringPull(m_rightPath, m_leftPath);
 
 }
 
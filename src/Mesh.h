@@ -159,6 +159,14 @@ public:
 };
 
 
+// an edge in the open set of edgesAstarSearch
+struct PrioNode
+{
+    PrioNode(HalfEdge* _h, float _p) :h(_h), prio(_p) {}
+    HalfEdge* h;
+    float prio = 0.0f;
+};
+
 class Mesh
 {
 public:
@@ -176,10 +184,22 @@ public:
         m_perimiters.clear();
         m_he.clear();
     }
+    // element addresses stay the same so internal pointers remain valid
+    void swap(Mesh& o) {
+        m_vtx.swap(o.m_vtx);
+        m_tri.swap(o.m_tri);
+        m_perimiters.swap(o.m_perimiters);
+        m_he.swap(o.m_he);
+        m_altVtxPosByRadius.swap(o.m_altVtxPosByRadius);
+    }
 
+    // copies the vertices and triangles of o, what connectTri makes is not copied
+    void assignTri(const Mesh& o);
     void connectTri();
     Triangle* findContaining(const Vec2& p, vector<Vec2>& posRef);
-    bool edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle* start, Triangle* end, vector<Triangle*>& corridor, float agetnRadiusSq);
+    // hint is tried first, may be null
+    Triangle* findContaining(const Vec2& p, vector<Vec2>& posRef, Triangle* hint);
+    bool edgesAstarSearch(const Vec2& startPos, const Vec2& endPos, Triangle* start, Triangle* end, vector<Triangle*>& corridor, float agetnRadius, float neighborDist);
 
     HalfEdge* addHe() {
         m_he.push_back(HalfEdge());
@@ -196,6 +216,8 @@ public:
     // for every radius, have a set of alternative position per vertex for plan creation
     // used at the beginning of the planning to determine the correct triangle the agent and the goal is at
     map<float, vector<Vec2>> m_altVtxPosByRadius;
+
+    vector<PrioNode> m_astarQueue; // heap of edgesAstarSearch, reused so that a replan does not allocate
 };
 
 // for the stringPull algorithm we need both the vertex pointer to know 
@@ -208,19 +230,26 @@ struct VtxWrap
     Vec2 p;
 };
 
-class PathMaker
+// receives the path that PathMaker makes
+class IPathSink
 {
 public:
-    typedef std::function<void(Vertex*)> TOutputCallback;
-    typedef std::function<Vec2(Vertex*)> TGetPosCallback;
-    PathMaker(const TOutputCallback& outCallback, const TGetPosCallback& posCallback) :m_outputCall(outCallback), m_getPos(posCallback)
-    {}
+    virtual ~IPathSink() {}
+    // called for every vertex of the path in order, the last one is the end dummy
+    virtual void output(Vertex* v) = 0;
+    // the position of the vertex that the path is calculated with
+    virtual Vec2 getPos(Vertex* v) = 0;
+};
 
+// can be kept and reused for many paths so that making a path does not allocate
+class PathMaker
+{
+public:
     void stringPull(const vector<VtxWrap>& portalsRight, const vector<VtxWrap>& portalsLeft);
-    void makePath(const vector<Triangle*>& tripath, const Vec2& start, const Vec2& end);
+    void makePath(const vector<Triangle*>& tripath, const Vec2& start, const Vec2& end, IPathSink* sink);
 
-    const TOutputCallback& m_outputCall;
-    const TGetPosCallback& m_getPos;
+    IPathSink* m_sink = nullptr; // of the current makePath
 
     Vertex m_startDummy, m_endDummy;
+    vector<VtxWrap> m_leftPath, m_rightPath;
 };
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "NavCache.h"
+#include "Document.h"
+#include "rvo2/Obstacle.h"
+
+#include <cstring>
+#include <fstream>
+
+#define TRI_FILE_MAGIC 0x3249544e // "NTI2"
+
+size_t NavBuild::byteSize() const
+{
+    size_t sz = sizeof(NavBuild);
+    sz += mesh.m_vtx.capacity() * sizeof(Vertex);
+    sz += mesh.m_tri.capacity() * sizeof(Triangle);
+    sz += mesh.m_he.capacity() * sizeof(HalfEdge);
+    for(const auto& pr: mesh.m_perimiters)
+        sz += sizeof(Polyline) + pr.m_d.capacity() * sizeof(Vertex*);
+    sz += perimeter.byteSize() - sizeof(PerimeterStore);
+    sz += obstacles.capacity() * sizeof(RVO::Obstacle*) + obstacleStore.size() * sizeof(RVO::Obstacle);
+    sz += obstacleTree.nodes.capacity() * sizeof(RVO::KdTree::ObstacleTreeNode);
+    return sz;
+}
+
+static void appendBytes(string& s, const void* p, size_t sz)
+{
+    s.append((const char*)p, sz);
+}
+static void appendVec(string& s, const Vec2& v)
+{
+    appendBytes(s, &v.x, sizeof(float));
+    appendBytes(s, &v.y, sizeof(float));
+}
+
+string NavCache::definitionOf(const MapDef& mapdef)
+{
+    string s;
+    for(const auto& pl: mapdef.m_pl) {
+        // polylines of boxes start at a vertex that depends on allocation order, the boxes are added below
+        if (pl->m_fromBox)
+            continue;
+        int sz = (int)pl->m_d.size();
+        appendBytes(s, &sz, sizeof(sz)); // also separates consecutive polylines
+        for(const auto* v: pl->m_d)
+            appendVec(s, v->p);
+    }
+    int bxCount = (int)mapdef.m_bx.size();
+    appendBytes(s, &bxCount, sizeof(bxCount));
+    for(const auto& b: mapdef.m_bx) {
+        appendVec(s, b->v[0]->p);
+        appendVec(s, b->v[2]->p);
+    }
+    return s;
+}
+
+// FNV-1a
+NavCache::TKey NavCache::keyOf(const string& definition)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(unsigned char c: definition) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void NavCache::put(TKey key, const string& definition, NavBuild* b)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end()) { // same map built twice, keep the newer one
+        m_bytes -= it->second->bytes;
+        delete it->second->b;
+        m_lru.erase(it->second);
+        m_index.erase(it);
+    }
+    size_t sz = b->byteSize();
+    m_lru.push_front(Entry{key, definition, b, sz});
+    m_index[key] = m_lru.begin();
+    m_bytes += sz;
+    evict();
+}
+
+NavBuild* NavCache::take(TKey key, const string& definition)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_stats.misses;
+        return nullptr;
+    }
+    if (it->second->definition != definition) {
+        // the entry stays, put() replaces it when the build of this map is stashed
+        ++m_stats.keyCollisions;
+        ++m_stats.misses;
+        return nullptr;
+    }
+    ++m_stats.hits;
+    NavBuild* b = it->second->b;
+    m_bytes -= it->second->bytes;
+    m_lru.erase(it->second);
+    m_index.erase(it);
+    return b;
+}
+
+void NavCache::evict()
+{
+    while (!m_lru.empty() && ((int)m_lru.size() > m_maxEntries || m_bytes > m_maxBytes))
+    {
+        auto& e = m_lru.back();
+        m_bytes -= e.bytes;
+        delete e.b;
+        m_index.erase(e.key);
+        m_lru.pop_back();
+        ++m_stats.evictions;
+    }
+}
+
+void NavCache::setLimits(int maxEntries, size_t maxBytes)
+{
+    m_maxEntries = maxEntries;
+    m_maxBytes = maxBytes;
+    evict();
+}
+
+void NavCache::clear()
+{
+    for(auto& e: m_lru)
+        delete e.b;
+    m_lru.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+string NavCache::diskPath(TKey key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.tri", (unsigned long long)key);
+    return m_diskDir + "/" + name;
+}
+
+// format: magic, vertex count, triangle count, definition length, the definition, vertices as float pairs,
+// triangles as vertex index triplets
+bool NavCache::loadTri(TKey key, const string& definition, Mesh& out)
+{
+    if (m_sharedTri && m_sharedTriKey == key && m_sharedTriDefinition == definition) {
+        out.assignTri(*m_sharedTri);
+        ++m_stats.sharedHits;
+        return true;
+    }
+    if (m_diskDir.empty())
+        return false;
+    ifstream ifs(diskPath(key), ios::binary);
+    if (!ifs.good())
+        return false;
+    int hdr[4] = { 0 };
+    ifs.read((char*)hdr, sizeof(hdr));
+    if (!ifs.good() || hdr[0] != TRI_FILE_MAGIC || hdr[1] < 0 || hdr[2] < 0)
+        return false;
+    if ((size_t)hdr[3] != definition.size()) {
+        ++m_stats.keyCollisions;
+        return false;
+    }
+    string fileDefinition(definition.size(), '\0');
+    ifs.read(&fileDefinition[0], fileDefinition.size());
+    if (!ifs.good())
+        return false;
+    if (fileDefinition != definition) {
+        ++m_stats.keyCollisions;
+        return false;
+    }
+    vector<float> vtx(hdr[1] * 2);
+    vector<int> tri(hdr[2] * 3);
+    ifs.read((char*)vtx.data(), vtx.size() * sizeof(float));
+    ifs.read((char*)tri.data(), tri.size() * sizeof(int));
+    if (!ifs.good())
+        return false;
+    for(int vi: tri)
+        if (vi < 0 || vi >= hdr[1])
+            return false;
+
+    out.clear();
+    out.m_vtx.reserve(hdr[1]); // triangles point into it
+    for(int i = 0; i < hdr[1]; ++i)
+        out.m_vtx.push_back(Vertex(i, vtx[i * 2], vtx[i * 2 + 1]));
+    out.m_tri.reserve(hdr[2]);
+    for(int i = 0; i < hdr[2]; ++i)
+        out.addTri(&out.m_vtx[tri[i * 3]], &out.m_vtx[tri[i * 3 + 1]], &out.m_vtx[tri[i * 3 + 2]]);
+    ++m_stats.diskHits;
+    return true;
+}
+
+void NavCache::saveTri(TKey key, const string& definition, const Mesh& m)
+{
+    if (m_diskDir.empty())
+        return;
+    ofstream ofs(diskPath(key), ios::binary);
+    if (!ofs.good())
+        return;
+    int hdr[4] = { TRI_FILE_MAGIC, (int)m.m_vtx.size(), (int)m.m_tri.size(), (int)definition.size() };
+    ofs.write((const char*)hdr, sizeof(hdr));
+    ofs.write(definition.data(), definition.size());
+    for(const auto& v: m.m_vtx)
+        ofs.write((const char*)&v.p.x, sizeof(float) * 2);
+    for(const auto& t: m.m_tri) {
+        int vi[3] = { t.v[0]->index, t.v[1]->index, t.v[2]->index };
+        ofs.write((const char*)vi, sizeof(vi));
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "Perimeter.h"
+#include "rvo2/KdTree.h"
+#include "rvo2/Obstacle.h"
+
+using namespace std;
+
+// everything Document::runTriangulate builds out of the MapDef.
+// the live one is spread in the Document members, stashed ones are owned by the cache
+struct NavBuild
+{
+    NavBuild() {}
+
+    size_t byteSize() const;
+
+    Mesh mesh;
+    PerimeterStore perimeter;
+    deque<RVO::Obstacle> obstacleStore;
+    vector<RVO::Obstacle*> obstacles; // point to obstacleStore
+    RVO::KdTree::ObstacleTree obstacleTree; // indexes obstacles
+
+    // contains pointers to its own content
+    NavBuild(const NavBuild&) = delete;
+    void operator=(const NavBuild&) = delete;
+};
+
+struct NavCacheStats
+{
+    int hits = 0;
+    int misses = 0;
+    int diskHits = 0; // misses that skipped the triangulation since it was on disk
+    int sharedHits = 0; // misses that skipped the triangulation since it was shared
+    int evictions = 0;
+    int keyCollisions = 0; // the key was found with the definition of another map, also counted as a miss
+};
+
+// content-addressed cache of navigation builds, keyed by a hash of the polylines and boxes of the MapDef.
+// the definition the key is a hash of is kept with every entry and compared on a hit.
+// the memory cache holds complete builds, the optional disk cache holds only the triangulation
+class NavCache
+{
+public:
+    typedef uint64_t TKey;
+
+    NavCache() {}
+    ~NavCache() {
+        clear();
+    }
+
+    // the polylines and boxes of the MapDef as bytes, equal for maps that triangulate the same
+    static string definitionOf(const MapDef& mapdef);
+    static TKey keyOf(const string& definition);
+
+    // takes ownership of b, may evict the least recently used entries to stay in the limits
+    void put(TKey key, const string& definition, NavBuild* b);
+    // returns nullptr if not found. ownership moves to the caller and the entry is removed
+    NavBuild* take(TKey key, const string& definition);
+
+    // disk cache of the triangulation, does nothing if no directory was set.
+    // loadTri first takes a shared triangulation of the same map
+    bool loadTri(TKey key, const string& definition, Mesh& out);
+    void saveTri(TKey key, const string& definition, const Mesh& m);
+
+    // a triangulation that other documents made and that is only read, see BatchRunner
+    void setSharedTri(TKey key, const string& definition, const shared_ptr<const Mesh>& tri) {
+        m_sharedTriKey = key;
+        m_sharedTriDefinition = definition;
+        m_sharedTri = tri;
+    }
+
+    void setLimits(int maxEntries, size_t maxBytes);
+    void setDiskDir(const string& dir) {
+        m_diskDir = dir;
+    }
+    void clear();
+
+    int entries() const {
+        return (int)m_lru.size();
+    }
+    size_t bytes() const {
+        return m_bytes;
+    }
+
+    NavCacheStats m_stats;
+
+private:
+    void evict();
+    string diskPath(TKey key) const;
+
+    struct Entry {
+        TKey key;
+        string definition;
+        NavBuild* b;
+        size_t bytes;
+    };
+    list<Entry> m_lru; // most recently used first
+    map<TKey, list<Entry>::iterator> m_index;
+    size_t m_bytes = 0;
+
+    int m_maxEntries = 16;
+    size_t m_maxBytes = 64 * 1024 * 1024;
+    string m_diskDir; // empty means no disk cache
+    TKey m_sharedTriKey = 0;
+    string m_sharedTriDefinition;
+    shared_ptr<const Mesh> m_sharedTri;
+
+    NavCache(const NavCache&) = delete;
+    void operator=(const NavCache&) = delete;
+};
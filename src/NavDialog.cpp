@@ -37,6 +37,7 @@ NavDialog::NavDialog(QWidget *parent)
     m_scene->setBackgroundBrush(QBrush(QColor(Qt::white)));
 
     m_doc = new Document;
+    m_doc->m_sim.setNumThreads(RVO::ThreadPool::hardwareThreads());
     readDoc();
 
 }
@@ -52,6 +53,10 @@ void NavDialog::readMesh()
         m_scene->addItem(i);
         m_meshitems.push_back(shared_ptr<TriItem>(i));
     }
+    // built with the mesh
+    m_perimeteritem.reset(new PerimeterItem(this, &m_doc->m_perimeter));
+    m_perimeteritem->setZValue(-5);
+    m_scene->addItem(m_perimeteritem.get());
 }
 
 void NavDialog::readPolyPoints() 
@@ -97,11 +102,6 @@ void NavDialog::readDoc()
                 auto b = dynamic_cast<AABB*>(obj);
                 if (b != nullptr) 
                     p = new AABBItem(b, this);
-                else {
-                    auto s = dynamic_cast<Segment*>(obj);
-                    if (s != nullptr)
-                        p = new SegmentItem(s, this);
-                }
             }
             if (p)
                 p->setZValue(-5);
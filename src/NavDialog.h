@@ -52,6 +52,7 @@ public:
     vector<shared_ptr<TriItem>> m_meshitems;
     vector<shared_ptr<PolyPointItem>> m_polypointitems;
     shared_ptr<MapDefItem> m_mapitem;
+    shared_ptr<PerimeterItem> m_perimeteritem;
     //shared_ptr<PolyPointItem> m_startitem;
     vector<shared_ptr<GoalItem>> m_goalitems;
     vector<shared_ptr<PolyPointItem>> m_markeritems;
@@ -179,21 +179,6 @@ QRectF AABBItem::boundingRect() const
 // --------------------------------------------------------
 
 
-void SegmentItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
-{
-    preparePainter(painter, option);
-    auto sz = m_obj->size / 2;
-    painter->drawLine(-sz.x, -sz.y, sz.x, sz.y);
-}
-
-QRectF SegmentItem::boundingRect() const
-{
-    auto sz = m_obj->size / 2;
-    return QRectF(-sz.x, -sz.y, m_obj->size.x, m_obj->size.y);
-}
-
-// ------------------------------------------------------------------
-
 void TriItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) 
 {
     QPointF pv[] = { toQ(m_t->v[0]->p), toQ(m_t->v[1]->p), toQ(m_t->v[2]->p) };
@@ -304,6 +289,20 @@ QRectF MapDefItem::boundingRect() const {
 
 // ------------------------------------------------------------------
 
+void PerimeterItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) 
+{
+    QPen pen(QColor(0,0,0));
+    pen.setWidth(1);
+    painter->setPen(pen);
+    for(const auto& e: m_p->m_edges)
+        painter->drawLine(toQ(e.a), toQ(e.b));
+}
+QRectF PerimeterItem::boundingRect() const {
+    return QRectF(-2000, -2000, 6000, 6000);
+}
+
+// ------------------------------------------------------------------
+
 extern Vec2 g1, g2;
 
 void PathItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) 
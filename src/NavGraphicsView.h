@@ -143,26 +143,6 @@ public:
 };
 
 
-class SegmentItem : public BaseItem
-{
-public:
-    SegmentItem(Segment* obj, NavDialog* ctrl)
-        :BaseItem(ctrl, obj), m_cobj(obj)
-    {}
-
-    virtual QString strDim() const {
-        return QString();
-    }
-    virtual void setDim(const QString& s) {
-    }
-
-    virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
-    virtual QRectF boundingRect() const;
-
-    Segment* m_cobj;
-};
-
-
 // part of a triangulation
 class TriItem  : public QGraphicsItem
 {
@@ -238,6 +218,22 @@ public:
     MapDef* m_p;
 };
 
+// the perimeters of the navigation build, as the simulation sees them
+class PerimeterItem : public QGraphicsItem 
+{
+public:
+    PerimeterItem(NavDialog* ctrl, const PerimeterStore* p) :m_ctrl(ctrl), m_p(p)
+    {
+        setCacheMode(NoCache);
+    }
+
+    virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget);
+    virtual QRectF boundingRect() const;
+
+    NavDialog* m_ctrl;
+    const PerimeterStore* m_p;
+};
+
 class PathItem : public QGraphicsItem
 {
 public:
@@ -35,8 +35,11 @@ public slots:
     Q_INVOKABLE void remove_goal(PTR_T ptr) {
         ::remove_goal(ptr);
     }
-    Q_INVOKABLE void set_goal(PTR_T agentPtr, PTR_T goalPtr) {
-        ::set_goal(agentPtr, goalPtr);
+    Q_INVOKABLE void set_goal(PTR_T agentPtr, PTR_T goalPtr, int grouped) {
+        ::set_goal(agentPtr, goalPtr, grouped);
+    }
+    Q_INVOKABLE void group_goal_agents(PTR_T goalPtr) {
+        ::group_goal_agents(goalPtr);
     }
     Q_INVOKABLE void cpp_progress(float deltaSec) {
         ::cpp_progress(deltaSec);
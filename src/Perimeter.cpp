@@ -0,0 +1,169 @@
+#include "Perimeter.h"
+#include "Except.h"
+#include "Goal.h"
+
+#define ANTI_OVERLAP_FACTOR 0.0 //0.1
+
+
+// return the intersection point of lines L1=a+tv L2=b+ku
+static Vec2 lineIntersect(const Vec2& a, const Vec2& v, const Vec2& b, const Vec2& u)
+{
+    float k = (v.x*(b.y-a.y) + v.y*(a.x-b.x))/(u.x*v.y - u.y*v.x);
+    return b+k*u;
+}
+
+void PerimeterStore::build(const Mesh& mesh)
+{
+    clear();
+    size_t numEdges = 0;
+    for(const auto& poly: mesh.m_perimiters)
+        numEdges += poly.m_d.size();
+    m_edges.reserve(numEdges);
+    m_loops.reserve(mesh.m_perimiters.size());
+    m_vtxRef.assign(mesh.m_vtx.size(), NO_REF);
+
+    for(const auto& poly: mesh.m_perimiters)
+    {
+        const vector<Vertex*>& v = poly.m_d;
+        const int sz = (int)v.size();
+        auto get = [&](int i) -> const Vec2& { return v[(i + sz) % sz]->p; };
+
+        Loop loop;
+        loop.firstEdge = (int)m_edges.size();
+        loop.numEdges = sz;
+        loop.isCW = poly.m_isCW;
+
+        // the dpb of an edge is known at the next vertex, the one of the last edge at the first vertex
+        Vec2 firstDpb;
+        Vec2* prevDpb = &firstDpb;
+        for(int i = 0; i < sz; ++i)
+        {
+            const Vec2& a = get(i - 1);
+            const Vec2& b = get(i);
+            const Vec2& c = get(i + 1);
+            Vec2 ab = b - a;
+            Vec2 bc = c - b;
+            Vec2 nab = normalize(ab);
+            Vec2 nbc = normalize(bc);
+            Vec2 dp1 = Vec2(-nab.y, nab.x); // perp to ab
+            Vec2 dp2 = Vec2(-nbc.y, nbc.x); // perp to bc
+            Edge e;
+            e.a = b;
+            e.b = c;
+            if (dot(ab, bc) < 0) // sharp angle - use the 45 points and add a point segment between
+            {
+                Vec2 dpb1 = dp1 + nab;
+                Vec2 dpb1_m = dp1 + nab * (1.0 + ANTI_OVERLAP_FACTOR);
+                // slightly more, to have overlap between the segment VO and the point VO to avoid floating point problems
+
+                Vec2 dpb2 = dp2 - nbc;
+                Vec2 dpb2_m = dp2 - nbc * (1.0 + ANTI_OVERLAP_FACTOR);
+                Vec2 dpc = dp2 + nbc;
+
+                *prevDpb = dpb1_m;
+
+                // the corner takes precedence for representing this vertex
+                m_vtxRef[v[i]->index] = -2 - (int)m_corners.size();
+                m_corners.push_back(Corner{b, dpb1, dpb2});
+                e.dpa = dpb2_m;
+                e.dpb = dpc;
+            }
+            else
+            {
+                Vec2 mid;
+                if (det(ab, bc) != 0) {
+                    Vec2 near_b1 = b + dp1; // near b with distanct perpendicular to ab
+                    Vec2 near_b2 = b + dp2; // near b with distanct perpendicular to bc
+                    mid = lineIntersect(near_b1, nab, near_b2, nbc);
+                    mid = mid - b;
+                }
+                else { // collinear
+                    mid = dp2;
+                }
+
+                *prevDpb = mid + nab * ANTI_OVERLAP_FACTOR; // avoid overlap
+                m_vtxRef[v[i]->index] = (int)m_edges.size();
+                e.dpa = mid;
+                e.dpb = mid;
+            }
+            m_edges.push_back(e);
+            prevDpb = &m_edges.back().dpb; // reserved, does not move
+        }
+        *prevDpb = firstDpb;
+        m_loops.push_back(loop);
+    }
+}
+
+void PerimeterStore::clear()
+{
+    m_edges.clear();
+    m_corners.clear();
+    m_loops.clear();
+    m_vtxRef.clear();
+}
+
+void PerimeterStore::swap(PerimeterStore& other)
+{
+    m_edges.swap(other.m_edges);
+    m_corners.swap(other.m_corners);
+    m_loops.swap(other.m_loops);
+    m_vtxRef.swap(other.m_vtxRef);
+}
+
+size_t PerimeterStore::byteSize() const
+{
+    return sizeof(PerimeterStore) + m_edges.capacity() * sizeof(Edge) + m_corners.capacity() * sizeof(Corner)
+         + m_loops.capacity() * sizeof(Loop) + m_vtxRef.capacity() * sizeof(int);
+}
+
+void PerimeterStore::makeSubGoal(int vtxIndex, float keepDist, const Vec2& goingTo, Plan& addto) const
+{
+    int ref = m_vtxRef[vtxIndex];
+    if (ref >= 0)
+    {
+        const Edge& e = m_edges[ref];
+        Vec2 a = e.a + e.dpa * keepDist;
+        Vec2 outv = a - e.a; // from segment point outside
+        Vec2 toNext = goingTo - e.a;
+        bool rev = det(outv, toNext) > 0;
+        addto.addSeg(a, e.dpa, rev); // always take the first, that's how they are built
+        // dpa is not normalized, but it's close to 1 and the length of the SubGoalSegment does not need to be accurate
+    }
+    else
+    {
+        const Corner& c = m_corners[-2 - ref];
+        Vec2 a = c.p + c.dpa * keepDist;
+        Vec2 b = c.p + c.dpb * keepDist;
+        // don't know which order to put them, middle will be enough?
+        Vec2 mid = (a + b)*0.5f - c.p;
+        Vec2 toNext = goingTo - c.p;
+        if (det(mid, toNext) < 0) { // check which side of the mid line we're coming from and decide what order should the points be
+            addto.addSeg(a, c.dpa, false);
+            addto.addSeg(b, c.dpb, false);
+        }  // dpa,dpb are not normalized, but close enough, see above
+        else {
+            addto.addSeg(b, c.dpb, true); // rev true since if we're coming from this size, determining the isPassed half-plane is reveresed
+            addto.addSeg(a, c.dpa, true);
+        }
+    }
+}
+
+Vec2 PerimeterStore::makePathRef(int vtxIndex, float keepDist) const
+{
+    int ref = m_vtxRef[vtxIndex];
+    if (ref >= 0) {
+        const Edge& e = m_edges[ref];
+        return e.a + e.dpa * keepDist;
+    }
+    const Corner& c = m_corners[-2 - ref];
+    Vec2 a = c.p + c.dpa * keepDist;
+    Vec2 b = c.p + c.dpb * keepDist;
+    return (a + b)*0.5f;
+}
+
+void PerimeterStore::obstacleVertices(const Loop& loop, vector<Vec2>& out) const
+{
+    out.clear();
+    for(int i = loop.firstEdge + loop.numEdges - 1; i >= loop.firstEdge; --i)
+        out.push_back(m_edges[i].a); // the perimeters are CCW
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "Vec2.h"
+#include "Mesh.h"
+
+using namespace std;
+
+class Plan;
+
+// the static geometry of the perimeters of a mesh, in flat arrays that are built in one pass after
+// the triangulation. the planner makes the sub-goals of a plan from it, the simulation takes its
+// obstacles from it and the display draws it
+class PerimeterStore
+{
+public:
+    // from a vertex of a perimeter to the next one
+    struct Edge {
+        Vec2 a, b;
+        Vec2 dpa, dpb; // these point in diagonal away from the points. they are an approximation of a circle around the point
+    };
+    // the gap between the VOs of the two edges of a sharp corner
+    struct Corner {
+        Vec2 p;
+        Vec2 dpa, dpb;
+    };
+    struct Loop {
+        int firstEdge;
+        int numEdges; // the edges of a perimeter are in the order of its vertices
+        bool isCW;
+    };
+
+    void build(const Mesh& mesh);
+    void clear();
+    void swap(PerimeterStore& other);
+    size_t byteSize() const;
+
+    // is the mesh vertex on a perimeter
+    bool hasVertex(int vtxIndex) const {
+        return m_vtxRef[vtxIndex] != NO_REF;
+    }
+    // add the sub-goals that keep keepDist from the vertex, a sharp corner adds 2 goal segments
+    // and another vertex adds 1
+    void makeSubGoal(int vtxIndex, float keepDist, const Vec2& goingTo, Plan& addto) const;
+    // a single "representative" point for this vertex so that extracting the path from the corridor would be accurate
+    Vec2 makePathRef(int vtxIndex, float keepDist) const;
+
+    // the points of a loop in the clockwise order the simulation needs for the obstacles
+    void obstacleVertices(const Loop& loop, vector<Vec2>& out) const;
+
+    vector<Edge> m_edges;
+    vector<Corner> m_corners;
+    vector<Loop> m_loops; // same order as Mesh::m_perimiters
+
+private:
+    enum { NO_REF = -1 };
+    // for every mesh vertex, the index of the edge that starts at it, or -2 - the index of its corner
+    // if it is sharp, or NO_REF if it is not on a perimeter
+    vector<int> m_vtxRef;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+// checks and measurements of the simulation that run without a display, see checks_main.cpp.
+// a check throws Exception (with CHECK) when it fails, a bench prints what it measured
+
+#include "../Except.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+class Document;
+
+// every check and bench, registered in checks_main.cpp
+void checkStepAllocs();
+void checkThreads();
+void checkAgentGrid();
+void benchAgentGrid();
+void checkVerletLists();
+void benchVerletLists();
+void checkObstacleLists();
+void benchObstacleLists();
+void benchObstacleSplits();
+void checkCheckpoint();
+void benchCheckpoint();
+void checkGroups();
+void benchGroups();
+void checkBihNearest();
+void benchBihNearest();
+void checkMtrig();
+void benchMtrig();
+void checkMeshMirror();
+void benchMeshMirror();
+void checkFrameStore();
+void benchFrameStore();
+void checkAddAgents();
+void benchAddAgents();
+void checkEvents();
+void benchEvents();
+void checkReplanBudget();
+void benchReplanBudget();
+void checkPerimeterStore();
+void benchPerimeterStore();
+void checkBatchScenes();
+void checkNavCache();
+
+// five agents that go around a triangle in a square to a goal behind it, the map and agents of tests/_tri_in_square4_5agent.txt
+extern const char* const SCENE_TRI_IN_SQUARE;
+
+// two blocks of perSide agents in an open square that swap sides, they meet in the middle
+std::string crowdScene(int perSide);
+
+// count agents on a ring that all go to its middle past a wall, every 25th to a goal in the wall that it cannot reach
+std::string ringScene(int count);
+
+// a square of perSide x perSide boxes without the box at index missing (-1 for all of them), 2025 boxes is a large map
+std::string boxScene(int perSide, int missing);
+
+// reads the scene into doc and builds its navigation, throws if it has no agents or the triangulation failed
+void loadCheckScene(Document& doc, const std::string& text);
+
+// milliseconds of the fastest of repeats calls of f
+template<typename F>
+double bestMs(int repeats, const F& f)
+{
+    double best = 1e30;
+    for(int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// a and b are the same up to tolerance times their size, or tolerance when they are smaller than 1
+inline bool closeTo(float a, float b, float tolerance) {
+    return std::abs(a - b) <= tolerance * std::max(1.0f, std::max(std::abs(a), std::abs(b)));
+}
+
+inline std::string checkMsg(const char* what, float a, float b) {
+    std::stringstream ss;
+    ss << what << " " << a << " != " << b;
+    return ss.str();
+}
+
+// the values a bench computed go here so that the compiler does not drop the work
+extern volatile float g_benchSink;
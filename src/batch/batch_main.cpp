@@ -0,0 +1,98 @@
+// headless runner of parameter sweeps over a scene, see BatchRunner
+//   batch <scene file> [--steps N] [--threads N] [--out results.csv|results.json]
+//         [--ndf 1.5,2] [--mn 5,10] [--th 2,5] [--tho 5] [--grs 1]
+// every combination of the listed values is a run. parameters that are not listed keep the defaults of AgentParams
+
+#include "../BatchRunner.h"
+#include "../Except.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+void cpp_out(const char* s) {
+    cout << s << endl;
+}
+
+template<typename T>
+static vector<T> parseList(const char* s)
+{
+    vector<T> v;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ','))
+        v.push_back((T)atof(item.c_str()));
+    CHECK(!v.empty(), string("Empty list ") + s);
+    return v;
+}
+
+static void usage()
+{
+    cerr << "usage: batch <scene> [--steps N] [--threads N] [--out file.csv|file.json]\n"
+            "             [--ndf list] [--mn list] [--th list] [--tho list] [--grs list]\n"
+            "  ndf neighbor distance factor, mn max neighbors, th time horizon,\n"
+            "  tho obstacle time horizon, grs goal radius scale. lists are comma separated\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    AgentParams def;
+    vector<float> ndf(1, def.neighborDistFactor), th(1, def.timeHorizon), tho(1, def.timeHorizonObst), grs(1, def.goalRadiusScale);
+    vector<int> mn(1, def.maxNeighbors);
+    int steps = 2000;
+    int threads = RVO::ThreadPool::hardwareThreads();
+    string out = "batch_results.csv";
+
+    try {
+        for(int i = 2; i < argc; ++i)
+        {
+            CHECK(i + 1 < argc, string("Missing value of ") + argv[i]);
+            const char* key = argv[i];
+            const char* value = argv[++i];
+            if (strcmp(key, "--steps") == 0)
+                steps = atoi(value);
+            else if (strcmp(key, "--threads") == 0)
+                threads = atoi(value);
+            else if (strcmp(key, "--out") == 0)
+                out = value;
+            else if (strcmp(key, "--ndf") == 0)
+                ndf = parseList<float>(value);
+            else if (strcmp(key, "--mn") == 0)
+                mn = parseList<int>(value);
+            else if (strcmp(key, "--th") == 0)
+                th = parseList<float>(value);
+            else if (strcmp(key, "--tho") == 0)
+                tho = parseList<float>(value);
+            else if (strcmp(key, "--grs") == 0)
+                grs = parseList<float>(value);
+            else {
+                usage();
+                return 1;
+            }
+        }
+
+        BatchRunner runner;
+        runner.loadScene(argv[1]);
+        runner.addSweep(ndf, mn, th, tho, grs);
+        vector<BatchMetrics> results = runner.run(steps, threads);
+
+        // the simulation writes to stdout so the results go to a file
+        ofstream ofs(out);
+        CHECK(ofs.good(), "Can't write " + out);
+        bool json = out.size() >= 5 && out.compare(out.size() - 5, 5, ".json") == 0;
+        if (json)
+            BatchRunner::writeJson(ofs, results);
+        else
+            BatchRunner::writeCsv(ofs, results);
+        cerr << results.size() << " runs written to " << out << endl;
+    }
+    catch(const exception& e) {
+        cerr << "failed: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
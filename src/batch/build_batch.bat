@@ -0,0 +1,2 @@
+g++ -O2 -std=c++11 -pthread batch_main.cpp ../BatchRunner.cpp ../poly2tri/adapter.cc ../poly2tri/advancing_front.cc ../poly2tri/shapes.cc ../poly2tri/sweep.cc ../poly2tri/sweep_context.cc ../rvo2/RAgent.cpp ../rvo2/KdTree.cpp ../rvo2/RVOSimulator.cpp ../rvo2/ThreadPool.cpp ../rvo2/AgentGrid.cpp ../Document.cpp ../Mesh.cpp ../NavCache.cpp ../Perimeter.cpp ../AllocCount.cpp ../js/order_perimiters.cpp -o batch.exe
+g++ -O2 -std=c++11 -pthread -DNAV_COUNT_ALLOCS checks_main.cpp check_alloc.cpp check_threads.cpp check_grid.cpp check_verlet.cpp check_obstacles.cpp check_checkpoint.cpp check_groups.cpp check_bih.cpp check_mtrig.cpp check_meshmirror.cpp check_frames.cpp check_spawn.cpp check_events.cpp check_replan.cpp check_perimeter.cpp check_batch.cpp check_navcache.cpp ../BatchRunner.cpp ../poly2tri/adapter.cc ../poly2tri/advancing_front.cc ../poly2tri/shapes.cc ../poly2tri/sweep.cc ../poly2tri/sweep_context.cc ../rvo2/RAgent.cpp ../rvo2/KdTree.cpp ../rvo2/RVOSimulator.cpp ../rvo2/ThreadPool.cpp ../rvo2/AgentGrid.cpp ../Document.cpp ../Checkpoint.cpp ../FrameStore.cpp ../BihTree.cpp ../Mesh.cpp ../NavCache.cpp ../Perimeter.cpp ../AllocCount.cpp ../js/order_perimiters.cpp ../js/MeshMirror.cpp -o checks.exe
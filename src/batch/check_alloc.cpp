@@ -0,0 +1,65 @@
+// Document::doStep does not allocate after its warm-up, and the check of it catches a step that does
+
+#include "Checks.h"
+#include "../Document.h"
+#include "../rvo2/ThreadPool.h"
+
+#define ALLOC_CHECK_STEPS 2000
+
+void checkStepAllocs()
+{
+#ifdef NAV_COUNT_ALLOCS
+    size_t before = navAllocCount();
+    g_benchSink += (float)vector<int>(1).size();
+    CHECK(navAllocCount() == before + 1, "navAllocCount did not count an allocation");
+
+    // every chunk allocates once, whichever thread runs it
+    RVO::ThreadPool pool;
+    pool.setNumThreads(4);
+    before = navAllocCount() + pool.workerAllocCount();
+    pool.parallelFor(64, 1, [](int, int) { g_benchSink += (float)vector<int>(1).size(); });
+    size_t counted = navAllocCount() + pool.workerAllocCount() - before;
+    CHECK(counted == 64, checkMsg("Allocations of the pool's chunks", (float)counted, 64.0f));
+
+    Document doc;
+    doc.m_sim.setEventMask(RVO::eventBit(RVO::EVENT_REPLAN));
+    loadCheckScene(doc, SCENE_TRI_IN_SQUARE);
+    vector<RVO::Event> events;
+    doc.m_sim.drainEvents(RVO::eventBit(RVO::EVENT_REPLAN), events); // the first plans
+
+    // doStep throws when it allocates after the warm-up. the agents get stuck at the triangle and replan
+    int step = 0;
+    for(; step < ALLOC_CHECK_STEPS; ++step)
+        if (doc.doStep(FIXED_STEP_TIME, true, step))
+            break;
+    events.clear();
+    doc.m_sim.drainEvents(RVO::eventBit(RVO::EVENT_REPLAN), events);
+    CHECK(!events.empty(), "The agents should replan while they step");
+    CHECK(step < ALLOC_CHECK_STEPS, "The agents should reach their goal");
+
+    // a step that has to grow a buffer it had before
+    doc.m_agents[0]->setPos(doc.m_agents[0]->m_position + Vec2(30, 0));
+    doc.updatePlan(doc.m_agents[0]);
+    for(int i = 0; i < ALLOC_WARMUP_STEPS; ++i)
+        doc.doStep(FIXED_STEP_TIME, true, step++);
+    for(auto& scratch: doc.m_sim.agentScratch_)
+        vector<RVO::Line>().swap(scratch.orcaLines);
+    bool threw = false;
+    try {
+        doc.doStep(FIXED_STEP_TIME, true, step++);
+    }
+    catch(const Exception& e) {
+        threw = true;
+    }
+    CHECK(threw, "doStep allocated after warm-up and did not throw");
+
+    // with a pool the agent tree is built in subtrees, how many depends on where the agents are. these all meet in the middle
+    Document pooled;
+    pooled.m_sim.setNumThreads(4);
+    loadCheckScene(pooled, ringScene(100));
+    for(int i = 0; i < 1000; ++i)
+        pooled.doStep(FIXED_STEP_TIME, true, i);
+#else
+    CHECK(false, "The checks are built without NAV_COUNT_ALLOCS");
+#endif
+}
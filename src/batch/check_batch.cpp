@@ -0,0 +1,55 @@
+// the batch runner reads the scenes of tests/, which are in the format of the first version
+
+#include "Checks.h"
+#include "../BatchRunner.h"
+
+// tests/_1_goinside2.txt with a glued goal as in tests/_grid.txt and an agent of that goal
+static const char* const OLD_SCENE =
+    "\n"
+    "polyline\n"
+    "v -392 -317\nv -418 327\nv 349 344\nv 361 -303\n"
+    "\n"
+    "polyline\n"
+    "v -132 87\nv -125 -27\nv -7 -34\nv -20 110\n"
+    "goal200 -200\n"
+    "agent 150 -250 0\n"
+    "start 200 0\n"
+    "end -213 150\n"
+    "agent 81 -79\n";
+
+void checkBatchScenes()
+{
+    CHECK(BatchRunner::isOldScene(OLD_SCENE) && !BatchRunner::isOldScene(SCENE_TRI_IN_SQUARE), "The old format is not told from the current one");
+
+    Document doc;
+    loadCheckScene(doc, BatchRunner::convertOldScene(OLD_SCENE));
+    CHECK(doc.m_mapdef.m_pl.size() == 2 && doc.m_mapdef.m_pl[0]->m_d.size() == 4 && doc.m_mapdef.m_pl[1]->m_d.size() == 4,
+          "The polylines of the old scene were not read");
+    CHECK(doc.m_mapdef.m_pl[1]->m_d[2]->p == Vec2(-7, -34), "A vertex of the old scene moved");
+    CHECK(doc.m_goals.size() == 2 && doc.m_goals[0]->def.p == Vec2(200, -200) && doc.m_goals[1]->def.p == Vec2(-213, 150),
+          "The goal and the end point of the old scene are not the goals");
+    CHECK(doc.m_agents.size() == 3, checkMsg("Agents of the old scene", (float)doc.m_agents.size(), 3.0f));
+
+    // the agents are in the order of the scene, the one of start after the ones of "agent"
+    const RVO::Agent* const* a = doc.m_agents.data();
+    CHECK(a[0]->m_position == Vec2(150, -250) && a[0]->m_endGoalId == doc.m_goals[0].get(), "The agent of the glued goal");
+    CHECK(a[1]->m_position == Vec2(81, -79) && !a[1]->m_endGoalPos.p.isValid(), "The agent without a goal should stand");
+    CHECK(a[2]->m_position == Vec2(200, 0) && a[2]->m_endGoalId == doc.m_goals[1].get(), "The start agent should go to the end point");
+    for(int i = 0; i < 3; ++i)
+        CHECK(a[i]->m_radius == OLD_SCENE_AGENT_RADIUS && a[i]->maxSpeed_ == OLD_SCENE_AGENT_SPEED, "The size of an old scene agent");
+
+    // the runner takes the old text as it is, and refuses a scene that has no map like tests/_grid.txt
+    BatchRunner runner;
+    runner.setSceneText(OLD_SCENE);
+    runner.addRun(BatchRun());
+    const vector<BatchMetrics> results = runner.run(10, 1);
+    CHECK(results.size() == 1 && results[0].error.empty() && results[0].steps == 10, "The runner did not run the old scene");
+    bool threw = false;
+    try {
+        runner.setSceneText("goal200 -200\nagent -200 -200 0\n");
+    }
+    catch(const Exception&) {
+        threw = true;
+    }
+    CHECK(threw, "A scene without a map should be refused");
+}
@@ -0,0 +1,139 @@
+// BihTree::nearest against a scan of all the objects, and its queries against the agent tree of RVO
+
+#include "Checks.h"
+#include "../BihTree.h"
+#include "../Objects.h"
+#include "../Document.h"
+
+#define BIH_OBJECTS 3000
+#define BIH_K 10
+#define BIH_RANGE 80.0f
+
+// circles and agents at the same places
+static void randomCircles(vector<unique_ptr<Circle>>& circles, Document& doc)
+{
+    minstd_rand rng(47);
+    uniform_real_distribution<float> pos(-1000.0f, 1000.0f), radius(3.0f, 15.0f);
+    doc.clearAllObj(); // the agents of the simulator's setup
+    for(int i = 0; i < BIH_OBJECTS; ++i) {
+        const Vec2 p(pos(rng), pos(rng));
+        const float r = radius(rng);
+        circles.emplace_back(new Circle(p, r, i));
+        doc.addAgent(p, nullptr, r, 1.0f);
+    }
+    doc.m_sim.prepareStep(); // builds the agent tree
+}
+
+static vector<Object*> objectsOf(const vector<unique_ptr<Circle>>& circles)
+{
+    vector<Object*> objs;
+    for(const auto& c: circles)
+        objs.push_back(c.get());
+    return objs;
+}
+
+// the k nearest centers of the agent tree, with the other agents in range
+static void kdNearest(const Document& doc, RVO::Agent* agent, int k)
+{
+    agent->agentNeighbors_.clear();
+    agent->neighborLimit_ = (size_t)k;
+    float rangeSq = sqr(BIH_RANGE);
+    doc.m_sim.kdTree_.computeAgentNeighbors(agent, rangeSq);
+}
+
+void checkBihNearest()
+{
+    vector<unique_ptr<Circle>> circles;
+    Document doc;
+    randomCircles(circles, doc);
+    vector<Object*> objs = objectsOf(circles);
+    BihTree tree;
+    tree.build(objs);
+
+    vector<BihTree::TNeighbor> nearest;
+    vector<float> scan;
+    for(size_t qi = 0; qi < circles.size(); ++qi)
+    {
+        const Circle* self = circles[qi].get();
+        const Vec2 p = self->m_position;
+        auto centerDistSq = [&](Object* obj, float) { return (obj == self) ? FLT_MAX : distSq(obj->m_position, p); };
+        // k that is less than, equal to and more than the objects in range
+        for(int k: { 1, BIH_K, 1000 }) {
+            tree.nearest(p, BIH_RANGE, k, nearest, centerDistSq);
+            scan.clear();
+            for(const auto& c: circles)
+                if (c.get() != self && distSq(c->m_position, p) < sqr(BIH_RANGE))
+                    scan.push_back(distSq(c->m_position, p));
+            sort(scan.begin(), scan.end());
+            scan.resize(min((int)scan.size(), k));
+            CHECK(nearest.size() == scan.size(), checkMsg("BihTree::nearest found another count than the scan", (float)nearest.size(), (float)scan.size()));
+            for(size_t i = 0; i < scan.size(); ++i)
+                CHECK(nearest[i].first == scan[i], checkMsg("BihTree::nearest is not the nearest", nearest[i].first, scan[i]));
+
+            // the agent tree finds the same distances, the objects of equal distances may differ
+            kdNearest(doc, doc.m_agents[qi], k);
+            const auto& kd = doc.m_agents[qi]->agentNeighbors_;
+            CHECK(kd.size() == scan.size(), checkMsg("The agent tree found another count than BihTree", (float)kd.size(), (float)scan.size()));
+            for(size_t i = 0; i < scan.size(); ++i)
+                CHECK(kd[i].first == scan[i], checkMsg("The agent tree found other distances than BihTree", kd[i].first, scan[i]));
+        }
+
+        // by the distance to the bounds
+        tree.nearest(p, BIH_RANGE, BIH_K, nearest);
+        for(size_t i = 1; i < nearest.size(); ++i)
+            CHECK(nearest[i - 1].first <= nearest[i].first, "BihTree::nearest is not sorted");
+    }
+}
+
+void benchBihNearest()
+{
+    vector<unique_ptr<Circle>> circles;
+    Document doc;
+    randomCircles(circles, doc);
+    vector<Object*> objs = objectsOf(circles);
+    BihTree tree;
+    const double bihBuildMs = bestMs(5, [&]{ tree.build(objs); });
+    const double kdBuildMs = bestMs(5, [&]{ doc.m_sim.kdTree_.buildAgentTree(); });
+
+    vector<BihTree::TNeighbor> nearest;
+    const double nearestMs = bestMs(5, [&]{
+        for(const auto& c: circles) {
+            const Circle* self = c.get();
+            tree.nearest(self->m_position, BIH_RANGE, BIH_K, nearest, [&](Object* obj, float) {
+                return (obj == self) ? FLT_MAX : distSq(obj->m_position, self->m_position);
+            });
+            g_benchSink += (float)nearest.size();
+        }
+    });
+    // what the old Agent did: everything in range from query, trimmed to the nearest with a heap
+    MyPrioQueue<BihTree::TNeighbor> heap;
+    const double queryMs = bestMs(5, [&]{
+        for(const auto& c: circles) {
+            const Circle* self = c.get();
+            heap.clear();
+            float rangeSq = sqr(BIH_RANGE);
+            tree.query(self->m_position, BIH_RANGE, [&](Object* obj) {
+                const float d = distSq(obj->m_position, self->m_position);
+                if (obj == self || d >= rangeSq)
+                    return;
+                heap.qpush(BihTree::TNeighbor(d, obj));
+                if ((int)heap.c.size() > BIH_K) {
+                    heap.qpop();
+                    rangeSq = heap.top().first;
+                }
+            });
+            g_benchSink += (float)heap.c.size();
+        }
+    });
+    const double kdMs = bestMs(5, [&]{
+        for(auto* a: doc.m_agents) {
+            kdNearest(doc, a, BIH_K);
+            g_benchSink += (float)a->agentNeighbors_.size();
+        }
+    });
+    const double count = (double)circles.size();
+    cout << BIH_OBJECTS << " objects, " << BIH_K << " nearest in " << BIH_RANGE << "\n";
+    cout << "  build: BihTree " << bihBuildMs << " ms, RVO::KdTree " << kdBuildMs << " ms\n";
+    cout << "  BihTree::nearest " << nearestMs * 1e6 / count << " ns, BihTree::query and a heap " << queryMs * 1e6 / count
+         << " ns, RVO::KdTree " << kdMs * 1e6 / count << " ns" << endl;
+}
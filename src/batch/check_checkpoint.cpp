@@ -0,0 +1,78 @@
+// restoring a SimCheckpoint steps the same as the first time, and it is refused when the agents or goals were replaced
+
+#include "Checks.h"
+#include "../Checkpoint.h"
+
+static void stepDoc(Document& doc, int steps)
+{
+    for(int i = 0; i < steps; ++i)
+        doc.doStep(FIXED_STEP_TIME, true, i);
+}
+
+static vector<Vec2> positions(const Document& doc)
+{
+    vector<Vec2> p;
+    for(const auto* a: doc.m_agents)
+        p.push_back(a->m_position);
+    return p;
+}
+
+void checkCheckpoint()
+{
+    Document doc;
+    loadCheckScene(doc, crowdScene(50));
+    stepDoc(doc, 100);
+
+    SimCheckpoint cp;
+    cp.save(doc, nullptr);
+    stepDoc(doc, 200);
+    const vector<Vec2> first = positions(doc);
+    CHECK(cp.restore(doc), "A checkpoint of the same agents and goals was not restored");
+    stepDoc(doc, 200);
+    CHECK(positions(doc) == first, "Stepping from the restored checkpoint went elsewhere than the first time");
+
+    // the new agent takes the index of the removed one and likely its address too
+    RVO::Agent* last = doc.m_agents.back();
+    const Vec2 pos = last->m_position;
+    const float radius = last->m_radius, maxSpeed = last->maxSpeed_;
+    Goal* goal = last->m_endGoalId;
+    doc.removeAgent(last->handle_);
+    doc.addAgent(pos, goal, radius, maxSpeed);
+    CHECK(!cp.restore(doc), "A checkpoint was restored into an agent that replaced the one it was saved from");
+
+    cp.save(doc, nullptr);
+    CHECK(cp.restore(doc), "A checkpoint of the same agents and goals was not restored");
+    const GoalDef def = doc.m_goals.back()->def;
+    doc.removeGoal(doc.m_goals.back().get());
+    doc.addGoal(def.p, def.radius, def.type);
+    CHECK(!cp.restore(doc), "A checkpoint was restored with a goal that replaced the one it was saved with");
+}
+
+void benchCheckpoint()
+{
+    Document doc;
+    loadCheckScene(doc, crowdScene(200));
+    stepDoc(doc, 100);
+
+    // every save shares the plans of the one before, as the page saves them
+    const int saves = 200;
+    vector<SimCheckpoint> cps(saves);
+    auto start = chrono::steady_clock::now();
+    size_t bytes = 0;
+    for(int i = 0; i < saves; ++i) {
+        cps[i].save(doc, (i > 0) ? &cps[i - 1] : nullptr);
+        bytes += cps[i].bytes();
+        doc.doStep(FIXED_STEP_TIME, true, i);
+    }
+    const double stepAndSaveMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    const double saveMs = bestMs(5, [&]{
+        for(int i = 1; i < saves; ++i)
+            cps[i].save(doc, &cps[i - 1]);
+    }) / (saves - 1);
+    const double restoreMs = bestMs(5, [&]{
+        for(int i = 0; i < saves; ++i)
+            g_benchSink += (float)cps[i].restore(doc);
+    }) / saves;
+    cout << doc.m_agents.size() << " agents, save " << saveMs * 1000.0 << " us, restore " << restoreMs * 1000.0 << " us, "
+         << bytes / saves << " bytes per checkpoint, " << saves << " steps with saves " << stepAndSaveMs << " ms" << endl;
+}
@@ -0,0 +1,132 @@
+// the events of the rings drained the same with any number of threads, filtered by the mask, and what recording them costs
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <cstring>
+#include <sstream>
+
+#define ALL_EVENTS ((1u << RVO::EVENT_TYPE_COUNT) - 1)
+
+// the events of every step drained after it as the hosts do, the first plans are recorded too
+static void runEvents(const string& scene, int numThreads, unsigned int mask, int steps, vector<RVO::Event>& events,
+                      vector<Vec2>& positions, double* ms)
+{
+    Document doc;
+    doc.m_sim.setNumThreads(numThreads);
+    doc.m_sim.setEventMask(mask);
+    loadCheckScene(doc, scene);
+    events.clear();
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < steps; ++i) {
+        doc.doStep(FIXED_STEP_TIME, true, i);
+        doc.m_sim.drainEvents(mask, events);
+    }
+    if (ms != nullptr)
+        *ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    CHECK(doc.m_sim.droppedEvents() == 0, "Events were dropped");
+    positions.clear();
+    for(const auto* a: doc.m_agents) {
+        positions.push_back(a->m_position);
+        // an agent that stops at its goal had an event for it
+        if (a->m_reached && (mask & RVO::eventBit(RVO::EVENT_GOAL_REACHED)) != 0) {
+            bool found = false;
+            for(const auto& e: events)
+                found |= (e.type == RVO::EVENT_GOAL_REACHED && e.agent == a->handle_);
+            CHECK(found, checkMsg("No goal reached event of the agent in slot", (float)a->handle_.slot, (float)a->handle_.slot));
+        }
+    }
+}
+
+static bool sameEvent(const RVO::Event& a, const RVO::Event& b)
+{
+    return a.step == b.step && a.agent == b.agent && a.type == b.type && memcmp(&a.value, &b.value, sizeof(float)) == 0;
+}
+
+static void checkSameEvents(const char* what, const vector<RVO::Event>& a, const vector<RVO::Event>& b)
+{
+    CHECK(a.size() == b.size(), checkMsg(what, (float)a.size(), (float)b.size()));
+    for(size_t i = 0; i < a.size(); ++i) {
+        if (!sameEvent(a[i], b[i])) {
+            stringstream ss;
+            ss << what << ": event " << i << " is step " << a[i].step << " slot " << a[i].agent.slot << " type " << a[i].type
+               << " and step " << b[i].step << " slot " << b[i].agent.slot << " type " << b[i].type;
+            throw Exception(ss.str());
+        }
+    }
+}
+
+void checkEvents()
+{
+    const string scene = ringScene(100);
+    const int steps = 1000;
+    vector<RVO::Event> one, four, none, some;
+    vector<Vec2> onePos, fourPos, nonePos, somePos;
+    runEvents(scene, 1, ALL_EVENTS, steps, one, onePos, nullptr);
+
+    int counts[RVO::EVENT_TYPE_COUNT] = { 0 };
+    for(size_t i = 0; i < one.size(); ++i) {
+        counts[one[i].type]++;
+        if (i > 0) {
+            const RVO::Event& p = one[i - 1];
+            CHECK(p.step < one[i].step || (p.step == one[i].step && (p.agent.slot < one[i].agent.slot
+                  || (p.agent.slot == one[i].agent.slot && p.type <= one[i].type))), "The events are not by step, agent and type");
+        }
+    }
+    for(int t = 0; t < RVO::EVENT_TYPE_COUNT; ++t)
+        CHECK(counts[t] > 0, checkMsg("The scene had no events of type", (float)t, (float)t));
+
+    runEvents(scene, 4, ALL_EVENTS, steps, four, fourPos, nullptr);
+    checkSameEvents("The events of 4 threads are not the ones of 1 thread", four, one);
+
+    // recording does not change the steps
+    runEvents(scene, 1, 0, steps, none, nonePos, nullptr);
+    CHECK(none.empty(), "Events were recorded with no mask");
+    CHECK(nonePos == onePos, "Recording events changed the steps");
+
+    // a mask records only its types, the same ones as with all types
+    const unsigned int mask = RVO::eventBit(RVO::EVENT_REPLAN) | RVO::eventBit(RVO::EVENT_GOAL_REACHED);
+    runEvents(scene, 4, mask, steps, some, somePos, nullptr);
+    vector<RVO::Event> filtered;
+    for(const auto& e: one)
+        if ((mask & RVO::eventBit((RVO::EventType)e.type)) != 0)
+            filtered.push_back(e);
+    checkSameEvents("The events of a mask are not the ones of all types", some, filtered);
+
+    // a full ring drops the newer events and keeps the order of the older
+    RVO::EventRing ring;
+    ring.push(RVO::EVENT_REPLAN, RVO::AgentHandle(0, 0), 0.0f);
+    ring.setMask(ALL_EVENTS);
+    for(int i = 0; i < EVENT_RING_CAPACITY + 10; ++i)
+        ring.push(RVO::EVENT_STUCK, RVO::AgentHandle(i, 1), (float)i);
+    CHECK(ring.dropped() == 10, checkMsg("A full ring dropped", (float)ring.dropped(), 10.0f));
+    vector<RVO::Event> drained;
+    ring.drain(ALL_EVENTS, drained);
+    CHECK(drained.size() == EVENT_RING_CAPACITY, checkMsg("A full ring drained", (float)drained.size(), (float)EVENT_RING_CAPACITY));
+    for(int i = 0; i < EVENT_RING_CAPACITY; ++i)
+        CHECK(drained[i].agent.slot == i && drained[i].value == (float)i, checkMsg("A full ring drained out of order at", (float)i, (float)drained[i].agent.slot));
+    ring.push(RVO::EVENT_REPLAN, RVO::AgentHandle(1, 1), 0.0f);
+    drained.clear();
+    ring.drain(RVO::eventBit(RVO::EVENT_STUCK), drained);
+    CHECK(drained.empty(), "The drain took a type that is not in its mask");
+    ring.drain(ALL_EVENTS, drained);
+    CHECK(drained.empty(), "A drain kept the events of the types that are not in its mask");
+}
+
+void benchEvents()
+{
+    const string scene = crowdScene(1000);
+    const int steps = 1500;
+    vector<RVO::Event> events;
+    vector<Vec2> offPos, onPos;
+    double offMs = 0.0, onMs = 0.0;
+    runEvents(scene, 4, 0, steps, events, offPos, &offMs);
+    runEvents(scene, 4, ALL_EVENTS, steps, events, onPos, &onMs);
+    int counts[RVO::EVENT_TYPE_COUNT] = { 0 };
+    for(const auto& e: events)
+        counts[e.type]++;
+    cout << "2000 agents, " << steps << " steps, 4 threads: events off " << offMs << " ms, all types " << onMs << " ms\n";
+    cout << "  " << counts[RVO::EVENT_GOAL_REACHED] << " reached, " << counts[RVO::EVENT_REPLAN] << " replan, "
+         << counts[RVO::EVENT_PLAN_FAILED] << " plan failed, " << counts[RVO::EVENT_STUCK] << " stuck, "
+         << counts[RVO::EVENT_LP3_FALLBACK] << " LP3" << endl;
+}
@@ -0,0 +1,126 @@
+// the recorded frames read back within the quantization, in any order, after truncate and over the memory limit
+
+#include "Checks.h"
+#include "../Document.h"
+#include "../FrameStore.h"
+
+#include <sstream>
+
+typedef vector<FrameStore::AgentState> Frame;
+
+// the states of the agents of the scene after every step
+static vector<Frame> recordCrowd(int perSide, int steps)
+{
+    Document doc;
+    loadCheckScene(doc, crowdScene(perSide));
+    vector<Frame> frames(steps);
+    for(int f = 0; f < steps; ++f) {
+        doc.doStep(FIXED_STEP_TIME, true, f);
+        for(const auto* a: doc.m_agents) {
+            FrameStore::AgentState s;
+            s.pos = a->m_position;
+            s.vel = a->m_velocity;
+            frames[f].push_back(s);
+        }
+    }
+    return frames;
+}
+
+static string frameMsg(const char* what, int f)
+{
+    stringstream ss;
+    ss << what << " " << f;
+    return ss.str();
+}
+
+static bool sameFrame(const Frame& a, const Frame& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); ++i)
+        if (!(a[i].pos == b[i].pos) || !(a[i].vel == b[i].vel))
+            return false;
+    return true;
+}
+
+// what get() gives for f, one step of the quantization is what rounding takes away at most
+static void checkFrame(FrameStore& store, int f, const Frame& recorded, Frame& out)
+{
+    stringstream ss;
+    ss << "frame " << f;
+    CHECK(store.get(f, out), ss.str() + " is not stored");
+    CHECK(out.size() == recorded.size(), ss.str() + " has a different agent count");
+    const float posErr = 0.5f / FRAME_POS_QUANT + 1e-4f, velErr = 0.5f / FRAME_VEL_QUANT + 1e-5f;
+    for(size_t i = 0; i < out.size(); ++i) {
+        const Vec2 dp = out[i].pos - recorded[i].pos, dv = out[i].vel - recorded[i].vel;
+        if (std::abs(dp.x) > posErr || std::abs(dp.y) > posErr || std::abs(dv.x) > velErr || std::abs(dv.y) > velErr) {
+            ss << " agent " << i << " is off by " << dp.x << "," << dp.y << " in position and " << dv.x << "," << dv.y << " in velocity";
+            throw Exception(ss.str());
+        }
+    }
+}
+
+void checkFrameStore()
+{
+    const int steps = 3 * KEYFRAME_INTERVAL + 5;
+    const vector<Frame> recorded = recordCrowd(100, steps);
+    FrameStore store;
+    for(const auto& frame: recorded)
+        store.push(frame);
+    CHECK(store.firstFrame() == 0 && store.endFrame() == steps, "The store does not have all the pushed frames");
+
+    vector<Frame> inOrder(steps);
+    for(int f = 0; f < steps; ++f)
+        checkFrame(store, f, recorded[f], inOrder[f]);
+
+    // backwards and jumping around, the decoding starts from the keyframe and not from the frame read before
+    minstd_rand rng(39);
+    uniform_int_distribution<int> anyFrame(0, steps - 1);
+    Frame out;
+    for(int i = 0; i < 200; ++i) {
+        const int f = (i < steps) ? steps - 1 - i : anyFrame(rng);
+        CHECK(store.get(f, out) && sameFrame(out, inOrder[f]), frameMsg("A random read differs from the read in order at frame", f));
+    }
+    CHECK(!store.get(-1, out) && !store.get(steps, out), "A frame out of the range was read");
+
+    // rewind into a block and at a keyframe and record again, the frames continue the same
+    for(int at: { 2 * KEYFRAME_INTERVAL + 3, KEYFRAME_INTERVAL }) {
+        store.truncate(at);
+        CHECK(store.endFrame() == at && !store.get(at, out), frameMsg("truncate did not drop the frames from", at));
+        for(int f = at; f < steps; ++f)
+            store.push(recorded[f]);
+        for(int f = 0; f < steps; ++f)
+            CHECK(store.get(f, out) && sameFrame(out, inOrder[f]), frameMsg("After truncate and recording again a different frame", f));
+    }
+
+    // over the memory limit the oldest blocks go and the rest still read the same
+    const size_t limit = store.bytes() / 2;
+    store.setMemoryLimit(limit);
+    CHECK(store.firstFrame() > 0 && store.firstFrame() % KEYFRAME_INTERVAL == 0, "The memory limit did not drop whole blocks");
+    CHECK(store.bytes() <= limit && !store.get(0, out), "The store is over the memory limit");
+    for(int f = store.firstFrame(); f < steps; ++f)
+        CHECK(store.get(f, out) && sameFrame(out, inOrder[f]), frameMsg("After the memory limit a different frame", f));
+
+    // an agent removed starts a new block
+    store.setMemoryLimit(FRAME_STORE_DEFAULT_BYTES);
+    Frame fewer(recorded[0].begin(), recorded[0].end() - 1);
+    store.push(fewer);
+    checkFrame(store, steps, fewer, out);
+    CHECK(store.get(steps - 1, out) && sameFrame(out, inOrder[steps - 1]), "The frame before an agent was removed changed");
+}
+
+void benchFrameStore()
+{
+    const int steps = 4 * KEYFRAME_INTERVAL;
+    const vector<Frame> recorded = recordCrowd(1000, steps);
+    FrameStore store;
+    const double pushMs = bestMs(1, [&]{ for(const auto& frame: recorded) store.push(frame); });
+    Frame out;
+    const double inOrderMs = bestMs(3, [&]{ for(int f = 0; f < steps; ++f) store.get(f, out); g_benchSink += out[0].pos.x; });
+    // every read decodes from the keyframe of its block
+    const double reverseMs = bestMs(3, [&]{ for(int f = steps - 1; f >= 0; --f) store.get(f, out); g_benchSink += out[0].pos.x; });
+    const size_t agents = recorded[0].size();
+    cout << agents << " agents " << steps << " frames: " << store.bytes() / steps << " bytes per frame, "
+         << agents * sizeof(FrameStore::AgentState) << " unquantized. push " << pushMs / steps << " ms, read in order "
+         << inOrderMs / steps << " ms, read in reverse " << reverseMs / steps << " ms per frame" << endl;
+}
@@ -0,0 +1,128 @@
+// the uniform grid broadphase finds the same agent neighbors as the kd-tree, and what building and querying
+// each of them costs by agent count and density
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <algorithm>
+
+// count agents of radius 3 to 10 spread at random, about spacing apart, all going to the middle
+static string spreadScene(int count, float spacing, unsigned int seed)
+{
+    minstd_rand rng(seed);
+    const float half = std::sqrt((float)count) * spacing * 0.5f;
+    uniform_real_distribution<float> pos(-half, half), radius(3.0f, 10.0f);
+    stringstream ss;
+    const float wall = half + 50.0f;
+    ss << "p,v," << -wall << "," << -wall << ",v," << -wall << "," << wall << ",v," << wall << "," << wall << ",v," << wall << "," << -wall << ",\n";
+    ss << "g,0,0,20,0,\n";
+    for(int i = 0; i < count; ++i)
+        ss << "a," << pos(rng) << "," << pos(rng) << ",0,0,0," << radius(rng) << ",1,\n";
+    return ss.str();
+}
+
+// the neighbors of every agent, in order, up to limit of them
+static void allNeighbors(Document& doc, const RVO::AgentBroadphase& bp, int limit, vector<vector<pair<float, int>>>& out)
+{
+    out.resize(doc.m_agents.size());
+    for(size_t i = 0; i < doc.m_agents.size(); ++i) {
+        RVO::Agent* agent = doc.m_agents[i];
+        agent->agentNeighbors_.clear();
+        agent->neighborLimit_ = (size_t)limit;
+        float rangeSq = sqr(agent->neighborDist_);
+        bp.computeAgentNeighbors(agent, rangeSq);
+        out[i] = agent->agentNeighbors_;
+    }
+}
+
+static void compareBroadphases(const string& scene, float cellSize, const char* what)
+{
+    Document doc;
+    loadCheckScene(doc, scene);
+    RVO::RVOSimulator& sim = doc.m_sim;
+    sim.prepareStep(); // fills the store
+    sim.kdTree_.buildAgents();
+    sim.agentGrid_.setCellSize(cellSize);
+    sim.agentGrid_.buildAgents();
+
+    // all the agents in range, and the nearest ones when the limit shrinks the range
+    vector<vector<pair<float, int>>> tree, grid;
+    int found = 0;
+    for(int limit: { 1000000, 10, 1 }) {
+        allNeighbors(doc, sim.kdTree_, limit, tree);
+        allNeighbors(doc, sim.agentGrid_, limit, grid);
+        for(size_t i = 0; i < tree.size(); ++i) {
+            if (tree[i] != grid[i]) {
+                stringstream ss;
+                ss << what << ": the grid found " << grid[i].size() << " neighbors of agent " << i << " with limit " << limit
+                   << ", the kd-tree " << tree[i].size() << " or others";
+                throw Exception(ss.str());
+            }
+            found += (int)tree[i].size();
+        }
+    }
+    CHECK(found > 0, string(what) + ": no agent has neighbors");
+
+    // the candidates of the Verlet lists, which are in the order of the broadphase
+    vector<int> treeCand, gridCand;
+    for(size_t i = 0; i < doc.m_agents.size(); ++i) {
+        const RVO::Agent* agent = doc.m_agents[i];
+        const float rangeSq = sqr(agent->neighborDist_ * 1.5f);
+        treeCand.clear();
+        gridCand.clear();
+        sim.kdTree_.computeAgentCandidates(agent->m_position, (int)i, rangeSq, treeCand);
+        sim.agentGrid_.computeAgentCandidates(agent->m_position, (int)i, rangeSq, gridCand);
+        sort(treeCand.begin(), treeCand.end());
+        sort(gridCand.begin(), gridCand.end());
+        CHECK(treeCand == gridCand, checkMsg((string(what) + ": the candidates of agent").c_str(), (float)gridCand.size(), (float)treeCand.size()));
+    }
+}
+
+void checkAgentGrid()
+{
+    // dense and sparse crowds, with the automatic cell size and cells smaller and much larger than the range
+    for(float spacing: { 8.0f, 25.0f, 120.0f }) {
+        const string scene = spreadScene(600, spacing, (unsigned int)spacing);
+        for(float cellSize: { 0.0f, 7.0f, 300.0f }) {
+            stringstream ss;
+            ss << "spacing " << spacing << ", cell size " << cellSize;
+            compareBroadphases(scene, cellSize, ss.str().c_str());
+        }
+    }
+    // a long thin crowd makes the grid grow its cells to stay under the cell limit
+    stringstream ss;
+    ss << "p,v,-2600,-100,v,-2600,100,v,2600,100,v,2600,-100,\ng,0,0,20,0,\n";
+    for(int i = 0; i < 300; ++i)
+        ss << "a," << -2400 + i * 8 << "," << (i % 7) * 2 - 6 << ",0,0,0,5,1,\n";
+    compareBroadphases(ss.str(), 0.0f, "a line of agents");
+}
+
+void benchAgentGrid()
+{
+    cout << "agents spacing: kd-tree build, query per agent / grid build, query per agent" << endl;
+    for(int count: { 1000, 4000, 16000 }) {
+        for(float spacing: { 8.0f, 25.0f, 100.0f }) {
+            Document doc;
+            loadCheckScene(doc, spreadScene(count, spacing, 30));
+            RVO::RVOSimulator& sim = doc.m_sim;
+            sim.prepareStep();
+            const RVO::AgentBroadphase* bps[] = { &sim.kdTree_, &sim.agentGrid_ };
+            cout << count << " " << spacing << ":";
+            for(const RVO::AgentBroadphase* cbp: bps) {
+                RVO::AgentBroadphase* bp = const_cast<RVO::AgentBroadphase*>(cbp);
+                const double buildMs = bestMs(5, [&]{ bp->buildAgents(); });
+                const double queryMs = bestMs(3, [&]{
+                    for(auto* agent: doc.m_agents) {
+                        agent->agentNeighbors_.clear();
+                        agent->neighborLimit_ = (size_t)agent->maxNeighbors_;
+                        float rangeSq = sqr(agent->neighborDist_);
+                        bp->computeAgentNeighbors(agent, rangeSq);
+                        g_benchSink += (float)agent->agentNeighbors_.size();
+                    }
+                });
+                cout << " " << buildMs << " ms, " << queryMs * 1e6 / count << " ns" << (bp == &sim.kdTree_ ? " /" : "");
+            }
+            cout << endl;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+// groups of agents sent to a goal together: an agent is in one group at most and only the leader is planned
+
+#include "Checks.h"
+#include "../Document.h"
+
+// the agents [begin, end) sent to the goal without a plan, as the page sends agents that are grouped
+static vector<RVO::AgentHandle> sendWithoutPlan(Document& doc, Goal* g, int begin, int end)
+{
+    vector<RVO::AgentHandle> sent;
+    for(int i = begin; i < end; ++i) {
+        RVO::Agent* a = doc.m_agents[i];
+        a->setEndGoal(g->def, g);
+        sent.push_back(a->handle_);
+    }
+    return sent;
+}
+
+// the crowd with rows of walls between it and the goals above and below, so that plans search the corridors
+static string wallsScene(int perSide)
+{
+    stringstream ss;
+    ss << crowdScene(perSide);
+    for(int y: { -300, 300 })
+        for(int x = -550; x < 550; x += 100)
+            ss << "p,v," << x << "," << y - 10 << ",v," << x + 60 << "," << y - 10 << ",v," << x + 60 << "," << y + 10 << ",v," << x << "," << y + 10 << ",\n";
+    return ss.str();
+}
+
+static int groupsOf(const Document& doc, const RVO::AgentHandle& h)
+{
+    int count = 0;
+    for(const auto& g: doc.m_groups)
+        count += (g.leader == h) + (int)std::count(g.followers.begin(), g.followers.end(), h);
+    return count;
+}
+
+void checkGroups()
+{
+    Document doc;
+    loadCheckScene(doc, wallsScene(30));
+    Goal* up = doc.addGoal(Vec2(0.0f, 500.0f), 20.0f, GOAL_POINT);
+    Goal* down = doc.addGoal(Vec2(0.0f, -500.0f), 20.0f, GOAL_POINT);
+
+    vector<unsigned long long> serials;
+    for(const auto* a: doc.m_agents)
+        serials.push_back(a->m_plan.m_serial);
+    vector<RVO::AgentHandle> first = sendWithoutPlan(doc, up, 0, 10);
+    doc.addGroup(first);
+    CHECK(doc.m_groups.size() == 1 && doc.m_groups[0].followers.size() == 9, "The ten agents were not grouped");
+    for(int i = 0; i < 10; ++i) {
+        const RVO::Agent* a = doc.m_agents[i];
+        const bool planned = a->m_plan.m_serial != serials[i];
+        CHECK(planned == (a->handle_ == doc.m_groups[0].leader), "addGroup planned another agent than the leader");
+    }
+
+    // half of the first group and its leader go elsewhere with five more
+    const RVO::AgentHandle firstLeader = doc.m_groups[0].leader;
+    const int leaderIndex = doc.m_sim.getAgent(firstLeader)->id_;
+    vector<RVO::AgentHandle> second = sendWithoutPlan(doc, down, 5, 15);
+    if (leaderIndex < 5)
+        second.push_back(sendWithoutPlan(doc, down, leaderIndex, leaderIndex + 1)[0]);
+    doc.addGroup(second);
+    CHECK(doc.m_groups.size() == 2, "The first group should stay with the agents that were not sent again");
+    for(const auto* a: doc.m_agents)
+        CHECK(groupsOf(doc, a->handle_) <= 1, "An agent is in two groups");
+    const AgentGroup& rest = doc.m_groups[0];
+    CHECK(rest.leader != firstLeader, "The first group kept a leader that was sent to another goal");
+    const RVO::Agent* newLeader = doc.m_sim.getAgent(rest.leader);
+    CHECK(newLeader->m_endGoalId == up && !newLeader->m_following && newLeader->m_curGoalPos != nullptr, "The new leader of the first group has no plan of its own");
+
+    for(int i = 0; i < 300; ++i)
+        doc.doStep(FIXED_STEP_TIME, true, i);
+    for(const auto& g: doc.m_groups)
+        for(const auto& h: g.followers)
+            CHECK(doc.m_sim.getAgent(h)->m_endGoalId == doc.m_sim.getAgent(g.leader)->m_endGoalId, "A follower goes to another goal than its leader");
+}
+
+void benchGroups()
+{
+    Document doc;
+    loadCheckScene(doc, wallsScene(200));
+    const int count = (int)doc.m_agents.size() / 2;
+    Goal* up = doc.addGoal(Vec2(0.0f, 500.0f), 20.0f, GOAL_POINT);
+    Goal* down = doc.addGoal(Vec2(0.0f, -500.0f), 20.0f, GOAL_POINT);
+
+    // the page used to plan every agent it sent before grouping them
+    int sends = 0;
+    const double planAllMs = bestMs(5, [&]{
+        Goal* g = (++sends & 1) ? up : down;
+        vector<RVO::AgentHandle> sent = sendWithoutPlan(doc, g, 0, count);
+        for(int i = 0; i < count; ++i)
+            doc.updatePlan(doc.m_agents[i]);
+        doc.addGroup(sent);
+    });
+    const double leaderMs = bestMs(5, [&]{
+        Goal* g = (++sends & 1) ? up : down;
+        doc.addGroup(sendWithoutPlan(doc, g, 0, count));
+    });
+    cout << "sending " << count << " agents in formation: planning all " << planAllMs << " ms, leader only " << leaderMs << " ms, "
+         << planAllMs / leaderMs << "x" << endl;
+}
@@ -0,0 +1,119 @@
+// the triangles the page has after the uploads of MeshMirror against the mesh of the document
+
+#include "Checks.h"
+#include "../Document.h"
+#include "../js/MeshMirror.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+
+// what take_mesh in page.html does with the arrays of the mirror
+struct PageMesh
+{
+    vector<float> vtx;
+    vector<int> slots;
+
+    void take(const MeshMirror& mm, bool all) {
+        vtx.resize(mm.m_firstNewVtx * 2); // keeps what was sent before
+        vtx.insert(vtx.end(), mm.m_vtx.begin() + mm.m_firstNewVtx * 2, mm.m_vtx.end());
+        if (all) {
+            slots = mm.m_slots;
+            return;
+        }
+        slots.resize(mm.m_slots.size());
+        for(int c: mm.m_changed)
+            copy(mm.m_slots.begin() + c * 3, mm.m_slots.begin() + c * 3 + 3, slots.begin() + c * 3);
+    }
+};
+
+// x,y of the 3 corners, rotated so that the smallest is first
+typedef array<float, 6> TriCoords;
+
+static TriCoords triCoords(const Vec2& a, const Vec2& b, const Vec2& c)
+{
+    array<pair<float, float>, 3> v = { { make_pair(a.x, a.y), make_pair(b.x, b.y), make_pair(c.x, c.y) } };
+    rotate(v.begin(), min_element(v.begin(), v.end()), v.end());
+    TriCoords t = { { v[0].first, v[0].second, v[1].first, v[1].second, v[2].first, v[2].second } };
+    return t;
+}
+
+static vector<TriCoords> meshTriangles(const Mesh& mesh)
+{
+    vector<TriCoords> tris;
+    for(const auto& tri: mesh.m_tri)
+        tris.push_back(triCoords(tri.v[0]->p, tri.v[1]->p, tri.v[2]->p));
+    sort(tris.begin(), tris.end());
+    return tris;
+}
+
+static vector<TriCoords> pageTriangles(const PageMesh& page)
+{
+    vector<TriCoords> tris;
+    for(size_t i = 0; i < page.slots.size(); i += 3) {
+        if (page.slots[i] < 0)
+            continue;
+        const int* s = &page.slots[i];
+        tris.push_back(triCoords(Vec2(page.vtx[s[0] * 2], page.vtx[s[0] * 2 + 1]), Vec2(page.vtx[s[1] * 2], page.vtx[s[1] * 2 + 1]),
+                                 Vec2(page.vtx[s[2] * 2], page.vtx[s[2] * 2 + 1])));
+    }
+    sort(tris.begin(), tris.end());
+    return tris;
+}
+
+// loads the scene, updates the mirror and the page with it. false if the page was sent all the slots
+static bool uploadScene(const string& scene, MeshMirror& mm, PageMesh& page, const char* what)
+{
+    Document doc;
+    loadCheckScene(doc, scene);
+    const bool diff = mm.update(doc.m_mesh);
+    page.take(mm, !diff);
+    stringstream ss;
+    ss << "after " << what << " the page has " << pageTriangles(page).size() << " triangles that are not the "
+       << doc.m_mesh.m_tri.size() << " of the mesh";
+    CHECK(pageTriangles(page) == meshTriangles(doc.m_mesh), ss.str());
+    return diff;
+}
+
+void checkMeshMirror()
+{
+    MeshMirror mm;
+    PageMesh page;
+    CHECK(!uploadScene(boxScene(45, -1), mm, page, "the first upload"), "The first upload was not of all the slots");
+
+    // one box away and back, only the region around it is sent
+    for(int missing: { 0, 1012, 2024 }) {
+        for(int back = 0; back < 2; ++back) {
+            const int sentVtx = (int)mm.m_vtx.size() / 2;
+            const bool diff = uploadScene(boxScene(45, back ? -1 : missing), mm, page, back ? "putting a box back" : "removing a box");
+            CHECK(diff, "The upload after a box changed was of all the slots");
+            stringstream ss;
+            ss << "A change of one box sent " << mm.m_changed.size() << " slots and " << mm.m_vtx.size() / 2 - sentVtx << " vertices";
+            CHECK(mm.m_changed.size() < 100 && mm.m_vtx.size() / 2 - sentVtx < 20, ss.str());
+        }
+    }
+
+    // a small map after the big one compacts the vertices with a full upload
+    CHECK(!uploadScene(boxScene(2, -1), mm, page, "a small map"), "The small map did not compact the mirror");
+    CHECK(mm.m_vtx.size() < 100, "The small map kept the vertices of the big one");
+    uploadScene(boxScene(45, -1), mm, page, "the big map again");
+
+    // readDoc and a failed triangulation leave the page with no triangles
+    mm.clear();
+    page.take(mm, true);
+    CHECK(page.slots.empty() && page.vtx.empty(), "The page has triangles after clear");
+    CHECK(!uploadScene(boxScene(3, 4), mm, page, "a map after clear"), "The upload after clear was not of all the slots");
+}
+
+void benchMeshMirror()
+{
+    Document full, missing;
+    loadCheckScene(full, boxScene(45, -1));
+    loadCheckScene(missing, boxScene(45, 1012));
+    MeshMirror mm;
+    const double firstMs = bestMs(5, [&]{ mm.clear(); mm.update(full.m_mesh); });
+    const double editMs = bestMs(5, [&]{ mm.update(missing.m_mesh); mm.update(full.m_mesh); }) / 2;
+    mm.update(missing.m_mesh);
+    cout << "mesh mirror of " << full.m_mesh.m_tri.size() << " triangles: first upload " << firstMs << " ms, a box changed "
+         << editMs << " ms and " << mm.m_changed.size() << " slots" << endl;
+}
@@ -0,0 +1,108 @@
+// mtrig against std within the errors its comments state, and its array functions against its scalar ones
+
+#include "Checks.h"
+#include "../Vec2.h"
+#include "../mtrig.h"
+#include <cfloat>
+#include <cstring>
+
+#define MTRIG_SAMPLES 100003 // not a multiple of 4, the end takes the scalar path
+
+static void checkMaxError(const char* what, double err, double bound)
+{
+    stringstream ss;
+    ss << what << " error " << err << " is more than " << bound;
+    CHECK(err <= bound, ss.str());
+}
+
+static void checkSameArray(const char* what, const vector<float>& a, const vector<float>& b)
+{
+    for(size_t i = 0; i < a.size(); ++i) {
+        // both NaN or the same bits, -0 is not 0
+        const bool same = (a[i] != a[i] && b[i] != b[i]) || memcmp(&a[i], &b[i], sizeof(float)) == 0;
+        CHECK(same, checkMsg(what, a[i], b[i]));
+    }
+}
+
+void checkMtrig()
+{
+    // within the rounding to float, the values next to 0 are only noise of the double sin
+    double tableErr = 0.0;
+    for(int i = 0; i < MAX_CIRCLE_ANGLE; ++i)
+        tableErr = max(tableErr, std::abs(mtrig::CosSinTable::values[i] - std::sin((double)i * M_PI / HALF_MAX_CIRCLE_ANGLE)));
+    checkMaxError("sin table", tableErr, 0.5 * FLT_EPSILON);
+
+    minstd_rand rng(48);
+    uniform_real_distribution<float> angle(-4.0f * PI, 4.0f * PI), unit(-1.0f, 1.0f), exponent(-6.0f, 6.0f);
+    vector<float> a(MTRIG_SAMPLES), y(MTRIG_SAMPLES), x(MTRIG_SAMPLES), u(MTRIG_SAMPLES);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i) {
+        a[i] = angle(rng);
+        // directions of all lengths, on the axes and at the origin too
+        const float len = std::pow(10.0f, exponent(rng));
+        y[i] = (i % 97 == 0) ? 0.0f : unit(rng) * len;
+        x[i] = (i % 89 == 0) ? 0.0f : unit(rng) * len;
+        u[i] = unit(rng);
+    }
+    a[0] = 0.0f; a[1] = -0.0f; a[2] = PI; a[3] = -PI;
+    u[0] = 1.0f; u[1] = -1.0f; u[2] = 0.0f;
+
+    // the table steps are 2pi/MAX_CIRCLE_ANGLE, the slope of sin is at most 1
+    const double step = 2.0 * M_PI / MAX_CIRCLE_ANGLE;
+    double sinErr = 0.0, cosErr = 0.0, atanErr = 0.0, asinErr = 0.0;
+    for(int i = 0; i < MTRIG_SAMPLES; ++i) {
+        sinErr = max(sinErr, std::abs(mtrig::sin(a[i]) - std::sin((double)a[i])));
+        cosErr = max(cosErr, std::abs(mtrig::cos(a[i]) - std::cos((double)a[i])));
+        if (x[i] != 0.0f || y[i] != 0.0f)
+            atanErr = max(atanErr, std::abs(mtrig::atan2(y[i], x[i]) - std::atan2((double)y[i], (double)x[i])));
+        asinErr = max(asinErr, std::abs(mtrig::asin(u[i]) - std::asin((double)u[i])));
+    }
+    CHECK(mtrig::atan2(0.0f, 0.0f) == 0.0f, "atan2 at the origin is not 0");
+    checkMaxError("sin", sinErr, step);
+    checkMaxError("cos", cosErr, step);
+    checkMaxError("atan2", atanErr, 4e-6);
+    checkMaxError("asin", asinErr, 7e-5);
+
+    vector<float> arr(MTRIG_SAMPLES), one(MTRIG_SAMPLES);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i)
+        one[i] = mtrig::sin(a[i]);
+    mtrig::sin(a.data(), arr.data(), MTRIG_SAMPLES);
+    checkSameArray("sin of an array", arr, one);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i)
+        one[i] = mtrig::cos(a[i]);
+    mtrig::cos(a.data(), arr.data(), MTRIG_SAMPLES);
+    checkSameArray("cos of an array", arr, one);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i)
+        one[i] = mtrig::atan2(y[i], x[i]);
+    mtrig::atan2(y.data(), x.data(), arr.data(), MTRIG_SAMPLES);
+    checkSameArray("atan2 of an array", arr, one);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i)
+        one[i] = mtrig::asin(u[i]);
+    mtrig::asin(u.data(), arr.data(), MTRIG_SAMPLES);
+    checkSameArray("asin of an array", arr, one);
+}
+
+void benchMtrig()
+{
+    minstd_rand rng(48);
+    uniform_real_distribution<float> angle(-PI, PI), unit(-1.0f, 1.0f);
+    vector<float> a(MTRIG_SAMPLES), y(MTRIG_SAMPLES), x(MTRIG_SAMPLES), out(MTRIG_SAMPLES);
+    for(int i = 0; i < MTRIG_SAMPLES; ++i) {
+        a[i] = angle(rng);
+        y[i] = unit(rng);
+        x[i] = unit(rng);
+    }
+    const double count = MTRIG_SAMPLES;
+    auto report = [&](const char* what, double arrayMs, double scalarMs, double stdMs) {
+        cout << what << " array " << arrayMs * 1e6 / count << " ns, scalar " << scalarMs * 1e6 / count << " ns, std "
+             << stdMs * 1e6 / count << " ns" << endl;
+    };
+    report("sin", bestMs(5, [&]{ mtrig::sin(a.data(), out.data(), MTRIG_SAMPLES); g_benchSink += out[7]; }),
+                  bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = mtrig::sin(a[i]); g_benchSink += out[7]; }),
+                  bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = std::sin(a[i]); g_benchSink += out[7]; }));
+    report("atan2", bestMs(5, [&]{ mtrig::atan2(y.data(), x.data(), out.data(), MTRIG_SAMPLES); g_benchSink += out[7]; }),
+                    bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = mtrig::atan2(y[i], x[i]); g_benchSink += out[7]; }),
+                    bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = std::atan2(y[i], x[i]); g_benchSink += out[7]; }));
+    report("asin", bestMs(5, [&]{ mtrig::asin(y.data(), out.data(), MTRIG_SAMPLES); g_benchSink += out[7]; }),
+                   bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = mtrig::asin(y[i]); g_benchSink += out[7]; }),
+                   bestMs(5, [&]{ for(int i = 0; i < MTRIG_SAMPLES; ++i) out[i] = std::asin(y[i]); g_benchSink += out[7]; }));
+}
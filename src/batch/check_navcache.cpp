@@ -0,0 +1,96 @@
+// the nav cache evicts the least recently used builds to stay in its entry and byte limits, a key that comes with
+// the definition of another map is a miss, and a triangulation saved to disk loads back the same
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <cstdio>
+
+// an empty build whose size grows with vertices
+static NavBuild* sizedBuild(size_t vertices)
+{
+    NavBuild* b = new NavBuild;
+    b->mesh.m_vtx.reserve(vertices);
+    return b;
+}
+
+// takes the entry and puts it back, it is the most recently used then
+static bool touch(NavCache& cache, NavCache::TKey key, const string& definition)
+{
+    NavBuild* b = cache.take(key, definition);
+    if (b == nullptr)
+        return false;
+    cache.put(key, definition, b);
+    return true;
+}
+
+static bool sameTri(const Mesh& a, const Mesh& b)
+{
+    if (a.m_vtx.size() != b.m_vtx.size() || a.m_tri.size() != b.m_tri.size())
+        return false;
+    for(size_t i = 0; i < a.m_vtx.size(); ++i)
+        if (a.m_vtx[i].p.x != b.m_vtx[i].p.x || a.m_vtx[i].p.y != b.m_vtx[i].p.y)
+            return false;
+    for(size_t i = 0; i < a.m_tri.size(); ++i)
+        for(int j = 0; j < 3; ++j)
+            if (a.m_tri[i].v[j]->index != b.m_tri[i].v[j]->index)
+                return false;
+    return true;
+}
+
+void checkNavCache()
+{
+    // entry limit
+    NavCache cache;
+    cache.setLimits(2, (size_t)1 << 30);
+    cache.put(1, "a", sizedBuild(10));
+    cache.put(2, "b", sizedBuild(10));
+    CHECK(touch(cache, 1, "a"), "The first build is not in the cache");
+    cache.put(3, "c", sizedBuild(10));
+    CHECK(cache.entries() == 2 && cache.m_stats.evictions == 1, checkMsg("Entries over the limit of 2", (float)cache.entries(), 2.0f));
+    CHECK(!touch(cache, 2, "b"), "The least recently used build was not the one evicted");
+    CHECK(touch(cache, 1, "a") && touch(cache, 3, "c"), "A recently used build was evicted");
+
+    // the same key with another map
+    const int misses = cache.m_stats.misses;
+    CHECK(cache.take(1, "x") == nullptr, "A build of another map with the same key was taken");
+    CHECK(cache.m_stats.keyCollisions == 1 && cache.m_stats.misses == misses + 1, "The key collision was not counted as a miss");
+    CHECK(touch(cache, 1, "a"), "The build was dropped by a key collision");
+
+    // byte limit
+    NavCache bytesCache;
+    NavBuild* probe = sizedBuild(1000);
+    const size_t sz = probe->byteSize();
+    delete probe;
+    bytesCache.setLimits(100, sz * 2 + sz / 2);
+    for(NavCache::TKey key = 1; key <= 3; ++key)
+        bytesCache.put(key, "", sizedBuild(1000));
+    CHECK(bytesCache.entries() == 2 && bytesCache.bytes() == sz * 2, checkMsg("Builds over the byte limit", (float)bytesCache.entries(), 2.0f));
+    CHECK(!touch(bytesCache, 1, "") && touch(bytesCache, 2, ""), "The byte limit did not evict the least recently used build");
+    bytesCache.setLimits(100, sz);
+    CHECK(bytesCache.entries() == 1 && touch(bytesCache, 2, ""), "Lowering the byte limit did not keep the most recently used build");
+
+    // disk round trip of a triangulation
+    Document doc;
+    loadCheckScene(doc, SCENE_TRI_IN_SQUARE);
+    CHECK(!doc.m_mesh.m_tri.empty(), "The scene has no triangles");
+    const NavCache::TKey key = doc.m_navKey;
+    const string& definition = doc.m_navDefinition;
+    CHECK(NavCache::keyOf(NavCache::definitionOf(doc.m_mapdef)) == key, "The key is not the one of the map definition");
+    NavCache disk;
+    disk.setDiskDir(".");
+    disk.saveTri(key, definition, doc.m_mesh);
+    Mesh loaded;
+    CHECK(disk.loadTri(key, definition, loaded) && disk.m_stats.diskHits == 1, "The saved triangulation did not load");
+    CHECK(sameTri(loaded, doc.m_mesh), "The loaded triangulation is not the saved one");
+    string other = definition;
+    other[other.size() / 2] ^= 1;
+    Mesh wrong;
+    CHECK(!disk.loadTri(key, other, wrong), "A triangulation of another map with the same key was loaded");
+    CHECK(!disk.loadTri(key, definition + "x", wrong), "A triangulation of a longer map definition was loaded");
+    CHECK(disk.m_stats.keyCollisions == 2, checkMsg("Key collisions on disk", (float)disk.m_stats.keyCollisions, 2.0f));
+
+    char path[32];
+    snprintf(path, sizeof(path), "./%016llx.tri", (unsigned long long)key);
+    remove(path);
+}
@@ -0,0 +1,163 @@
+// the obstacle neighbors from the lists of the grid cells against the obstacle tree, and the tree built from
+// a sample of the splitters against one that tries all of them
+
+#include "Checks.h"
+#include "../Document.h"
+
+// a square with rows of small square pillars, the agent is somewhere between them
+static string pillarScene()
+{
+    stringstream ss;
+    ss << "p,v,-600,-600,v,-600,600,v,600,600,v,600,-600,\n";
+    for(int y = -500; y <= 500; y += 100)
+        for(int x = -500; x <= 500; x += 100) {
+            const int s = 10 + ((x + y) / 100 & 3) * 5; // pillars of different sizes
+            ss << "p,v," << x - s << "," << y - s << ",v," << x + s << "," << y - s << ",v," << x + s << "," << y + s << ",v," << x - s << "," << y + s << ",\n";
+        }
+    ss << "g,550,550,20,0,\n";
+    ss << "a,-550,-550,0,0,0,10,3,\n";
+    return ss.str();
+}
+
+static bool sameNeighbors(const RVO::AgentScratch& a, const RVO::AgentScratch& b)
+{
+    return a.obstacleNeighbors == b.obstacleNeighbors;
+}
+
+void checkObstacleLists()
+{
+    Document doc;
+    loadCheckScene(doc, pillarScene());
+    RVO::Agent* agent = doc.m_agents[0];
+    const RVO::KdTree& tree = doc.m_sim.kdTree_;
+    const float range = agent->obstacleRange();
+    CHECK(tree.obstacleListRange() >= range, "The obstacle lists were not built for the range of the agent");
+
+    minstd_rand rng(37);
+    // a little outside of the square too, where the lists have no cells
+    uniform_real_distribution<float> pos(-700.0f, 700.0f);
+    RVO::AgentScratch lists, query;
+    int found = 0;
+    for(int i = 0; i < 20000; ++i) {
+        agent->m_position = Vec2(pos(rng), pos(rng));
+        // the range of the agent, a smaller one that scans a prefix of the cell and a larger one that takes the tree
+        for(float scale: { 1.0f, 0.5f, 2.0f }) {
+            const float rangeSq = sqr(range * scale);
+            lists.obstacleNeighbors.clear();
+            query.obstacleNeighbors.clear();
+            tree.computeObstacleNeighbors(agent, rangeSq, lists);
+            tree.queryObstacleTree(agent, rangeSq, query);
+            if (!sameNeighbors(lists, query)) {
+                stringstream ss;
+                ss << "The obstacle lists found other neighbors than the tree at " << agent->m_position.x << "," << agent->m_position.y;
+                throw Exception(ss.str());
+            }
+            found += (int)query.obstacleNeighbors.size();
+        }
+    }
+    CHECK(found > 0, "No obstacle was in range of the random positions");
+}
+
+void benchObstacleLists()
+{
+    Document doc;
+    loadCheckScene(doc, pillarScene());
+    RVO::Agent* agent = doc.m_agents[0];
+    const RVO::KdTree& tree = doc.m_sim.kdTree_;
+    const float rangeSq = sqr(agent->obstacleRange());
+
+    minstd_rand rng(37);
+    uniform_real_distribution<float> pos(-600.0f, 600.0f);
+    vector<Vec2> positions;
+    for(int i = 0; i < 100000; ++i)
+        positions.push_back(Vec2(pos(rng), pos(rng)));
+    RVO::AgentScratch scratch;
+    scratch.obstacleNeighbors.reserve(doc.m_sim.obstacles_.size());
+
+    const double listsMs = bestMs(5, [&]{
+        for(const auto& p: positions) {
+            agent->m_position = p;
+            scratch.obstacleNeighbors.clear();
+            tree.computeObstacleNeighbors(agent, rangeSq, scratch);
+            g_benchSink += (float)scratch.obstacleNeighbors.size();
+        }
+    });
+    const double treeMs = bestMs(5, [&]{
+        for(const auto& p: positions) {
+            agent->m_position = p;
+            scratch.obstacleNeighbors.clear();
+            tree.queryObstacleTree(agent, rangeSq, scratch);
+            g_benchSink += (float)scratch.obstacleNeighbors.size();
+        }
+    });
+    const double count = (double)positions.size();
+    cout << doc.m_sim.obstacles_.size() << " obstacle edges, " << tree.obstacleTree_.lists.entries.size() << " list entries\n";
+    cout << "cell lists " << listsMs * 1e6 / count << " ns/agent, tree " << treeMs * 1e6 / count << " ns/agent, "
+         << treeMs / listsMs << "x" << endl;
+}
+
+// count boxes of sides 5 to 20 at random in a square that has room for them
+static void addRandomBoxes(RVO::RVOSimulator& sim, int count)
+{
+    minstd_rand rng(31);
+    const float half = std::sqrt((float)count) * 30.0f;
+    uniform_real_distribution<float> pos(-half, half), side(5.0f, 20.0f);
+    vector<Vec2> box(4);
+    for(int i = 0; i < count; ++i) {
+        const Vec2 p(pos(rng), pos(rng));
+        const float w = side(rng), h = side(rng);
+        box[0] = p;
+        box[1] = p + Vec2(w, 0);
+        box[2] = p + Vec2(w, h);
+        box[3] = p + Vec2(0, h);
+        sim.addObstacle(box);
+    }
+}
+
+// the obstacle tree with a sample of the splitters of large nodes against trying all of them: build time, and
+// what the tree costs to query for agents of range 3 between the boxes
+void benchObstacleSplits()
+{
+    Document doc;
+    loadCheckScene(doc, SCENE_TRI_IN_SQUARE);
+    RVO::Agent* agent = doc.m_agents[0]; // only its position is read
+    RVO::AgentScratch scratch;
+
+    cout << "edges: sampled build, nodes, depth, query / all splitters build, nodes, depth, query" << endl;
+    for(int boxes: { 250, 1000, 2500, 5000 }) {
+        cout << boxes * 4 << ":";
+        for(size_t candidates: { (size_t)RVO::KdTree::OBSTACLE_SPLIT_CANDIDATES, (size_t)0 }) {
+            // a tree splits the obstacles it is built from, every build is of a new simulator
+            double buildMs = 1e9;
+            unique_ptr<RVO::RVOSimulator> sim;
+            for(int rep = 0; rep < (candidates == 0 ? 1 : 5); ++rep) {
+                sim.reset(new RVO::RVOSimulator);
+                addRandomBoxes(*sim, boxes);
+                sim->kdTree_.setObstacleSplitCandidates(candidates);
+                auto start = chrono::steady_clock::now();
+                sim->kdTree_.buildObstacleTree();
+                buildMs = min(buildMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+            const RVO::KdTree& tree = sim->kdTree_;
+
+            minstd_rand rng(31);
+            const float half = std::sqrt((float)boxes) * 30.0f;
+            uniform_real_distribution<float> pos(-half, half);
+            vector<Vec2> positions;
+            for(int i = 0; i < 20000; ++i)
+                positions.push_back(Vec2(pos(rng), pos(rng)));
+            scratch.obstacleNeighbors.reserve(sim->obstacles_.size());
+            const double queryMs = bestMs(5, [&]{
+                for(const auto& p: positions) {
+                    agent->m_position = p;
+                    scratch.obstacleNeighbors.clear();
+                    tree.queryObstacleTree(agent, 9.0f, scratch);
+                    g_benchSink += (float)scratch.obstacleNeighbors.size();
+                }
+            });
+            cout << " " << buildMs << " ms, " << tree.obstacleTree_.nodes.size() << ", " << tree.obstacleTree_.depth << ", "
+                 << queryMs * 1e6 / positions.size() << " ns" << (candidates != 0 ? " /" : "");
+        }
+        cout << endl;
+    }
+}
@@ -0,0 +1,165 @@
+// the perimeter store of a mesh: its edges go around the perimeters with their offsets at the distance of the
+// sub-goals, the simulation has its obstacles, and a build restored from the cache is the same
+
+#include "Checks.h"
+#include "../Document.h"
+#include "../Goal.h"
+
+#include <sstream>
+
+// acute corners of triangles and of a star, the right angles of boxes and a vertex in the middle of an edge
+static string spikesScene()
+{
+    stringstream ss;
+    ss << "p,v,-400,-400,v,-400,400,v,400,400,v,400,-400,\n";
+    ss << "p,v,-250,-250,v,-150,-250,v,-200,-120,\n";
+    ss << "p,v,100,100,v,200,100,v,300,100,v,300,200,v,100,200,\n";
+    ss << "p,";
+    for(int i = 0; i < 10; ++i) {
+        const float a = i * (float)M_PI / 5.0f, r = (i % 2 == 0) ? 100.0f : 35.0f;
+        ss << "v," << -150.0f + std::cos(a) * r << "," << 200.0f + std::sin(a) * r << ",";
+    }
+    ss << "\n";
+    ss << "b,150,-250,200,-200,\nb,250,-250,300,-150,\n";
+    ss << "g,350,350,20,0,\n";
+    ss << "a,-350,-350,0,0,0,5,2,\n";
+    return ss.str();
+}
+
+// from the line through a and b, positive on its left
+static float sideDist(const Vec2& a, const Vec2& b, const Vec2& p)
+{
+    return det(normalize(b - a), p - a);
+}
+
+static void checkOffset(const char* what, int loop, int edge, float d)
+{
+    if (std::abs(d - 1.0f) > 1e-4f) {
+        stringstream ss;
+        ss << what << " of edge " << edge << " of perimeter " << loop << " is " << d << " from its line and not 1";
+        throw Exception(ss.str());
+    }
+}
+
+static bool sameEdges(const vector<PerimeterStore::Edge>& a, const vector<PerimeterStore::Edge>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); ++i)
+        if (!(a[i].a == b[i].a) || !(a[i].b == b[i].b) || !(a[i].dpa == b[i].dpa) || !(a[i].dpb == b[i].dpb))
+            return false;
+    return true;
+}
+
+static vector<Vec2> obstaclePoints(const Document& doc)
+{
+    vector<Vec2> points;
+    for(const auto* ob: doc.m_sim.obstacles_)
+        points.push_back(ob->point_);
+    return points;
+}
+
+void checkPerimeterStore()
+{
+    Document doc;
+    loadCheckScene(doc, spikesScene());
+    const PerimeterStore& ps = doc.m_perimeter;
+    const Mesh& mesh = doc.m_mesh;
+    CHECK(ps.m_loops.size() == mesh.m_perimiters.size(), checkMsg("Perimeter loops", (float)ps.m_loops.size(), (float)mesh.m_perimiters.size()));
+
+    vector<bool> onPerimeter(mesh.m_vtx.size(), false);
+    vector<Vec2> obstacles, loopPoints;
+    int numEdges = 0, corners = 0, straight = 0;
+    Plan plan;
+    plan.reserve(4);
+    for(size_t li = 0; li < ps.m_loops.size(); ++li) {
+        const PerimeterStore::Loop& loop = ps.m_loops[li];
+        const vector<Vertex*>& v = mesh.m_perimiters[li].m_d;
+        const int n = (int)v.size();
+        CHECK(loop.firstEdge == numEdges && loop.numEdges == n, checkMsg("The edges of perimeter", (float)li, (float)li));
+        CHECK(loop.isCW == mesh.m_perimiters[li].m_isCW, checkMsg("The direction of perimeter", (float)li, (float)li));
+        numEdges += n;
+        for(int k = 0; k < n; ++k) {
+            const PerimeterStore::Edge& e = ps.m_edges[loop.firstEdge + k];
+            const PerimeterStore::Edge& next = ps.m_edges[loop.firstEdge + (k + 1) % n];
+            CHECK(e.a == v[k]->p && e.b == next.a, checkMsg("An edge is not between the vertices of perimeter", (float)li, (float)li));
+            onPerimeter[v[k]->index] = true;
+
+            // the offsets at both ends of an edge keep the distance 1 from it on the same side, also the last edge of a loop
+            const float da = sideDist(e.a, e.b, e.a + e.dpa), db = sideDist(e.a, e.b, e.b + e.dpb);
+            checkOffset("The offset at the start", (int)li, k, std::abs(da));
+            checkOffset("The offset at the end", (int)li, k, std::abs(db));
+            CHECK((da > 0) == (db > 0), checkMsg("The offsets of an edge are on both sides of perimeter", (float)li, (float)li));
+            // the end offset is where the next edge takes over, on its offset line or past a sharp corner
+            if (dot(e.b - e.a, next.b - next.a) < 0)
+                checkOffset("The offset past the corner at the end", (int)li, k, dot(e.dpb, normalize(e.b - e.a)));
+            else
+                checkOffset("The offset on the next line", (int)li, k, (da > 0 ? 1.0f : -1.0f) * sideDist(next.a, next.b, e.b + e.dpb));
+
+            // a corner sharper than a right angle has a goal segment on each of its edges, another vertex one between them
+            const Vec2& prev = v[(k + n - 1) % n]->p;
+            const bool sharp = dot(e.a - prev, e.b - e.a) < 0;
+            plan.clear();
+            ps.makeSubGoal(v[k]->index, 1.0f, e.b, plan);
+            CHECK(plan.m_segs.size() == (sharp ? 2u : 1u), checkMsg("The goal segments of a vertex of perimeter", (float)plan.m_segs.size(), sharp ? 2.0f : 1.0f));
+            if (sharp) {
+                ++corners;
+                continue;
+            }
+            const Vec2 ref = ps.makePathRef(v[k]->index, 1.0f);
+            checkOffset("The path point at the start", (int)li, k, std::abs(sideDist(prev, e.a, ref)));
+            checkOffset("The path point at the end", (int)li, k, std::abs(sideDist(e.a, e.b, ref)));
+            straight += (det(e.a - prev, e.b - e.a) == 0.0f);
+        }
+        ps.obstacleVertices(loop, loopPoints);
+        for(int k = 0; k < n; ++k)
+            CHECK(loopPoints[k] == v[n - 1 - k]->p, checkMsg("The obstacle of perimeter is not in the reverse order", (float)li, (float)li));
+        obstacles.insert(obstacles.end(), loopPoints.begin(), loopPoints.end());
+    }
+    CHECK(numEdges == (int)ps.m_edges.size(), checkMsg("Edges that are in no perimeter", (float)ps.m_edges.size(), (float)numEdges));
+    CHECK(corners > 0 && straight > 0, "The scene has no sharp corner or no vertex in the middle of an edge");
+    for(size_t i = 0; i < mesh.m_vtx.size(); ++i)
+        CHECK(ps.hasVertex((int)i) == onPerimeter[i], checkMsg("hasVertex is wrong for vertex", (float)i, (float)i));
+
+    // the simulation adds the obstacles of the loops in order, the tree build appends the vertices it splits
+    const vector<Vec2> simPoints = obstaclePoints(doc);
+    CHECK(simPoints.size() >= obstacles.size() && equal(obstacles.begin(), obstacles.end(), simPoints.begin()),
+          "The simulation obstacles are not the ones of the perimeter loops");
+
+    // another map and back, the second time the build comes from the cache
+    const vector<PerimeterStore::Edge> edges = ps.m_edges;
+    loadCheckScene(doc, boxScene(3, -1));
+    CHECK(!sameEdges(ps.m_edges, edges), "Another map has the same perimeters");
+    const int hits = doc.m_navCache.m_stats.hits;
+    loadCheckScene(doc, spikesScene());
+    CHECK(doc.m_navCache.m_stats.hits == hits + 1, "The map loaded again did not come from the cache");
+    CHECK(sameEdges(ps.m_edges, edges), "The perimeters restored from the cache are not the ones built");
+    CHECK(obstaclePoints(doc) == simPoints, "The obstacles restored from the cache are not the ones built");
+}
+
+void benchPerimeterStore()
+{
+    Document doc;
+    loadCheckScene(doc, boxScene(2, -1));
+    MapDef other; // the small map, its build is in the cache once the big one is loaded
+    other.m_pl.swap(doc.m_mapdef.m_pl);
+    other.m_bx.swap(doc.m_mapdef.m_bx);
+    loadCheckScene(doc, boxScene(45, -1));
+
+    PerimeterStore store;
+    const double buildMs = bestMs(5, [&]{ store.build(doc.m_mesh); g_benchSink += (float)store.m_edges.size(); store.clear(); });
+    store.build(doc.m_mesh);
+
+    // switching between the maps, each build goes to the cache and the other comes from it, or both are built again
+    auto switchMap = [&]{
+        doc.m_mapdef.m_pl.swap(other.m_pl);
+        doc.m_mapdef.m_bx.swap(other.m_bx);
+        doc.runTriangulate();
+    };
+    const double cachedMs = bestMs(5, [&]{ switchMap(); switchMap(); });
+    const double builtMs = bestMs(3, [&]{ doc.m_navCache.clear(); switchMap(); doc.m_navCache.clear(); switchMap(); });
+    CHECK(doc.m_navLive && doc.m_perimeter.m_edges.size() == store.m_edges.size(), "The big map is not live after switching");
+    cout << "2025 boxes, " << doc.m_mesh.m_vtx.size() << " vertices: PerimeterStore build and clear " << buildMs << " ms, "
+         << store.byteSize() << " bytes. switching to a small map and back " << cachedMs << " ms from the cache, "
+         << builtMs << " ms building both" << endl;
+}
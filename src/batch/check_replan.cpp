@@ -0,0 +1,109 @@
+// stuck agents are replanned at most m_replanBudget in a step and back off between replans, and what the budget costs
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <sstream>
+
+// perSide x perSide agents in the left room that go to the right one through a gap in the wall between them
+static string chokeScene(int perSide, int budget)
+{
+    stringstream ss;
+    ss << "p,v,-400,-400,v,-400,400,v,400,400,v,400,-400,\n";
+    ss << "p,v,-10,-400,v,-10,-20,v,10,-20,v,10,-400,\n";
+    ss << "p,v,-10,20,v,-10,400,v,10,400,v,10,20,\n";
+    ss << "g,300,0,40,0,\n";
+    for(int i = 0; i < perSide * perSide; ++i)
+        ss << "a," << -350 + (i % perSide) * 300.0f / perSide << "," << -150 + (i / perSide) * 300.0f / perSide << ",0,0,0,5,2,\n";
+    ss << "o,replan_budget," << budget << ",\n";
+    return ss.str();
+}
+
+struct ReplanRun {
+    int replans = 0;
+    int maxPerStep = 0;
+    int stuck = 0;
+    int reached = 0;
+    double ms = 0.0;
+};
+
+typedef pair<RVO::Event, int> Replan; // and the backoff of the agent after it
+
+// the replans of the steps, the plans that loading made are not counted
+static ReplanRun runChoke(int perSide, int budget, int steps, int numThreads, vector<Replan>* replans)
+{
+    Document doc;
+    doc.m_sim.setNumThreads(numThreads);
+    loadCheckScene(doc, chokeScene(perSide, budget));
+    CHECK(doc.m_replanBudget == budget, checkMsg("The scene option set the replan budget", (float)doc.m_replanBudget, (float)budget));
+    const unsigned int mask = RVO::eventBit(RVO::EVENT_REPLAN) | RVO::eventBit(RVO::EVENT_STUCK);
+    doc.m_sim.setEventMask(mask);
+    ReplanRun run;
+    vector<RVO::Event> events;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < steps; ++i) {
+        doc.doStep(FIXED_STEP_TIME, true, i);
+        events.clear();
+        doc.m_sim.drainEvents(mask, events);
+        int perStep = 0;
+        for(const auto& e: events) {
+            run.stuck += (e.type == RVO::EVENT_STUCK);
+            if (e.type == RVO::EVENT_REPLAN) {
+                ++perStep;
+                if (replans != nullptr)
+                    replans->push_back(Replan(e, doc.m_sim.getAgent(e.agent)->m_replanBackoff));
+            }
+        }
+        run.replans += perStep;
+        run.maxPerStep = max(run.maxPerStep, perStep);
+    }
+    run.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    for(const auto* a: doc.m_agents)
+        run.reached += a->m_reached;
+    return run;
+}
+
+void checkReplanBudget()
+{
+    const int steps = 1500;
+    // with no budget the agents get stuck and are not replanned
+    const ReplanRun none = runChoke(20, 0, steps, 1, nullptr);
+    CHECK(none.stuck > 0, "No agent got stuck at the gap");
+    CHECK(none.replans == 0, checkMsg("Agents were replanned with a budget of 0, replans", (float)none.replans, 0.0f));
+
+    for(int budget: { 1, 4 }) {
+        vector<Replan> replans;
+        const ReplanRun run = runChoke(20, budget, steps, 4, &replans);
+        CHECK(run.replans > 0, checkMsg("No agent was replanned with a budget of", (float)budget, (float)budget));
+        CHECK(run.maxPerStep <= budget, checkMsg("More replans in a step than the budget", (float)run.maxPerStep, (float)budget));
+        // an agent waits its backoff after a replan before the next, the backoff doubles while it stays stuck
+        int doubled = 0;
+        for(size_t i = 0; i < replans.size(); ++i) {
+            const RVO::Event& e = replans[i].first;
+            const int backoff = replans[i].second;
+            CHECK(backoff >= STUCK_STEPS && backoff <= REPLAN_MAX_BACKOFF, checkMsg("A backoff out of its range", (float)backoff, (float)STUCK_STEPS));
+            doubled += (backoff > STUCK_STEPS);
+            for(size_t j = i + 1; j < replans.size() && replans[j].first.step < e.step + backoff; ++j) {
+                stringstream ss;
+                ss << "The agent in slot " << e.agent.slot << " was replanned at step " << e.step << " and again at "
+                   << replans[j].first.step << " before its backoff of " << backoff;
+                CHECK(!(replans[j].first.agent == e.agent), ss.str());
+            }
+        }
+        CHECK(doubled > 0, "No agent was stuck again after a replan");
+    }
+
+    // with no limit more agents are replanned in a step than the default budget allows
+    const ReplanRun unlimited = runChoke(20, 100000, steps, 1, nullptr);
+    CHECK(unlimited.maxPerStep > REPLAN_BUDGET, checkMsg("The scene never had more stuck agents in a step than the budget", (float)unlimited.maxPerStep, (float)REPLAN_BUDGET));
+}
+
+void benchReplanBudget()
+{
+    const int steps = 4000;
+    for(int budget: { 0, REPLAN_BUDGET, 100000 }) {
+        const ReplanRun run = runChoke(40, budget, steps, 4, nullptr);
+        cout << "1600 agents " << steps << " steps, budget " << budget << ": " << run.replans << " replans, max " << run.maxPerStep
+             << " in a step, " << run.stuck << " stuck, " << run.reached << " reached, " << run.ms << " ms" << endl;
+    }
+}
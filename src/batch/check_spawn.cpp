@@ -0,0 +1,114 @@
+// agents added with addAgents get the plans of agents added one by one with updatePlan, and how much faster it is
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <sstream>
+
+// 12x12 buildings between a corner where the agents start and a goal in the other corner
+static string buildingsScene()
+{
+    stringstream ss;
+    ss << "p,v,-700,-700,v,-700,700,v,700,700,v,700,-700,\n";
+    for(int y = 0; y < 12; ++y)
+        for(int x = 0; x < 12; ++x)
+            ss << "b," << x * 100 - 550 << "," << y * 100 - 550 << "," << x * 100 - 500 << "," << y * 100 - 500 + (x % 3) * 10 << ",\n";
+    ss << "g,650,650,30,0,\n";
+    ss << "a,650,-650,-1,0,0,5,1,\n";
+    return ss.str();
+}
+
+// count positions in the corner, two radiuses in runs as a spawner makes them
+static void cornerWave(int count, vector<Vec2>& positions, vector<float>& radiuses)
+{
+    minstd_rand rng(42);
+    uniform_real_distribution<float> pos(-690.0f, -570.0f);
+    positions.clear();
+    radiuses.clear();
+    for(int i = 0; i < count; ++i) {
+        positions.push_back(Vec2(pos(rng), pos(rng)));
+        radiuses.push_back((i / 50 % 2 == 0) ? 5.0f : 8.0f);
+    }
+}
+
+// from the agent through the points of its plan
+static float planLength(const RVO::Agent* a)
+{
+    float len = 0.0f;
+    Vec2 at = a->m_position;
+    for(const auto* sub: a->m_plan.m_d) {
+        const Vec2 dest = sub->getDest(at);
+        len += dist(at, dest);
+        at = dest;
+    }
+    return len;
+}
+
+static void addOneByOne(Document& doc, const vector<Vec2>& positions, const vector<float>& radiuses)
+{
+    Goal* goal = doc.m_goals[0].get();
+    for(size_t i = 0; i < positions.size(); ++i)
+        doc.updatePlan(doc.addAgent(positions[i], goal, radiuses[i], 1.0f));
+}
+
+void checkAddAgents()
+{
+    vector<Vec2> positions;
+    vector<float> radiuses;
+    cornerWave(1000, positions, radiuses);
+
+    Document one, wave;
+    loadCheckScene(one, buildingsScene());
+    loadCheckScene(wave, buildingsScene());
+    addOneByOne(one, positions, radiuses);
+    vector<RVO::AgentHandle> handles;
+    wave.addAgents(positions, radiuses, vector<float>(1, 1.0f), wave.m_goals[0].get(), &handles);
+
+    CHECK(one.m_agents.size() == wave.m_agents.size(), checkMsg("addAgents added a different number of agents", (float)wave.m_agents.size(), (float)one.m_agents.size()));
+    CHECK(handles.size() == positions.size() && wave.m_goals[0]->agents.size() == positions.size(), "addAgents did not give a handle for every agent");
+    int reachable = 0;
+    double oneLength = 0.0, waveLength = 0.0;
+    float worst = 1.0f;
+    for(size_t i = 0; i < positions.size(); ++i) {
+        const RVO::Agent* a = one.m_agents[i + 1];
+        const RVO::Agent* b = wave.m_sim.getAgent(handles[i]);
+        CHECK(b != nullptr && b == wave.m_agents[i + 1], "A handle of addAgents is not of its agent");
+        CHECK(a->m_position == b->m_position && a->m_radius == b->m_radius && a->neighborDist_ == b->neighborDist_,
+              "addAgents made an agent that is not the one of addAgent");
+        stringstream ss;
+        ss << "agent " << i << " at " << positions[i].x << "," << positions[i].y << " is " << (a->m_goalIsReachable ? "" : "not ")
+           << "reachable one by one and " << (b->m_goalIsReachable ? "" : "not ") << "with addAgents";
+        CHECK(a->m_goalIsReachable == b->m_goalIsReachable, ss.str());
+        // the corridor of a start and end triangle is searched from the middle of its agents, the path in it can bend elsewhere
+        CHECK(b->m_plan.m_d.empty() == a->m_plan.m_d.empty(), ss.str() + ", one of them has no plan");
+        reachable += a->m_goalIsReachable;
+        oneLength += planLength(a);
+        waveLength += planLength(b);
+        worst = max(worst, planLength(b) / max(1.0f, planLength(a)));
+    }
+    CHECK(reachable > (int)positions.size() / 2, checkMsg("Few agents reach the goal", (float)reachable, (float)positions.size()));
+    CHECK(waveLength < oneLength * 1.02, checkMsg("The plans of addAgents are longer than one by one", (float)waveLength, (float)oneLength));
+    CHECK(worst < 1.2f, checkMsg("A plan of addAgents is longer than one by one by", worst, 1.0f));
+}
+
+void benchAddAgents()
+{
+    vector<Vec2> positions;
+    vector<float> radiuses;
+    cornerWave(10000, positions, radiuses);
+    double oneMs = 0.0, waveMs = 0.0;
+    size_t triangles = 0;
+    {
+        Document doc;
+        loadCheckScene(doc, buildingsScene());
+        triangles = doc.m_mesh.m_tri.size();
+        oneMs = bestMs(1, [&]{ addOneByOne(doc, positions, radiuses); });
+    }
+    {
+        Document doc;
+        loadCheckScene(doc, buildingsScene());
+        waveMs = bestMs(1, [&]{ doc.addAgents(positions, radiuses, vector<float>(1, 1.0f), doc.m_goals[0].get(), nullptr); });
+    }
+    cout << positions.size() << " agents on " << triangles << " triangles: addAgent and updatePlan " << oneMs
+         << " ms, addAgents " << waveMs << " ms" << endl;
+}
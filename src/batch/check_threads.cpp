@@ -0,0 +1,91 @@
+// the step gives the same agents with any number of threads, and an exception of a chunk of the ThreadPool
+// reaches the caller after the workers are done
+
+#include "Checks.h"
+#include "../Document.h"
+#include "../rvo2/ThreadPool.h"
+
+#include <atomic>
+#include <thread>
+
+#define THREADS_CHUNKS 100
+
+// runs the chunks on 4 threads, the ones that throw are picked by throws(caller). returns the message it caught
+static string runThrowing(RVO::ThreadPool& pool, bool (*throws)(bool caller), atomic<int>& inside)
+{
+    const thread::id callerId = this_thread::get_id();
+    try {
+        pool.parallelFor(THREADS_CHUNKS, 1, [&](int, int) {
+            ++inside;
+            this_thread::sleep_for(chrono::microseconds(200)); // long enough for the workers to take chunks
+            const bool caller = this_thread::get_id() == callerId;
+            --inside;
+            if (throws(caller))
+                throw Exception(caller ? "caller" : "worker");
+        });
+    }
+    catch(const Exception& e) {
+        return e.what();
+    }
+    return "";
+}
+
+static void checkPoolExceptions()
+{
+    RVO::ThreadPool pool;
+    pool.setNumThreads(4);
+    atomic<int> inside(0);
+
+    // without the catch in the workers this ends the process
+    CHECK(runThrowing(pool, [](bool caller) { return !caller; }, inside) == "worker", "The exception of a worker did not reach the caller");
+    // the workers still use the chunk function on the stack of the caller when its own chunk throws
+    CHECK(runThrowing(pool, [](bool caller) { return caller; }, inside) == "caller", "The exception of the caller's chunk was not thrown");
+    CHECK(inside == 0, checkMsg("Chunks still running after parallelFor threw", (float)inside, 0.0f));
+
+    // the pool runs every chunk once after a job that threw
+    vector<int> runs(THREADS_CHUNKS, 0);
+    pool.parallelFor(THREADS_CHUNKS, 1, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i)
+            ++runs[i];
+    });
+    CHECK(count(runs.begin(), runs.end(), 1) == THREADS_CHUNKS, "A job after an exception did not run every chunk once");
+}
+
+// positions and velocities of all the agents after steps
+static void stepScene(const string& scene, int numThreads, int steps, vector<Vec2>& state)
+{
+    Document doc;
+    doc.m_sim.setNumThreads(numThreads);
+    loadCheckScene(doc, scene);
+    for(int i = 0; i < steps; ++i)
+        doc.doStep(FIXED_STEP_TIME, true, i);
+    state.clear();
+    for(const auto* a: doc.m_agents) {
+        state.push_back(a->m_position);
+        state.push_back(a->m_velocity);
+    }
+}
+
+void checkThreads()
+{
+    checkPoolExceptions();
+
+    // a crowd that meets in the middle, and agents that replan at a wall
+    const string scenes[] = { crowdScene(200), ringScene(200) };
+    const int threadCounts[] = { 2, 3, 4, RVO::ThreadPool::hardwareThreads() };
+    vector<Vec2> one, many;
+    for(const string& scene: scenes) {
+        stepScene(scene, 1, 400, one);
+        for(int threads: threadCounts) {
+            stepScene(scene, threads, 400, many);
+            CHECK(one.size() == many.size(), "Another number of agents");
+            for(size_t i = 0; i < one.size(); ++i) {
+                if (!(one[i] == many[i])) {
+                    stringstream ss;
+                    ss << "Agent " << i / 2 << " has another " << ((i % 2 == 0) ? "position" : "velocity") << " with " << threads << " threads than with 1";
+                    throw Exception(ss.str());
+                }
+            }
+        }
+    }
+}
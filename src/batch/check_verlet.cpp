@@ -0,0 +1,77 @@
+// the Verlet lists of the agent neighbors give the same steps as a query every step, and how many queries they save
+
+#include "Checks.h"
+#include "../Document.h"
+
+// runs the scene with the skin and the broadphase. positions are of all the agents after the steps
+static void runCrowd(const string& scene, float skin, RVO::BroadphaseType broadphase, int numThreads, int steps,
+                     vector<Vec2>& positions, int* rebuilds, double* ms)
+{
+    Document doc;
+    doc.m_sim.setNumThreads(numThreads);
+    loadCheckScene(doc, scene);
+    doc.m_sim.setBroadphase(broadphase);
+    doc.m_sim.setVerletSkin(skin);
+    const int rebuildsBefore = doc.m_sim.verletRebuilds_;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < steps; ++i)
+        doc.doStep(FIXED_STEP_TIME, true, i);
+    if (ms != nullptr)
+        *ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (rebuilds != nullptr)
+        *rebuilds = doc.m_sim.verletRebuilds_ - rebuildsBefore;
+    positions.clear();
+    for(const auto* a: doc.m_agents)
+        positions.push_back(a->m_position);
+}
+
+static float maxDistance(const vector<Vec2>& a, const vector<Vec2>& b)
+{
+    CHECK(a.size() == b.size(), "Runs of different agent counts");
+    float d = 0.0f;
+    for(size_t i = 0; i < a.size(); ++i)
+        d = max(d, dist(a[i], b[i]));
+    return d;
+}
+
+void checkVerletLists()
+{
+    const string scene = crowdScene(100);
+    const RVO::BroadphaseType broadphases[] = { RVO::BROADPHASE_KDTREE, RVO::BROADPHASE_GRID };
+    vector<Vec2> query, verlet;
+    for(auto bp: broadphases) {
+        runCrowd(scene, 0.0f, bp, 1, 600, query, nullptr, nullptr);
+        for(float skin: { 0.5f, 1.0f }) {
+            for(int threads: { 1, 3 }) {
+                int rebuilds = 0;
+                runCrowd(scene, skin, bp, threads, 600, verlet, &rebuilds, nullptr);
+                CHECK(rebuilds < 600, "The Verlet lists were rebuilt every step");
+                stringstream ss;
+                ss << "Verlet lists moved the agents differently than a query every step, skin " << skin << ", " << threads << " threads";
+                CHECK(maxDistance(query, verlet) == 0.0f, ss.str());
+            }
+        }
+    }
+}
+
+void benchVerletLists()
+{
+    const int steps = 1500;
+    const string scene = crowdScene(200);
+    vector<Vec2> query, verlet;
+    for(auto bp: { RVO::BROADPHASE_KDTREE, RVO::BROADPHASE_GRID }) {
+        double queryMs = 0.0;
+        int queryRebuilds = 0;
+        runCrowd(scene, 0.0f, bp, 1, steps, query, &queryRebuilds, &queryMs);
+        cout << ((bp == RVO::BROADPHASE_KDTREE) ? "kdtree" : "grid") << ", 400 agents, " << steps << " steps, one thread\n";
+        cout << "  skin 0: " << queryRebuilds << " broadphase queries, " << queryMs << " ms\n";
+        for(float skin: { 0.25f, 0.5f, 1.0f, 2.0f }) {
+            double ms = 0.0;
+            int rebuilds = 0;
+            runCrowd(scene, skin, bp, 1, steps, verlet, &rebuilds, &ms);
+            // the difference to the run that queries every step is the loss of avoidance accuracy
+            cout << "  skin " << skin << ": " << rebuilds << " broadphase queries, " << ms << " ms, "
+                 << "largest distance to the positions of skin 0 " << maxDistance(query, verlet) << endl;
+        }
+    }
+}
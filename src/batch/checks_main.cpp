@@ -0,0 +1,157 @@
+// checks and benches of the simulation, see Checks.h
+//   checks [--bench] [name ...]
+// without --bench runs the checks, with it runs the benches. names select some of them, all run otherwise.
+// returns 1 if a check failed
+
+#include "Checks.h"
+#include "../Document.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+void cpp_out(const char* s) {
+    cout << s << endl;
+}
+
+volatile float g_benchSink = 0.0f;
+
+const char* const SCENE_TRI_IN_SQUARE =
+    "p,v,-415,-339,v,-421,346,v,401,360,v,382,-341,\n"
+    "p,v,84,21,v,-116,181,v,210,68,\n"
+    "g,304,160,20,0,\n"
+    "a,-68,99,0,0,0,15,1,\n"
+    "a,-100,89,0,0,0,15,1,\n"
+    "a,-109,52,0,0,0,15,1,\n"
+    "a,-114,21,0,0,0,15,1,\n"
+    "a,-148,-2,0,0,0,15,1,\n";
+
+string crowdScene(int perSide)
+{
+    const float radius = 5.0f, spacing = radius * 3.0f;
+    const int cols = max(1, (int)std::sqrt((float)perSide));
+    stringstream ss;
+    ss << "p,v,-600,-600,v,-600,600,v,600,600,v,600,-600,\n";
+    ss << "g,400,0,40,0,\ng,-400,0,40,0,\n";
+    for(int side = 0; side < 2; ++side) {
+        const float dir = (side == 0) ? -1.0f : 1.0f;
+        for(int i = 0; i < perSide; ++i) {
+            float x = dir * (200.0f + (i % cols) * spacing);
+            float y = ((i / cols) - perSide / cols * 0.5f) * spacing;
+            ss << "a," << x << "," << y << "," << side << ",0,0," << radius << ",1,\n";
+        }
+    }
+    return ss.str();
+}
+
+string ringScene(int count)
+{
+    stringstream ss;
+    ss << "p,v,-300,-300,v,-300,300,v,300,300,v,300,-300,\n";
+    ss << "p,v,-60,40,v,60,40,v,60,50,v,-60,50,\n";
+    ss << "g,0,0,30,0,\ng,0,45,5,0,\n";
+    for(int i = 0; i < count; ++i) {
+        const float a = i * 2.0f * (float)M_PI / count;
+        ss << "a," << std::cos(a) * 200.0f << "," << std::sin(a) * 200.0f << "," << (i % 25 == 0) << ",0,0,5,2,\n";
+    }
+    return ss.str();
+}
+
+string boxScene(int perSide, int missing)
+{
+    const int half = perSide * 20 + 100;
+    stringstream ss;
+    ss << "p,v," << -half << "," << -half << ",v," << -half << "," << half << ",v," << half << "," << half << ",v," << half << "," << -half << ",\n";
+    for(int i = 0; i < perSide * perSide; ++i) {
+        if (i == missing)
+            continue;
+        const int x = (i % perSide) * 40 - perSide * 20, y = (i / perSide) * 40 - perSide * 20;
+        ss << "b," << x << "," << y << "," << x + 20 << "," << y + 20 << ",\n";
+    }
+    ss << "g," << half - 50 << "," << half - 50 << ",20,0,\n";
+    ss << "a," << -half + 50 << "," << -half + 50 << ",0,0,0,10,3,\n";
+    return ss.str();
+}
+
+void loadCheckScene(Document& doc, const string& text)
+{
+    istringstream is(text);
+    map<string, string> imported;
+    doc.deserialize(is, imported);
+    CHECK(!doc.m_agents.empty(), "Scene has no agents");
+    doc.m_mapdef.makeBoxPoly();
+    doc.runTriangulate();
+    CHECK(doc.m_navLive, "Scene triangulation failed");
+}
+
+struct CheckEntry {
+    const char* name;
+    void (*func)();
+    bool bench;
+};
+
+static const CheckEntry g_checks[] = {
+    { "alloc", checkStepAllocs, false },
+    { "threads", checkThreads, false },
+    { "grid", checkAgentGrid, false },
+    { "grid", benchAgentGrid, true },
+    { "verlet", checkVerletLists, false },
+    { "verlet", benchVerletLists, true },
+    { "obstacles", checkObstacleLists, false },
+    { "obstacles", benchObstacleLists, true },
+    { "obstacles", benchObstacleSplits, true },
+    { "checkpoint", checkCheckpoint, false },
+    { "checkpoint", benchCheckpoint, true },
+    { "groups", checkGroups, false },
+    { "groups", benchGroups, true },
+    { "bih", checkBihNearest, false },
+    { "bih", benchBihNearest, true },
+    { "mtrig", checkMtrig, false },
+    { "mtrig", benchMtrig, true },
+    { "meshmirror", checkMeshMirror, false },
+    { "meshmirror", benchMeshMirror, true },
+    { "frames", checkFrameStore, false },
+    { "frames", benchFrameStore, true },
+    { "spawn", checkAddAgents, false },
+    { "spawn", benchAddAgents, true },
+    { "events", checkEvents, false },
+    { "events", benchEvents, true },
+    { "replan", checkReplanBudget, false },
+    { "replan", benchReplanBudget, true },
+    { "perimeter", checkPerimeterStore, false },
+    { "perimeter", benchPerimeterStore, true },
+    { "batch", checkBatchScenes, false },
+    { "navcache", checkNavCache, false },
+};
+
+int main(int argc, char* argv[])
+{
+    bool bench = false;
+    vector<string> names;
+    for(int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else
+            names.push_back(argv[i]);
+    }
+
+    int ran = 0, failed = 0;
+    for(const auto& c: g_checks)
+    {
+        if (c.bench != bench)
+            continue;
+        if (!names.empty() && find(names.begin(), names.end(), string(c.name)) == names.end())
+            continue;
+        ++ran;
+        cerr << (bench ? "bench " : "check ") << c.name << endl;
+        try {
+            c.func();
+        }
+        catch(const exception& e) {
+            cerr << "FAILED " << c.name << ": " << e.what() << endl;
+            ++failed;
+        }
+    }
+    cerr << ran << " ran, " << failed << " failed" << endl;
+    return (failed > 0 || ran == 0) ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+#include "MeshMirror.h"
+#include <algorithm>
+
+void MeshMirror::clear()
+{
+    m_vtx.clear();
+    m_slots.clear();
+    m_vtxIndex.clear();
+    m_slotOf.clear();
+    m_freeSlots.clear();
+    m_firstNewVtx = 0;
+    m_changed.clear();
+}
+
+int MeshMirror::vertexIndex(const Vec2& p)
+{
+    auto it = m_vtxIndex.insert(make_pair(make_pair(p.x, p.y), (int)m_vtx.size() / 2));
+    if (it.second) {
+        m_vtx.push_back(p.x);
+        m_vtx.push_back(p.y);
+    }
+    return it.first->second;
+}
+
+void MeshMirror::freeSlot(int slot)
+{
+    m_slots[slot * 3] = m_slots[slot * 3 + 1] = m_slots[slot * 3 + 2] = -1;
+    m_freeSlots.push_back(slot);
+    m_changed.push_back(slot);
+}
+
+bool MeshMirror::update(const Mesh& mesh)
+{
+    const size_t numVtx = m_vtxIndex.size();
+    const size_t numTri = m_slotOf.size();
+    bool full = (numVtx > MESH_COMPACT_MIN && numVtx > 2 * mesh.m_vtx.size())
+             || (m_freeSlots.size() > MESH_COMPACT_MIN && m_freeSlots.size() > numTri);
+    if (full)
+        clear();
+    m_firstNewVtx = (int)m_vtx.size() / 2;
+    m_changed.clear();
+
+    m_meshVtxIndex.resize(mesh.m_vtx.size());
+    for(size_t i = 0; i < mesh.m_vtx.size(); ++i)
+        m_meshVtxIndex[i] = vertexIndex(mesh.m_vtx[i].p);
+    m_newKeys.clear();
+    for(const auto& tri : mesh.m_tri) {
+        TriKey k = { { m_meshVtxIndex[tri.v[0]->index], m_meshVtxIndex[tri.v[1]->index], m_meshVtxIndex[tri.v[2]->index] } };
+        rotate(k.begin(), min_element(k.begin(), k.end()), k.end()); // keeps the winding
+        m_newKeys.push_back(k);
+    }
+    sort(m_newKeys.begin(), m_newKeys.end());
+
+    // both are sorted, the triangles that are only in the old ones free their slots
+    m_newSlotOf.clear();
+    auto oldIt = m_slotOf.begin();
+    for(const auto& k : m_newKeys) {
+        for(; oldIt != m_slotOf.end() && oldIt->first < k; ++oldIt)
+            freeSlot(oldIt->second);
+        if (oldIt != m_slotOf.end() && oldIt->first == k)
+            m_newSlotOf.push_back(*oldIt++);
+        else
+            m_newSlotOf.push_back(TriSlot(k, -1));
+    }
+    for(; oldIt != m_slotOf.end(); ++oldIt)
+        freeSlot(oldIt->second);
+
+    for(auto& ts : m_newSlotOf) {
+        if (ts.second >= 0)
+            continue;
+        if (!m_freeSlots.empty()) {
+            ts.second = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else {
+            ts.second = (int)m_slots.size() / 3;
+            m_slots.resize(m_slots.size() + 3);
+        }
+        copy(ts.first.begin(), ts.first.end(), m_slots.begin() + ts.second * 3);
+        m_changed.push_back(ts.second);
+    }
+    m_slotOf.swap(m_newSlotOf);
+    // when most slots changed, all of them are sent instead of the list
+    return !full && m_changed.size() * 2 < m_slots.size() / 3;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <array>
+#include "../Mesh.h"
+
+using namespace std;
+
+// vertices and slots that are not used anymore are dropped when there are more than this and more than the used ones
+#define MESH_COMPACT_MIN 4096
+
+// the triangles of the mesh as the page has them, see take_mesh in page.html. the vertices are only appended to
+// and a triangle keeps its slot as long as it is in the mesh, so after a remesh of a region only the new vertices
+// and the slots of the triangles around the region are sent again
+class MeshMirror
+{
+public:
+    // makes the mirror the same as mesh, m_changed are the slots that changed. false if the page should take all the slots
+    bool update(const Mesh& mesh);
+
+    vector<float> m_vtx; // x,y
+    vector<int> m_slots; // 3 indices in m_vtx per slot, -1 for an empty slot
+    int m_firstNewVtx = 0; // the ones before it were sent before the last update
+    vector<int> m_changed; // slots of the last update
+
+    // no triangles, the next update sends all
+    void clear();
+
+private:
+    typedef array<int, 3> TriKey; // indices of the vertices, rotated so that the smallest is first
+    typedef pair<TriKey, int> TriSlot;
+    int vertexIndex(const Vec2& p);
+    void freeSlot(int slot);
+
+    map<pair<float, float>, int> m_vtxIndex;
+    vector<TriSlot> m_slotOf; // sorted by key
+    vector<int> m_freeSlots;
+    // buffers of update()
+    vector<int> m_meshVtxIndex; // of every mesh vertex
+    vector<TriKey> m_newKeys;
+    vector<TriSlot> m_newSlotOf;
+};
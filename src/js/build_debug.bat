@@ -1 +1 @@
-%EMSCRIPTEN%\em++ -g3 -O0 -std=c++11 -s ASSERTIONS=1 -s SAFE_HEAP=1 -s DEMANGLE_SUPPORT=1 --memory-init-file 0 js_main.cpp unity.cpp -o js_main.html -s EXPORTED_FUNCTIONS="['_cpp_start', '_added_poly_point', '_moved_object', '_started_new_poly', '_added_agent', '_add_goal', '_remove_goal', '_set_goal', '_cpp_progress', '_serialize', '_deserialize', '_go_to_frame', '_update_agent', '_update_goal', '_add_imported', '_added_building']"
\ No newline at end of file
+%EMSCRIPTEN%\em++ -g3 -O0 -std=c++11 -s ASSERTIONS=1 -s SAFE_HEAP=1 -s DEMANGLE_SUPPORT=1 -DNAV_COUNT_ALLOCS --memory-init-file 0 js_main.cpp unity.cpp -o js_main.html -s EXPORTED_FUNCTIONS="['_cpp_start', '_added_poly_point', '_moved_object', '_started_new_poly', '_added_agent', '_remove_agent', '_add_goal', '_remove_goal', '_group_goal_agents', '_set_goal', '_cpp_progress', '_cpp_advance', '_serialize', '_deserialize', '_go_to_frame', '_set_frame_memory', '_set_event_mask', '_drain_events', '_event_data', '_drain_transforms', '_transform_data', '_update_agent', '_update_goal', '_add_imported', '_added_building']"
\ No newline at end of file
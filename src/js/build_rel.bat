@@ -1 +1 @@
-%EMSCRIPTEN%\em++ -O3 -std=c++11 --profiling --memory-init-file 0 js_main.cpp order_perimiters.cpp ../Agent.cpp ../poly2tri/adapter.cc ../poly2tri/advancing_front.cc ../poly2tri/shapes.cc ../poly2tri/sweep.cc ../poly2tri/sweep_context.cc ../BihTree.cpp ../Document.cpp ../Mesh.cpp -o js_main.html -s EXPORTED_FUNCTIONS="['_cpp_start', '_added_poly_point', '_moved_object', '_started_new_poly', '_added_agent', '_add_goal', '_remove_goal', '_set_goal', '_cpp_progress', '_serialize', '_deserialize', '_go_to_frame', '_update_agent', '_update_goal', '_add_imported', '_added_building']"
\ No newline at end of file
+%EMSCRIPTEN%\em++ -O3 -std=c++11 --profiling --memory-init-file 0 js_main.cpp order_perimiters.cpp MeshMirror.cpp ../Agent.cpp ../poly2tri/adapter.cc ../poly2tri/advancing_front.cc ../poly2tri/shapes.cc ../poly2tri/sweep.cc ../poly2tri/sweep_context.cc ../BihTree.cpp ../Document.cpp ../Mesh.cpp ../Perimeter.cpp ../Checkpoint.cpp ../FrameStore.cpp ../AllocCount.cpp ../rvo2/AgentGrid.cpp ../rvo2/ThreadPool.cpp ../NavCache.cpp -o js_main.html -s EXPORTED_FUNCTIONS="['_cpp_start', '_added_poly_point', '_moved_object', '_started_new_poly', '_added_agent', '_remove_agent', '_add_goal', '_remove_goal', '_group_goal_agents', '_set_goal', '_cpp_progress', '_cpp_advance', '_serialize', '_deserialize', '_go_to_frame', '_set_frame_memory', '_set_event_mask', '_drain_events', '_event_data', '_drain_transforms', '_transform_data', '_update_agent', '_update_goal', '_add_imported', '_added_building']"
\ No newline at end of file
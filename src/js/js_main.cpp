@@ -7,23 +7,29 @@
 #include "js_main.h"
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <map>
+#include <array>
+#include <algorithm>
 #include <assert.h>
 
 #include <limits>
 #include "../Vec2.h"
 #include "../Document.h"
+#include "../FrameStore.h"
+#include "../Checkpoint.h"
 #include "../Except.h"
 
 #include "../rvo2/Agent.h"
 #include "../mtrig.h"
+#include "MeshMirror.h"
 
 using namespace std;
 
 // bias the index so that they would be displayed in the proper z order
 
 #define Z_POLYPOINT 10
-#define Z_TRI 0
 #define Z_AGENT 20
 #define Z_GOAL 25
 #define Z_ERRBOX 5
@@ -67,41 +73,26 @@ public:
     int m_plindex, m_vindex; //polyline index, vertex index in the polyline
 };
 
-class TriItem  : public Item
-{
-public:
-    TriItem(NavCtrl* ctrl, Triangle* t) :Item(ctrl), m_t(t)
-    {
-        const Vec2& a = m_t->v[0]->p;
-        const Vec2& b = m_t->v[1]->p;
-        const Vec2& c = m_t->v[2]->p;
-        //EM_ASM_( out("tri (" + $0 + " " + $1 + ") (" + $2 + " " + $3 + ") (" + $4 + " " + $5 + ")"), a.x, a.y, b.x, b.y, c.x, c.y);
-        EM_ASM_( add_tri($0, $1, $2, $3, $4, $5, $6, $7), this, Z_TRI, a.x, a.y, b.x, b.y, c.x, c.y);
-    }
-    virtual ~TriItem() {
-        EM_ASM_( remove_triangle($0), this );
-    }
-
-    Triangle* m_t;
-};
-
 class AgentItem : public CircleItem
 {
 public:
-    AgentItem(NavCtrl* ctrl, RVO::Agent* a) :CircleItem(ctrl), m_a(a)
+    AgentItem(NavCtrl* ctrl, RVO::Agent* a) :CircleItem(ctrl), m_h(a->handle_)
     {
-        EM_ASM_( add_circle($0, $1, $2, $3, $4, COLOR_AGENT, ObjSelType.MULTI, ObjType.AGENT, null), this, Z_AGENT, m_a->m_position.x, m_a->m_position.y, m_a->m_radius);
+        EM_ASM_( add_circle($0, $1, $2, $3, $4, COLOR_AGENT, ObjSelType.MULTI, ObjType.AGENT, null), this, Z_AGENT, a->m_position.x, a->m_position.y, a->m_radius);
     }
     virtual ~AgentItem() {}
     virtual void setPos(const Vec2& p);
     void updatePos() {
-        EM_ASM_( move_orient_circle($0, $1, $2, $3), this, m_a->m_position.x, m_a->m_position.y, m_a->m_orientation);
+        auto* a = agent();
+        EM_ASM_( move_orient_circle($0, $1, $2, $3), this, a->m_position.x, a->m_position.y, a->m_orientation);
     }
     void updateSize() {
-        EM_ASM_( changed_size($0, $1), this, m_a->m_radius);
+        EM_ASM_( changed_size($0, $1), this, agent()->m_radius);
     }
-    //Agent* m_a;
-    RVO::Agent* m_a;
+    // the item is removed with its agent so it is always found
+    RVO::Agent* agent() const;
+
+    RVO::AgentHandle m_h;
 };
 
 class GoalItem : public CircleItem
@@ -196,19 +187,39 @@ public:
     unique_ptr<ErrorBoxItem> m_errBox;
 };
 
-struct AgentData {
-    Vec2 pos;
-    Vec2 vel;
+// recorded frames between checkpoints of the simulation. continuing from a frame restores the checkpoint before it and steps to it
+#define CHECKPOINT_INTERVAL 8
+#define MAX_CHECKPOINTS 256
+
+// how the simulation was stepped after a recorded frame, for stepping it again the same way
+struct FrameSteps {
+    float deltaSec;
+    int steps;
+    int throttle;
 };
-struct Frame
-{
-    vector<AgentData> m_agents;
+
+struct FrameCheckpoint {
+    int frame;
+    SimCheckpoint state;
+    vector<FrameSteps> steps; // of frame and the frames after it until the next checkpoint
 };
 
+// what the display needs of an agent. JS reads all of them from the heap in one go, see apply_transforms in page.html
+struct AgentTransform {
+    ptr_t item; // the key of its circle
+    float x, y;
+    float orientation;
+};
+#ifdef EMSCRIPTEN
+static_assert(sizeof(AgentTransform) == 4 * 4, "AgentTransform is read as 4 words");
+#endif
+
 class NavCtrl
 {
 public:
     NavCtrl() {
+        // the web build has no threads and stays on one
+        m_doc.m_sim.setNumThreads(RVO::ThreadPool::hardwareThreads());
     }
     void addPoly() {
         if (!m_doc.m_mapdef.isLastEmpty())
@@ -229,6 +240,17 @@ public:
         m_agentitems.push_back(shared_ptr<AgentItem>(i));
         m_quiteCount = 0;
     }
+    void removeAgent(AgentItem* a)
+    {
+        m_agentToGoal.erase(a);
+        m_doc.removeAgent(a->m_h);
+        auto it = find_if(m_agentitems.begin(), m_agentitems.end(), [a](const shared_ptr<AgentItem>& i) { return i.get() == a; });
+        if (it != m_agentitems.end())
+            m_agentitems.erase(it); // removes its circle
+        // the recorded frames and the checkpoints are by index in m_agentitems, the agents after it moved
+        resetFrames();
+        m_quiteCount = 0;
+    }
     GoalItem* addGoal(const Vec2& p, float radius, int type) 
     {
         auto pg = m_doc.addGoal(p, radius, (EGoalType)type);
@@ -260,6 +282,12 @@ public:
 
     void removeGoal(GoalItem* g) 
     {
+        for(auto mit = m_agentToGoal.begin(); mit != m_agentToGoal.end(); ) {
+            if (mit->second == g)
+                mit = m_agentToGoal.erase(mit);
+            else
+                ++mit;
+        }
         auto it = m_goalitems.begin();
         while(it != m_goalitems.end()) {
             if (it->get() == g) {
@@ -277,7 +305,8 @@ public:
             g->m_g->def.radius = radius;
         if (type >= 0)
             g->m_g->def.type = (EGoalType)type;
-        for(auto* a: g->m_g->agents) {
+        for(const auto& h: g->m_g->agents) {
+            auto* a = m_doc.m_sim.getAgent(h);
             a->m_endGoalPos = g->m_g->def;
             // goal-id stays the same
             m_doc.updatePlan(a);
@@ -298,44 +327,72 @@ public:
         m_quiteCount = 0;
     }
 
-    void setGoal(AgentItem* a, GoalItem* g) 
+    // an agent that is sent with others to be grouped is planned by groupGoalAgents, only the leader needs a plan
+    void setGoal(AgentItem* a, GoalItem* g, bool grouped) 
     {
-        setAgentGoalPos(a->m_a, g->m_g);
-        g->m_g->agents.push_back(a->m_a);
+        if (grouped) {
+            a->agent()->setEndGoal(g->m_g->def, g->m_g);
+            m_groupSent.push_back(a->m_h);
+            m_quiteCount = 0;
+        }
+        else
+            setAgentGoalPos(a->agent(), g->m_g);
+        g->m_g->agents.push_back(a->m_h);
 
         // remove the agent from its previous goal, if any
         auto oldg = m_agentToGoal[a];
         m_agentToGoal[a] = g;
         if (oldg != nullptr) {
-            auto it = find(oldg->m_g->agents.begin(), oldg->m_g->agents.end(), a->m_a);
+            auto it = find(oldg->m_g->agents.begin(), oldg->m_g->agents.end(), a->m_h);
             CHECK(it != oldg->m_g->agents.end(), "Did not find anget in prev goal");
             oldg->m_g->agents.erase(it);
         }
     }
 
+    // the agents that were sent to the goal with setGoal(grouped) move in formation behind the one
+    // that is closest to it. agents that were sent to it before are not part of the group
+    void groupGoalAgents(GoalItem* g)
+    {
+        auto it = remove_if(m_groupSent.begin(), m_groupSent.end(), [&](const RVO::AgentHandle& h) {
+            const RVO::Agent* a = m_doc.m_sim.getAgent(h);
+            return a == nullptr || a->m_endGoalId != g->m_g;
+        });
+        m_groupSent.erase(it, m_groupSent.end());
+        if (m_groupSent.size() == 1)
+            m_doc.updatePlan(m_doc.m_sim.getAgent(m_groupSent[0]));
+        else if (m_groupSent.size() > 1)
+            m_doc.addGroup(m_groupSent);
+        m_groupSent.clear();
+        m_quiteCount = 0;
+    }
+
     void updateAgent(AgentItem* a, float sz, float speed) {
         if (sz > 0) {
-            a->m_a->setRadius(sz);
+            a->agent()->setRadius(sz);
             a->updateSize();
             m_doc.addAgentRadius(sz);
         }
         if (speed > 0) {
-            a->m_a->setSpeed(speed);
+            a->agent()->setSpeed(speed);
         }
         m_quiteCount = 0;
     }
 
     void recordFrame() 
     {
-        m_frames.resize(m_atFrame); // truncate any future frames
-        m_frames.push_back(Frame());
-        auto& frame = m_frames.back();
-
-        for(auto& a: m_agentitems) {
-            a->updatePos();
-            frame.m_agents.push_back(AgentData{a->m_a->m_position, a->m_a->m_velocity});
+        if (m_rewound)
+            continueFromFrame(m_atFrame);
+        m_frames.truncate(m_atFrame); // truncate any future frames
+        saveCheckpoint();
+        m_frameBuf.resize(m_agentitems.size());
+        for(int i = 0; i < m_agentitems.size(); ++i) {
+            const auto* agent = m_agentitems[i]->agent();
+            m_frameBuf[i].pos = agent->m_position;
+            m_frameBuf[i].vel = agent->m_velocity;
         }
-        EM_ASM_( set_max_frame($0), m_frames.size()-1);
+        m_frames.push(m_frameBuf);
+        updateTransforms();
+        EM_ASM_( set_frame_range($0, $1), m_frames.firstFrame(), m_frames.endFrame()-1);
         ++m_atFrame;
     }
     
@@ -344,40 +401,121 @@ public:
         if (m_quiteCount >= 100 || m_goalitems.empty())
             return true;
         recordFrame();
-        if (m_doc.doStep(deltaSec, true, m_frames.size() - 1))  //0.25
+        m_checkpoints.back().steps.push_back(FrameSteps{deltaSec, 1, m_doc.m_sim.throttle()});
+        if (m_doc.doStep(deltaSec, true, m_frames.endFrame() - 1))  //0.25
             ++m_quiteCount;
 
         return false;
     }
 
+    // one frame of the display, any number of simulation steps that fit the budget
+    bool advance(float realTime, float cpuBudgetMs)
+    {
+        if (m_quiteCount >= 100 || m_goalitems.empty())
+            return true;
+        recordFrame();
+        int throttle = m_doc.m_sim.throttle();
+        AdvanceReport r = m_doc.advance(realTime, cpuBudgetMs);
+        m_checkpoints.back().steps.push_back(FrameSteps{FIXED_STEP_TIME, r.steps, throttle});
+        if (r.steps > 0 && r.reachedGoals)
+            ++m_quiteCount;
+        EM_ASM_( set_step_report($0, $1, $2, $3), r.steps, r.skippedSteps, r.throttle, r.stepMs);
+        return false;
+    }
+
+    // instead of a call to JS for every agent
+    void updateTransforms()
+    {
+        m_transforms.resize(m_agentitems.size());
+        for(int i = 0; i < m_agentitems.size(); ++i) {
+            const auto* agent = m_agentitems[i]->agent();
+            AgentTransform& t = m_transforms[i];
+            t.item = (ptr_t)m_agentitems[i].get();
+            t.x = agent->m_position.x;
+            t.y = agent->m_position.y;
+            t.orientation = agent->m_orientation;
+        }
+        m_newTransforms = true;
+    }
+
     void goToFrame(int f) 
     {
-        if (f >= m_frames.size()) {
-            OUT("bad frame index " << f << " sz=" << m_frames.size());
+        // recorded frames are quantized, the agents continue from a state close to the one they had
+        if (!m_frames.get(f, m_frameBuf)) {
+            OUT("bad frame index " << f << " range=" << m_frames.firstFrame() << "-" << m_frames.endFrame());
             return;
         }
 
-        auto& frame = m_frames[f];
-        for(int i = 0; i < frame.m_agents.size(); ++i) {
+        for(int i = 0; i < m_frameBuf.size() && i < m_agentitems.size(); ++i) {
             auto ai = m_agentitems[i];
-            const auto& fa = frame.m_agents[i];
-            ai->m_a->m_position = fa.pos;
-            ai->m_a->m_velocity = fa.vel;
-            ai->updatePos();
+            const auto& fa = m_frameBuf[i];
+            auto* agent = ai->agent();
+            agent->m_position = fa.pos;
+            agent->m_velocity = fa.vel;
         }
+        updateTransforms();
         m_atFrame = f;
         m_quiteCount = 0;
+        m_rewound = true;
+    }
+
+    // drop the checkpoints after the frame that is recorded now and add one if it is time for it
+    void saveCheckpoint()
+    {
+        while (!m_checkpoints.empty() && m_checkpoints.back().frame > m_atFrame)
+            m_checkpoints.pop_back();
+        if (!m_checkpoints.empty() && m_checkpoints.back().frame == m_atFrame)
+            m_checkpoints.pop_back(); // the state of the frame may not be the same, if continueFromFrame failed
+        if (!m_checkpoints.empty())
+            m_checkpoints.back().steps.resize(m_atFrame - m_checkpoints.back().frame);
+
+        if (m_checkpoints.empty() || m_atFrame % CHECKPOINT_INTERVAL == 0) {
+            const SimCheckpoint* prev = m_checkpoints.empty() ? nullptr : &m_checkpoints.back().state;
+            FrameCheckpoint cp;
+            cp.frame = m_atFrame;
+            cp.state.save(m_doc, prev);
+            m_checkpoints.push_back(move(cp));
+        }
+        // a checkpoint is needed for every frame that is still recorded
+        while (m_checkpoints.size() > MAX_CHECKPOINTS || (m_checkpoints.size() > 1 && m_checkpoints[1].frame <= m_frames.firstFrame()))
+            m_checkpoints.pop_front();
+    }
+
+    // goToFrame only moved the agents to where they were. bring back the rest of their state from the
+    // checkpoint before the frame and step from it, so that playing again does the same as the first time
+    void continueFromFrame(int f)
+    {
+        m_rewound = false;
+        auto it = upper_bound(m_checkpoints.begin(), m_checkpoints.end(), f, [](int f, const FrameCheckpoint& cp) { return f < cp.frame; });
+        if (it == m_checkpoints.begin() || !(it - 1)->state.restore(m_doc)) {
+            OUT("no checkpoint for frame " << f << ", continuing from the recorded positions");
+            return;
+        }
+        const FrameCheckpoint& cp = *(it - 1);
+        for(int fi = cp.frame; fi < f; ++fi) {
+            const FrameSteps& fs = cp.steps[fi - cp.frame];
+            m_doc.m_sim.setThrottle(fs.throttle);
+            for(int i = 0; i < fs.steps; ++i)
+                m_doc.doStep(fs.deltaSec, true, fi);
+        }
+        if (f - cp.frame < cp.steps.size())
+            m_doc.m_sim.setThrottle(cp.steps[f - cp.frame].throttle);
     }
     
     void updateMesh(); // when plylines change
     void updateBoxesAndMesh(); // when there's a chance boxes changed
     void readDoc();
     void sendPerminiters();
+    void sendMesh();
+    void clearMesh();
+    void uploadMesh(bool all);
 
     void resetFrames() {
         m_frames.clear();
+        m_checkpoints.clear();
+        m_rewound = false;
         m_atFrame = 0;
-        EM_ASM_( set_max_frame($0), 0);
+        EM_ASM_( set_frame_range($0, $1), 0, 0);
     }
 
     const char* serialize() {
@@ -398,30 +536,41 @@ public:
     }
     
     vector<shared_ptr<PolyPointItem>> m_polypointitems;
-    vector<shared_ptr<TriItem>> m_meshitems;
     vector<shared_ptr<AgentItem>> m_agentitems;
     vector<shared_ptr<GoalItem>> m_goalitems;
     vector<shared_ptr<BuildingPointItem>> m_buildingitems;
     vector<shared_ptr<BuildingMoveItem>> m_buildingCenterItems;
     Document m_doc;
-    vector<Frame> m_frames;
+    FrameStore m_frames;
+    vector<FrameStore::AgentState> m_frameBuf; // of the frame that is recorded or read
+    vector<RVO::Event> m_events; // of the last drain_events
+    MeshMirror m_meshMirror;
+    vector<AgentTransform> m_transforms; // of the last recorded or shown frame
+    bool m_newTransforms = false; // m_transforms was not drained yet
     int m_atFrame = 0; // the index of the last frame that was recorded
+    deque<FrameCheckpoint> m_checkpoints; // in frame order, the first is at or before m_frames.firstFrame()
+    bool m_rewound = false; // goToFrame moved the agents, the rest of the state is not of m_atFrame
     int m_quiteCount = 0; // frames that are quiet
     map<AgentItem*, GoalItem*> m_agentToGoal; // this info should not be in Agent because Anget is not aware of Goal
+    vector<RVO::AgentHandle> m_groupSent; // sent by setGoal without a plan, until groupGoalAgents
     map<string, string> m_importedTexts;
 };
 
+RVO::Agent* AgentItem::agent() const {
+    return m_ctrl->m_doc.m_sim.getAgent(m_h);
+}
+
 void AgentItem::setPos(const Vec2& p) {
-    m_a->setPos(p);
+    agent()->setPos(p);
     updatePos();
-    m_ctrl->changedAgentPos(m_a);
+    m_ctrl->changedAgentPos(agent());
 }
 
 // depends on NavCtrl
 void GoalItem::setPos(const Vec2& p) {
     m_g->def.p = p;
-    for(auto* a: m_g->agents)
-        m_ctrl->setAgentGoalPos(a, m_g);
+    for(const auto& h: m_g->agents)
+        m_ctrl->setAgentGoalPos(m_ctrl->m_doc.m_sim.getAgent(h), m_g);
     EM_ASM_( move_circle($0, $1, $2), this, m_g->def.p.x, m_g->def.p.y);
 }
 
@@ -502,14 +651,16 @@ void NavCtrl::sendPerminiters()
     v.clear();
     vector<Polyline*> polyorder;
     orderPerimiters(m_doc.m_mesh.m_perimiters, polyorder);
+    const PerimeterStore& store = m_doc.m_perimeter;
     for(const auto* pr: polyorder)
     {
-        for(const auto* vtx: pr->m_d) {
-            v.push_back(vtx->p.x);
-            v.push_back(vtx->p.y);
+        const auto& loop = store.m_loops[pr - m_doc.m_mesh.m_perimiters.data()];
+        for(int i = loop.firstEdge; i < loop.firstEdge + loop.numEdges; ++i) {
+            v.push_back(store.m_edges[i].a.x);
+            v.push_back(store.m_edges[i].a.y);
         }
         // end of polygon marker
-        v.push_back((pr->m_isCW ? 1:-1) * numeric_limits<float>::infinity());
+        v.push_back((loop.isCW ? 1:-1) * numeric_limits<float>::infinity());
     }
     float* p = nullptr;
     if (v.size() > 0)
@@ -517,6 +668,25 @@ void NavCtrl::sendPerminiters()
     EM_ASM_( take_perimiters($0, $1), p, v.size());
 }
 
+// replaces the triangles in the page with one call instead of one for every triangle
+void NavCtrl::sendMesh()
+{
+    uploadMesh(!m_meshMirror.update(m_doc.m_mesh));
+}
+
+// the page drops its triangles, the next sendMesh() sends all of them
+void NavCtrl::clearMesh()
+{
+    m_meshMirror.clear();
+    uploadMesh(true);
+}
+
+void NavCtrl::uploadMesh(bool all)
+{
+    const MeshMirror& mm = m_meshMirror;
+    EM_ASM_( take_mesh($0, $1, $2, $3, $4, $5, $6), mm.m_vtx.data(), mm.m_vtx.size() / 2, mm.m_firstNewVtx,
+             mm.m_slots.data(), mm.m_slots.size() / 3, mm.m_changed.data(), all ? -1 : (int)mm.m_changed.size());
+}
 
 void NavCtrl::updateMesh()
 {
@@ -525,17 +695,12 @@ void NavCtrl::updateMesh()
     }
     catch(const exception& e) {
         OUT("failed triangulation");
+        clearMesh(); // not the triangles of the map before
         return;
     }
 
     sendPerminiters();
-
-    m_meshitems.clear();
-    //OUT("Triangles " << m_doc.m_mesh.m_tri.size());
-    for(auto& tri : m_doc.m_mesh.m_tri) {
-        auto i = new TriItem(this, &tri);
-        m_meshitems.push_back(shared_ptr<TriItem>(i));
-    }
+    sendMesh();
     m_quiteCount = 0;
 }
 
@@ -560,7 +725,7 @@ void NavCtrl::readDoc()
     m_polypointitems.clear();
     m_buildingitems.clear();
     m_buildingCenterItems.clear();
-    m_meshitems.clear();
+    clearMesh();
 
     //OUT("AItems " << m_doc.m_agents.size());
     for(auto* agent: m_doc.m_sim.agents_) {
@@ -616,6 +781,12 @@ void added_poly_point(int x, int y) {
 void added_agent(int x, int y, float radius, float speed) {
     g_ctrl->addAgent(Vec2(x, y), radius, speed);
 }
+void remove_agent(ptr_t ptr) {
+    AgentItem* a = dynamic_cast<AgentItem*>((Item*)ptr);
+    if (a == nullptr)
+        return;
+    g_ctrl->removeAgent(a);
+}
 
 void moved_object(ptr_t ptr, int x, int y)
 {
@@ -629,16 +800,21 @@ ptr_t add_goal(int x, int y, float radius, int type) {
     //OUT("AddGoal " << g);
     return (ptr_t)g;
 }
-void set_goal(ptr_t agentPtr, ptr_t goalPtr) {
+// grouped agents are planned by the group_goal_agents call that follows
+void set_goal(ptr_t agentPtr, ptr_t goalPtr, int grouped) {
     AgentItem* a = (AgentItem*)agentPtr;
     GoalItem* g = (GoalItem*)goalPtr;
     //OUT("SetGoal " << a << " " << g);
-    g_ctrl->setGoal(a, g);
+    g_ctrl->setGoal(a, g, grouped != 0);
 }
 void remove_goal(ptr_t ptr) {
     GoalItem* g = (GoalItem*)ptr;
     g_ctrl->removeGoal(g);
 }
+void group_goal_agents(ptr_t goalPtr) {
+    GoalItem* g = (GoalItem*)goalPtr;
+    g_ctrl->groupGoalAgents(g);
+}
 
 bool cpp_progress(float deltaSec) {
     try {
@@ -649,6 +825,15 @@ bool cpp_progress(float deltaSec) {
         return false;
     }
 }
+bool cpp_advance(float realTime, float cpuBudgetMs) {
+    try {
+        return g_ctrl->advance(realTime, cpuBudgetMs);
+    }
+    catch(const std::exception& e) {
+        OUT("EXCEPTION: " << e.what());
+        return false;
+    }
+}
 // write doc
 const char* serialize() {
     return g_ctrl->serialize();
@@ -678,6 +863,30 @@ void go_to_frame(int f) {
     g_ctrl->goToFrame(f);
 }
 
+void set_frame_memory(int mb) {
+    g_ctrl->m_frames.setMemoryLimit((size_t)max(1, mb) * 1024 * 1024);
+}
+
+void set_event_mask(int mask) {
+    g_ctrl->m_doc.m_sim.setEventMask((unsigned int)mask);
+}
+int drain_events(int mask) {
+    g_ctrl->m_events.clear();
+    g_ctrl->m_doc.m_sim.drainEvents((unsigned int)mask, g_ctrl->m_events);
+    return (int)g_ctrl->m_events.size();
+}
+ptr_t event_data() {
+    return (ptr_t)g_ctrl->m_events.data();
+}
+int drain_transforms() {
+    int count = g_ctrl->m_newTransforms ? (int)g_ctrl->m_transforms.size() : 0;
+    g_ctrl->m_newTransforms = false;
+    return count;
+}
+ptr_t transform_data() {
+    return (ptr_t)g_ctrl->m_transforms.data();
+}
+
 void update_agent(ptr_t ptr, float sz, float speed) {
     AgentItem* a = dynamic_cast<AgentItem*>((Item*)ptr);
     if (a == nullptr)
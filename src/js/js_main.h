@@ -14,17 +14,31 @@ void cpp_start();
 void started_new_poly();
 void added_poly_point(int x, int y);
 void added_agent(int x, int y, float radius, float speed);
+void remove_agent(ptr_t ptr);
 void moved_object(ptr_t ptr, int x, int y);
 
 ptr_t add_goal(int x, int y, float radius, int type);
-void set_goal(ptr_t agentPtr, ptr_t goalPtr);
+void set_goal(ptr_t agentPtr, ptr_t goalPtr, int grouped);
 void remove_goal(ptr_t ptr);
+void group_goal_agents(ptr_t goalPtr);
 
 bool cpp_progress(float deltaSec);
+// advance by realTime seconds of simulation in about cpuBudgetMs
+bool cpp_advance(float realTime, float cpuBudgetMs);
 
 const char* serialize();
 void deserialize(const char* sp);
 void go_to_frame(int f);
+// memory limit of the recorded frames
+void set_frame_memory(int mb);
+// RVO::EventType bits of the events to record, 0 for none
+void set_event_mask(int mask);
+// the number of events of the types in mask since the last drain, read from event_data()
+int drain_events(int mask);
+ptr_t event_data();
+// the number of agents that moved since the last drain, their AgentTransform are read from transform_data()
+int drain_transforms();
+ptr_t transform_data();
 void update_agent(ptr_t ptr, float sz, float speed);
 void update_goal(ptr_t ptr, float radius, int type);
 void add_imported(const char* name, const char* text);
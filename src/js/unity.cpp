@@ -9,10 +9,18 @@
 #include "../rvo2/RAgent.cpp"
 #include "../rvo2/KdTree.cpp"
 #include "../rvo2/RVOSimulator.cpp"
+#include "../rvo2/ThreadPool.cpp"
+#include "../rvo2/AgentGrid.cpp"
 
 #include "../Document.cpp"
 #include "../Mesh.cpp"
+#include "../NavCache.cpp"
+#include "../AllocCount.cpp"
+#include "../FrameStore.cpp"
+#include "../Checkpoint.cpp"
+#include "../Perimeter.cpp"
 
 #include "order_perimiters.cpp"
+#include "MeshMirror.cpp"
 
 
@@ -5,6 +5,13 @@
 #include <cmath>
 #endif
 
+// the web build is compiled without SIMD and takes the scalar path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MTRIG_USE_SSE
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
 namespace jsMath {
     float atan2(float y, float x);
     float asin(float a);
@@ -17,6 +24,7 @@ namespace mtrig
 
 #ifdef USE_MY_TRIG
 // from http://http.developer.nvidia.com/Cg/atan2.html
+// max error 4e-6 rad
 inline float atan2(float y, float x)
 {
     if (x == 0.0f && y == 0.0f)
@@ -46,6 +54,7 @@ inline float atan2(float y, float x)
     return t3;
 }
 
+// max error 7e-5 rad
 inline float asin(float x) {
     float negate = float(x < 0);
     x = iabs(x);
@@ -68,44 +77,163 @@ inline float asin(float x) {
 #define MASK_MAX_CIRCLE_ANGLE (MAX_CIRCLE_ANGLE - 1)
 #define PI 3.14159265358979323846f
 
-static bool g_wasInited = false;
-static float fast_cossin_table[MAX_CIRCLE_ANGLE];
+// the table is generated by the compiler so there is nothing to initialize before the first call
+namespace detail {
+    template<int... I> struct Seq {};
+    // 0..N-1 made of two halves so that the template depth is log(N)
+    template<typename A, typename B> struct Concat;
+    template<int... A, int... B> struct Concat<Seq<A...>, Seq<B...>> {
+        typedef Seq<A..., (int)sizeof...(A) + B...> type;
+    };
+    template<int N> struct MakeSeq {
+        typedef typename Concat<typename MakeSeq<N / 2>::type, typename MakeSeq<N - N / 2>::type>::type type;
+    };
+    template<> struct MakeSeq<0> { typedef Seq<> type; };
+    template<> struct MakeSeq<1> { typedef Seq<0> type; };
 
-inline void build_table() {
-    // Build cossin table
-    for (int i = 0 ; i < MAX_CIRCLE_ANGLE ; i++)
-    {
-        fast_cossin_table[i] = (float)sin((double)i * PI / HALF_MAX_CIRCLE_ANGLE);
+    // taylor series in double, more than enough terms for [0,2pi) to round to the same float as sin()
+    constexpr double taylorSin(double x, double term, double sum, int k) {
+        return (k == 40) ? sum : taylorSin(x, -term * x * x / ((2 * k + 2) * (2 * k + 3)), sum + term, k + 1);
     }
+    // pi in double, PI is a float and would put the steps off by its rounding
+    constexpr double tablePi = 3.14159265358979323846;
+    constexpr float tableSin(int i) {
+        return (float)taylorSin((double)i * tablePi / HALF_MAX_CIRCLE_ANGLE, (double)i * tablePi / HALF_MAX_CIRCLE_ANGLE, 0.0, 0);
+    }
+
+    template<typename S> struct SinTable;
+    template<int... I> struct SinTable<Seq<I...>> {
+        static constexpr float values[sizeof...(I)] = { tableSin(I)... };
+    };
+    template<int... I> constexpr float SinTable<Seq<I...>>::values[sizeof...(I)];
 }
 
+typedef detail::SinTable<detail::MakeSeq<MAX_CIRCLE_ANGLE>::type> CosSinTable;
+static_assert(CosSinTable::values[QUARTER_MAX_CIRCLE_ANGLE] == 1.0f, "sin table");
+
+// the angle is truncated to steps of 2pi/MAX_CIRCLE_ANGLE so the max error is 0.0123
 inline float cos(float n)
 {
     float f = n * HALF_MAX_CIRCLE_ANGLE / PI;
     int i = (int)f;
     if (i < 0)
     {
-        return fast_cossin_table[((-i) + QUARTER_MAX_CIRCLE_ANGLE) & MASK_MAX_CIRCLE_ANGLE];
+        return CosSinTable::values[((-i) + QUARTER_MAX_CIRCLE_ANGLE) & MASK_MAX_CIRCLE_ANGLE];
     }
     else
     {
-        return fast_cossin_table[(i + QUARTER_MAX_CIRCLE_ANGLE) & MASK_MAX_CIRCLE_ANGLE];
+        return CosSinTable::values[(i + QUARTER_MAX_CIRCLE_ANGLE) & MASK_MAX_CIRCLE_ANGLE];
     }
 }
 
+// same as cos(). a negative i is 2pi-|i| in two's complement which is sin(-|i|)
 inline float sin(float n)
 {
     float f = n * HALF_MAX_CIRCLE_ANGLE / PI;
     int i = (int)f;
-    if (i < 0)
+    return CosSinTable::values[i & MASK_MAX_CIRCLE_ANGLE];
+}
+
+// the same functions over arrays, out[i] = f(in[i]) for i < n. they give exactly what the scalar
+// functions give, 4 at a time with SSE. out may be the same array as an input
+#ifdef MTRIG_USE_SSE
+
+namespace detail {
+    inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+    // like iabs(), -0 stays -0
+    inline __m128 abs(__m128 a) {
+        return _mm_xor_ps(a, _mm_and_ps(_mm_cmplt_ps(a, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+    }
+    inline __m128 atan2(__m128 y, __m128 x)
     {
-        return fast_cossin_table[(-((-i) & MASK_MAX_CIRCLE_ANGLE)) + MAX_CIRCLE_ANGLE];
+        const __m128 ax = abs(x), ay = abs(y);
+        const __m128 t0 = _mm_max_ps(ax, ay);
+        const __m128 t1 = _mm_min_ps(ax, ay);
+        __m128 t3 = _mm_mul_ps(t1, _mm_div_ps(_mm_set1_ps(1.0f), t0));
+        const __m128 t4 = _mm_mul_ps(t3, t3);
+        __m128 p = _mm_set1_ps(-0.013480470f);
+        p = _mm_add_ps(_mm_mul_ps(p, t4), _mm_set1_ps(0.057477314f));
+        p = _mm_sub_ps(_mm_mul_ps(p, t4), _mm_set1_ps(0.121239071f));
+        p = _mm_add_ps(_mm_mul_ps(p, t4), _mm_set1_ps(0.195635925f));
+        p = _mm_sub_ps(_mm_mul_ps(p, t4), _mm_set1_ps(0.332994597f));
+        p = _mm_add_ps(_mm_mul_ps(p, t4), _mm_set1_ps(0.999995630f));
+        t3 = _mm_mul_ps(p, t3);
+        t3 = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(1.570796327f), t3), t3);
+        t3 = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.141592654f), t3), t3);
+        t3 = select(_mm_cmplt_ps(y, _mm_setzero_ps()), _mm_xor_ps(t3, _mm_set1_ps(-0.0f)), t3);
+        // 0/0 is NaN, 0 at the origin
+        return _mm_andnot_ps(_mm_cmpeq_ps(t0, _mm_setzero_ps()), t3);
     }
-    else
+    inline __m128 asin(__m128 x)
+    {
+        const __m128 negate = _mm_cmplt_ps(x, _mm_setzero_ps());
+        x = abs(x);
+        __m128 r = _mm_set1_ps(-0.0187293f);
+        r = _mm_add_ps(_mm_mul_ps(r, x), _mm_set1_ps(0.0742610f));
+        r = _mm_sub_ps(_mm_mul_ps(r, x), _mm_set1_ps(0.2121144f));
+        r = _mm_add_ps(_mm_mul_ps(r, x), _mm_set1_ps(1.5707288f));
+        // the end is in double like in the scalar function, 2 at a time
+        const __m128d halfPi = _mm_set1_pd(3.14159265358979*0.5), one = _mm_set1_pd(1.0);
+        const __m128d lo = _mm_sub_pd(halfPi, _mm_mul_pd(_mm_sqrt_pd(_mm_sub_pd(one, _mm_cvtps_pd(x))), _mm_cvtps_pd(r)));
+        const __m128d hi = _mm_sub_pd(halfPi, _mm_mul_pd(_mm_sqrt_pd(_mm_sub_pd(one, _mm_cvtps_pd(_mm_movehl_ps(x, x)))),
+                                                          _mm_cvtps_pd(_mm_movehl_ps(r, r))));
+        r = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+        return _mm_xor_ps(r, _mm_and_ps(negate, _mm_set1_ps(-0.0f)));
+    }
+    // the table indices of sin(), cos() is the same with a quarter added to |i|
+    inline void tableIndices(__m128 n, bool isCos, int* out)
+    {
+        __m128i i = _mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(n, _mm_set1_ps((float)HALF_MAX_CIRCLE_ANGLE)), _mm_set1_ps(PI)));
+        if (isCos) {
+            const __m128i neg = _mm_cmplt_epi32(i, _mm_setzero_si128());
+            i = _mm_sub_epi32(_mm_xor_si128(i, neg), neg); // |i|
+            i = _mm_add_epi32(i, _mm_set1_epi32(QUARTER_MAX_CIRCLE_ANGLE));
+        }
+        _mm_storeu_si128((__m128i*)out, _mm_and_si128(i, _mm_set1_epi32(MASK_MAX_CIRCLE_ANGLE)));
+    }
+    inline void table(const float* a, float* out, int n, bool isCos)
     {
-        return fast_cossin_table[i & MASK_MAX_CIRCLE_ANGLE];
+        int k = 0;
+        int idx[4];
+        for (; k + 4 <= n; k += 4) {
+            tableIndices(_mm_loadu_ps(a + k), isCos, idx);
+            out[k] = CosSinTable::values[idx[0]];
+            out[k + 1] = CosSinTable::values[idx[1]];
+            out[k + 2] = CosSinTable::values[idx[2]];
+            out[k + 3] = CosSinTable::values[idx[3]];
+        }
+        for (; k < n; ++k)
+            out[k] = isCos ? mtrig::cos(a[k]) : mtrig::sin(a[k]);
     }
 }
+
+inline void atan2(const float* y, const float* x, float* out, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, detail::atan2(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+    for (; i < n; ++i)
+        out[i] = atan2(y[i], x[i]);
+}
+inline void asin(const float* a, float* out, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, detail::asin(_mm_loadu_ps(a + i)));
+    for (; i < n; ++i)
+        out[i] = asin(a[i]);
+}
+inline void sin(const float* a, float* out, int n) {
+    detail::table(a, out, n, false);
+}
+inline void cos(const float* a, float* out, int n) {
+    detail::table(a, out, n, true);
+}
+
+#endif //MTRIG_USE_SSE
+
 #else
 
 #ifdef EMSCRIPTEN
@@ -122,4 +250,23 @@ using std::sin;
 
 #endif //USE_MY_TRIG
 
-}
\ No newline at end of file
+#if !defined(USE_MY_TRIG) || !defined(MTRIG_USE_SSE)
+inline void atan2(const float* y, const float* x, float* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = atan2(y[i], x[i]);
+}
+inline void asin(const float* a, float* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = asin(a[i]);
+}
+inline void sin(const float* a, float* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = sin(a[i]);
+}
+inline void cos(const float* a, float* out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = cos(a[i]);
+}
+#endif
+
+}
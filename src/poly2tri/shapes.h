@@ -38,6 +38,7 @@
 #include <cmath>
 
 #include <exception>
+#include <stdexcept>
 
 namespace p2t {
 
@@ -8,6 +8,9 @@
 #include "../Objects.h"
 #include "../Goal.h"
 
+// steps without getting a radius closer to the current subgoal or passing it before an agent is stuck
+#define STUCK_STEPS 40
+
 namespace RVO {
 
 
@@ -15,7 +18,7 @@ template<typename T, int N>
 class CyclicBuffer
 {
     T m_buf[N];
-    int m_ind;
+    int m_ind = 0;
 
 public:
     void init(T v) {
@@ -51,36 +54,76 @@ public:
 		timeHorizon_ = timeHorizon;
 		timeHorizonObst_ = timeHorizonObst;
 		m_velocity = Vec2();
+        agentNeighbors_.reserve(maxNeighbors);
 
         m_lastGoalDists.init(FLT_MAX);
     }
 
-	void computeNeighbors(KdTree& kdTree);
+	// obstacles from the kd-tree and agents from the Verlet candidates, or the broadphase when they are off
+	void computeNeighbors(const RVOSimulator& sim, AgentScratch& scratch);
+
+	// other agents are read from the store and not from their objects
+	void computeNewVelocity(const AgentStore& store, float timeStep, AgentScratch& scratch);
 
-	void computeNewVelocity(float timeStep);
+	void insertAgentNeighbor(int index, float distSq, float &rangeSq);
 
-	void insertAgentNeighbor(const Agent *agent, float &rangeSq);
+	void insertObstacleNeighbor(AgentScratch& scratch, const Obstacle *obstacle, float distSq) const;
 
-	void insertObstacleNeighbor(const Obstacle *obstacle, float rangeSq);
+	// obstacles further than this are not avoided
+	float obstacleRange() const {
+		return timeHorizonObst_ * maxSpeed_ + m_radius;
+	}
 
-    bool update(float timeStep);
+    // true if the agent reached its goal in this update. events is the ring of the thread that runs it
+    bool update(float timeStep, EventRing& events);
+    // counts the steps since the agent got closer to its subgoal
+    void trackProgress(EventRing& events);
+    // apply what update() found about the goal to the shared Goal. called serially in agent order after all agents were updated
+    void commitGoalUpdate();
 
     void setPos(const Vec2& p) {
         m_position = p;
     }       
     void setRadius(float r) {
+        // keeps the neighbor distance factor it was made with
+        neighborDist_ = (m_radius > 0.0f) ? neighborDist_ * r / m_radius : r * NEI_DIST_RADIUS_FACTOR;
         m_radius = r;
         //size = Vec2(r * 2, r * 2);
-        neighborDist_ = r * NEI_DIST_RADIUS_FACTOR;
     }
     void setEndGoal(const GoalDef& g, Goal* gid) {
         m_endGoalPos = g;
-        m_endGoalPos.p += Vec2(0.001 * (rand()%100), 0.001 * (rand()%100)); // random small pertrub to break symmetry
+        // small pertrub to break symmetry. derived from the id and not from rand() so it doesn't depend on the order of calls
+        unsigned int h = perturbHash(id_);
+        m_endGoalPos.p += Vec2(0.001 * (h % 100), 0.001 * ((h / 100) % 100));
         m_endGoalId = gid; // actually a pointer to Goal
         m_reached = false;
+        m_asleep = false;
         m_goalIsReachable = false;
     }
 
+    // an agent that reached its goal stops being stepped. others avoid it as a static circle
+    void sleep() {
+        m_asleep = true;
+        m_velocity = Vec2();
+        newVelocity_ = Vec2();
+        prefVelocity_ = Vec2();
+    }
+    // pushed by a neighbor, goes back to the goal and falls asleep again when it reaches it
+    void wake() {
+        m_asleep = false;
+        m_reached = false;
+        m_lastGoalDists.init(FLT_MAX);
+        resetProgress();
+    }
+    // the agent has a new plan or was moved, it is not stuck
+    void resetProgress() {
+        m_progressIndex = -1;
+        m_stuckSteps = 0;
+    }
+    bool isStuck() const {
+        return m_stuckSteps >= STUCK_STEPS;
+    }
+
     void setSpeed(float speed) {
         //m_prefSpeed = speed;
         maxSpeed_ = speed;// * 2;
@@ -90,14 +133,25 @@ public:
 
     void computePreferredVelocity(float deltaTime);
 
-    void updateOrientation(float deltaTime);
+    // turns toward nexto, the angle of the velocity, by at most MAX_ANGULAR_SPEED
+    void updateOrientation(float deltaTime, float nexto);
+    // after update(), the angles of the velocities of all the agents are computed in one batch
+    static void updateOrientations(Agent* const* agents, int count, float deltaTime, AgentScratch& scratch);
+
+    static unsigned int perturbHash(unsigned int x) {
+        x = ((x >> 16) ^ x) * 0x45d9f3b;
+        x = ((x >> 16) ^ x) * 0x45d9f3b;
+        return (x >> 16) ^ x;
+    }
 
 public:
 	//RVOSimulator *sim_;
-    int id_;
+    int id_; // index in RVOSimulator::agents_ and in its AgentStore, set by addAgent and changed by removeAgent
+    AgentHandle handle_; // set by RVOSimulator::addAgent
 
     // configs
 	int maxNeighbors_;
+	size_t neighborLimit_ = 0; // maxNeighbors_ capped by the StepDetail of the current step
 	float maxSpeed_;
 	float neighborDist_;
 	Vec2 prefVelocity_;
@@ -114,9 +168,12 @@ public:
 	Vec2 m_position;
 	Vec2 m_velocity;
 	Vec2 newVelocity_;
-	std::vector<Line> orcaLines_;
-	std::vector<std::pair<float, const Agent *> > agentNeighbors_;
-	std::vector<std::pair<float, const Obstacle *> > obstacleNeighbors_;
+	std::vector<std::pair<float, int> > agentNeighbors_; // index in RVOSimulator::agents_, of the last step and not valid after a removal
+	// Verlet list, agents that were within candidateDist_ + the skin when RVOSimulator::verletEpoch_ was candidateEpoch_
+	std::vector<int> agentCandidates_;
+	int candidateEpoch_ = -1;
+	float candidateDist_ = 0.0f;
+	bool candidatesGrew_ = false; // the last rebuild of the list allocated, the crowd got denser around the agent
 
     float m_orientation = 0.0;
 
@@ -126,11 +183,27 @@ public:
     // TBD-move all of these to an object
     ISubGoal* m_curGoalPos = nullptr; // in the plan
     bool m_reached = false;
+    bool m_asleep = false; // not stepped until woken, set after m_reached
     bool m_goalIsReachable = false; //determined in updatePlan
     int m_indexInPlan = -1;
     Plan m_plan;
+    // a follower of a group goes to its slot instead of following m_plan, see Document::updateGroups
+    bool m_following = false;
+    FormationSubGoal m_formationGoal;
+    float m_prefSpeed = 1.0f; // largest preferred velocity, groups change it to keep their formation together
 
     CyclicBuffer<float, 4> m_lastGoalDists;
+
+    // progress along the plan, updated by update(). Document::scheduleReplans replans the agents that are stuck
+    int m_progressIndex = -1; // m_indexInPlan when the agent last made progress
+    float m_progressDist = 0.0f; // distance to the subgoal when it last made progress
+    int m_stuckSteps = 0;
+    int m_replanBackoff = 0; // steps between replans, grows while replanning does not get the agent moving
+    int m_replanWait = 0; // steps until it may be replanned again
+
+    // set by update() when the agent stopped near a POINT goal, the goal minDistForStop is updated in commitGoalUpdate()
+    float m_stopUpdate = -1.0f;
+    float m_stopDist = 0.0f;
 };
 
 
@@ -0,0 +1,123 @@
+#include "AgentGrid.h"
+
+#include "Agent.h"
+#include "RVOSimulator.h"
+
+namespace RVO {
+
+    void AgentGrid::clear()
+    {
+        cellStart_.clear();
+        agents_.clear();
+        agentPos_.clear();
+        agentCell_.clear();
+        width_ = height_ = 0;
+    }
+
+    void AgentGrid::buildAgents()
+    {
+        const AgentStore& store = sim_->agentStore_;
+        const int count = (int)store.size();
+        if (count == 0) {
+            clear();
+            return;
+        }
+
+        Vec2 minP = store.position[0], maxP = store.position[0];
+        float maxDist = 0.0f;
+        for (int i = 0; i < count; ++i) {
+            const Vec2& p = store.position[i];
+            minP.x = std::min(minP.x, p.x);
+            minP.y = std::min(minP.y, p.y);
+            maxP.x = std::max(maxP.x, p.x);
+            maxP.y = std::max(maxP.y, p.y);
+            maxDist = std::max(maxDist, store.neighborDist[i]);
+        }
+
+        cellSize_ = (fixedCellSize_ > 0.0f) ? fixedCellSize_ : maxDist;
+        cellSize_ = std::max(cellSize_, RVO_EPSILON);
+        /* The +1 of the sides does not shrink with the cells, a long and thin crowd needs more than one try
+         * to get under the limit. Under it the cells always fit in the reserved cellStart_. */
+        const int maxCells = std::max(64, 2 * count);
+        for (;;) {
+            invCellSize_ = 1.0f / cellSize_;
+            width_ = (int)((maxP.x - minP.x) * invCellSize_) + 1;
+            height_ = (int)((maxP.y - minP.y) * invCellSize_) + 1;
+            const float areaCells = (float)width_ * (float)height_;
+            if (areaCells <= (float)maxCells) {
+                break;
+            }
+            cellSize_ *= std::sqrt(areaCells / (float)maxCells) * 1.01f;
+        }
+        origin_ = minP;
+
+        /* Counting sort of the agents by cell. */
+        const int cells = width_ * height_;
+        cellStart_.reserve(maxCells + 1);
+        cellStart_.assign(cells + 1, 0);
+        agentCell_.resize(count);
+        for (int i = 0; i < count; ++i) {
+            const int cx = std::min(width_ - 1, (int)((store.position[i].x - origin_.x) * invCellSize_));
+            const int cy = std::min(height_ - 1, (int)((store.position[i].y - origin_.y) * invCellSize_));
+            agentCell_[i] = cy * width_ + cx;
+            ++cellStart_[agentCell_[i] + 1];
+        }
+        for (int c = 0; c < cells; ++c) {
+            cellStart_[c + 1] += cellStart_[c];
+        }
+
+        agents_.resize(count);
+        agentPos_.resize(count);
+        for (int i = 0; i < count; ++i) {
+            const int at = cellStart_[agentCell_[i]]++;
+            agents_[at] = i;
+            agentPos_[at] = store.position[i];
+        }
+        /* The starts moved to the ends of the cells, shift them back. */
+        for (int c = cells; c > 0; --c) {
+            cellStart_[c] = cellStart_[c - 1];
+        }
+        cellStart_[0] = 0;
+    }
+
+    template<typename F>
+    void AgentGrid::queryCells(const Vec2 &position, int self, float &rangeSq, const F &insert) const
+    {
+        if (agents_.empty()) {
+            return;
+        }
+
+        const float range = std::sqrt(rangeSq);
+        const int cx0 = std::max(0, (int)std::floor((position.x - range - origin_.x) * invCellSize_));
+        const int cy0 = std::max(0, (int)std::floor((position.y - range - origin_.y) * invCellSize_));
+        const int cx1 = std::min(width_ - 1, (int)std::floor((position.x + range - origin_.x) * invCellSize_));
+        const int cy1 = std::min(height_ - 1, (int)std::floor((position.y + range - origin_.y) * invCellSize_));
+
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                const int c = cy * width_ + cx;
+                for (int i = cellStart_[c]; i < cellStart_[c + 1]; ++i) {
+                    const float distSq = absSq(position - agentPos_[i]);
+
+                    if (distSq < rangeSq && agents_[i] != self) {
+                        insert(agents_[i], distSq, rangeSq);
+                    }
+                }
+            }
+        }
+    }
+
+    void AgentGrid::computeAgentNeighbors(Agent *agent, float &rangeSq) const
+    {
+        queryCells(agent->m_position, agent->id_, rangeSq, [agent](int index, float distSq, float &rangeSq) {
+            agent->insertAgentNeighbor(index, distSq, rangeSq);
+        });
+    }
+
+    void AgentGrid::computeAgentCandidates(const Vec2 &position, int self, float rangeSq, std::vector<int> &out) const
+    {
+        queryCells(position, self, rangeSq, [&out](int index, float, float &) {
+            out.push_back(index);
+        });
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef RVO_AGENT_GRID_H_
+#define RVO_AGENT_GRID_H_
+
+#include "Broadphase.h"
+
+namespace RVO {
+
+    /**
+     * \brief      Uniform grid of the agents, built by a counting sort of the cells.
+     *
+     * Cheaper to build than the kd-tree, best when the agents have similar radii and
+     * density. The cell size is the largest neighbor distance unless set, and grows
+     * when the agents are spread so that the number of cells stays in proportion to
+     * the number of agents.
+     */
+    class AgentGrid : public AgentBroadphase
+    {
+    public:
+        explicit AgentGrid(RVOSimulator *sim) : sim_(sim) {}
+
+        virtual void buildAgents();
+        virtual void computeAgentNeighbors(Agent *agent, float &rangeSq) const;
+        virtual void computeAgentCandidates(const Vec2 &position, int self, float rangeSq, std::vector<int> &out) const;
+
+        void clear();
+        // 0 for automatic
+        void setCellSize(float size) {
+            fixedCellSize_ = size;
+        }
+
+    private:
+        // calls insert(index, distSq, rangeSq) for the agents in range, except self
+        template<typename F>
+        void queryCells(const Vec2 &position, int self, float &rangeSq, const F &insert) const;
+
+        RVOSimulator *sim_;
+        float fixedCellSize_ = 0.0f;
+
+        float cellSize_ = 1.0f;
+        float invCellSize_ = 1.0f;
+        Vec2 origin_;
+        int width_ = 0;
+        int height_ = 0;
+
+        std::vector<int> cellStart_; // index in agents_ of the first agent of each cell, one more than the cells
+        std::vector<int> agents_; // indices to RVOSimulator::agents_ sorted by cell
+        std::vector<Vec2> agentPos_; // positions of agents_
+        std::vector<int> agentCell_; // cell of every agent, by index in RVOSimulator::agents_
+    };
+}
+
+#endif /* RVO_AGENT_GRID_H_ */
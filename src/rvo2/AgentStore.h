@@ -0,0 +1,48 @@
+#ifndef RVO_AGENT_STORE_H_
+#define RVO_AGENT_STORE_H_
+
+#include "Definitions.h"
+
+namespace RVO {
+
+    /**
+     * \brief      A copy of the agent state that other agents read during a step.
+     *
+     * RVOSimulator::prepareStep copies it from the Agent objects at the start of
+     * every step, indexed by the index of the agent in RVOSimulator::agents_. The
+     * Agent objects own the state and writes to the copy are lost at the next step.
+     * It is only read during the step so agents can update themselves while others
+     * still read the values of the previous step.
+     */
+    class AgentStore
+    {
+    public:
+        void resize(size_t n) {
+            position.resize(n);
+            velocity.resize(n);
+            radius.resize(n);
+            neighborDist.resize(n);
+            avoidShare.resize(n);
+        }
+        size_t size() const {
+            return position.size();
+        }
+        void clear() {
+            position.clear();
+            velocity.clear();
+            radius.clear();
+            neighborDist.clear();
+            avoidShare.clear();
+        }
+
+        std::vector<Vec2> position;
+        std::vector<Vec2> velocity;
+        std::vector<float> radius;
+        std::vector<float> neighborDist;
+        // the part of the avoidance that agents take against this agent. half when it avoids
+        // back, all of it when it is not stepped (asleep or without a goal)
+        std::vector<float> avoidShare;
+    };
+}
+
+#endif /* RVO_AGENT_STORE_H_ */
@@ -0,0 +1,39 @@
+#ifndef RVO_BROADPHASE_H_
+#define RVO_BROADPHASE_H_
+
+#include "Definitions.h"
+
+namespace RVO {
+
+    enum BroadphaseType {
+        BROADPHASE_KDTREE = 0,
+        BROADPHASE_GRID = 1
+    };
+
+    /**
+     * \brief      Finds the agent neighbors of an agent.
+     *
+     * Rebuilt from RVOSimulator::agentStore_ at the start of every step.
+     */
+    class AgentBroadphase
+    {
+    public:
+        virtual ~AgentBroadphase() {}
+
+        virtual void buildAgents() = 0;
+
+        /**
+         * \brief  Inserts the agents closer than the range to agent as its neighbors.
+         *         The range shrinks when the agent has the maximal number of neighbors.
+         */
+        virtual void computeAgentNeighbors(Agent *agent, float &rangeSq) const = 0;
+
+        /**
+         * \brief  Appends all the agents closer than the range to position, except self,
+         *         in the order computeAgentNeighbors would visit them. For the Verlet lists.
+         */
+        virtual void computeAgentCandidates(const Vec2 &position, int self, float rangeSq, std::vector<int> &out) const = 0;
+    };
+}
+
+#endif /* RVO_BROADPHASE_H_ */
@@ -20,10 +20,57 @@
  */
 const float RVO_EPSILON = 0.00001f;
 
+/**
+ * \brief       Number of agents in a unit of work of a parallel step.
+ */
+const int AGENTS_CHUNK_SIZE = 64;
+
+/**
+ * \brief       Distance from touching within which an agent that moves towards
+ *              a sleeping agent wakes it.
+ */
+const float WAKE_TOUCH_DIST = 1.0f;
+
+/**
+ * \brief       Default skin of the Verlet neighbor lists, in parts of the smallest
+ *              neighbor distance. 0 queries the broadphase every step.
+ */
+const float VERLET_SKIN_FACTOR = 0.5f;
+
+/**
+ * \brief       Highest level of RVOSimulator::setThrottle.
+ */
+const int MAX_THROTTLE = 3;
+
 namespace RVO {
 	class Agent;
 	class Obstacle;
 	class RVOSimulator;
+	struct AgentScratch;
+	struct StepDetail;
+
+	/**
+	 * \brief      Refers to an agent of an RVOSimulator until it is removed.
+	 *
+	 * The index of an agent changes when another agent is removed, the handle
+	 * does not. A handle of a removed agent does not find the agent that took
+	 * its slot since the generation of the slot changed.
+	 */
+	struct AgentHandle
+	{
+		AgentHandle() {}
+		AgentHandle(int s, unsigned int g) : slot(s), generation(g) {}
+
+		bool operator==(const AgentHandle& other) const {
+			return slot == other.slot && generation == other.generation;
+		}
+		bool operator!=(const AgentHandle& other) const {
+			return !(*this == other);
+		}
+
+		int slot = -1;
+		unsigned int generation = 0;
+	};
 
 	/**
 	 * \brief      Computes the squared distance from a line segment with the
@@ -0,0 +1,109 @@
+#ifndef RVO_EVENT_RING_H_
+#define RVO_EVENT_RING_H_
+
+#include <atomic>
+#include <vector>
+
+#include "Definitions.h"
+
+// events a ring keeps until they are drained, a power of 2. newer events are dropped when it is full
+#define EVENT_RING_CAPACITY 4096
+
+namespace RVO {
+
+    enum EventType {
+        EVENT_GOAL_REACHED,  // value is the distance from the goal
+        EVENT_REPLAN,        // value is the number of subgoals of the new plan
+        EVENT_PLAN_FAILED,   // there is no corridor to the goal, the agent goes straight at it
+        EVENT_STUCK,         // no progress for STUCK_STEPS, value is the distance to the current subgoal
+        EVENT_LP3_FALLBACK,  // the ORCA constraints had no solution, value is the number of lines
+        EVENT_TYPE_COUNT
+    };
+
+    inline unsigned int eventBit(EventType type) {
+        return 1u << type;
+    }
+
+    /**
+     * \brief      Something that happened to an agent during a step, for the host to show or count.
+     *
+     * Plain 32 bit fields so that the web page can read drained events from the heap.
+     */
+    struct Event
+    {
+        int step;           // RVOSimulator::stepCount() when it happened
+        AgentHandle agent;
+        int type;           // EventType
+        float value;
+    };
+
+    /**
+     * \brief      Events written by one thread and drained by another without locks.
+     *
+     * Every worker of the thread pool writes to its own ring, so there is one writer and
+     * one reader. Types that are not in the mask are not written, with no mask a push
+     * is one test of a bit.
+     */
+    class EventRing
+    {
+    public:
+        // not while the ring is written or drained
+        void setMask(unsigned int mask) {
+            mask_ = mask;
+            if (mask != 0 && buffer_.empty()) {
+                buffer_.resize(EVENT_RING_CAPACITY);
+            }
+        }
+        bool wants(EventType type) const {
+            return (mask_ & eventBit(type)) != 0;
+        }
+        void setStep(int step) {
+            step_ = step;
+        }
+
+        void push(EventType type, AgentHandle agent, float value) {
+            if (!wants(type)) {
+                return;
+            }
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) == buffer_.size()) {
+                ++dropped_;
+                return;
+            }
+            Event& e = buffer_[head & (buffer_.size() - 1)];
+            e.step = step_;
+            e.agent = agent;
+            e.type = type;
+            e.value = value;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // append the events of the types in mask to out, the others are dropped too
+        void drain(unsigned int mask, std::vector<Event>& out) {
+            const size_t head = head_.load(std::memory_order_acquire);
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            for (; tail != head; ++tail) {
+                const Event& e = buffer_[tail & (buffer_.size() - 1)];
+                if ((mask & eventBit((EventType)e.type)) != 0) {
+                    out.push_back(e);
+                }
+            }
+            tail_.store(tail, std::memory_order_release);
+        }
+
+        // events that did not fit since the ring was made
+        size_t dropped() const {
+            return dropped_;
+        }
+
+    private:
+        std::vector<Event> buffer_;
+        unsigned int mask_ = 0;
+        int step_ = 0;
+        size_t dropped_ = 0;
+        std::atomic<size_t> head_{0}; // next to write
+        std::atomic<size_t> tail_{0}; // next to drain
+    };
+}
+
+#endif /* RVO_EVENT_RING_H_ */
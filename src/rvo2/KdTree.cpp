@@ -4,50 +4,110 @@
 #include "Agent.h"
 #include "RVOSimulator.h"
 #include "Obstacle.h"
+#include "ThreadPool.h"
+
+#include <functional>
 
 namespace RVO {
-	KdTree::KdTree(RVOSimulator *sim) : obstacleTree_(NULL), sim_(sim) { }
+	KdTree::KdTree(RVOSimulator *sim) : sim_(sim) { }
 
 	KdTree::~KdTree()
 	{
-		deleteObstacleTree(obstacleTree_);
 	}
 
     void KdTree::clear()
     {
-        deleteObstacleTree(obstacleTree_);
-        obstacleTree_ = nullptr;
+        obstacleTree_.clear();
         agents_.clear();
+        agentPos_.clear();
         agentTree_.clear();
     }
 
 	void KdTree::buildAgentTree()
 	{
-		if (agents_.size() < sim_->agents_.size()) {
-			for (size_t i = agents_.size(); i < sim_->agents_.size(); ++i) {
-				agents_.push_back(sim_->agents_[i]);
-			}
+		const AgentStore& store = sim_->agentStore_;
+
+		if (agents_.size() > store.size()) {
+			/* agents were removed, the last ones took their indices and the indices past the end are gone */
+			const int count = (int)store.size();
+			agents_.erase(std::remove_if(agents_.begin(), agents_.end(), [count](int index) { return index >= count; }), agents_.end());
+		}
+		for (size_t i = agents_.size(); i < store.size(); ++i) {
+			agents_.push_back((int)i);
+		}
+		agentTree_.resize(agents_.empty() ? 0 : 2 * agents_.size() - 1);
+
+		if (agents_.empty()) {
+			return;
+		}
 
-			agentTree_.resize(2 * agents_.size() - 1);
+		/* Keep the order of the previous build, it is mostly sorted already. */
+		agentPos_.resize(agents_.size());
+		for (size_t i = 0; i < agents_.size(); ++i) {
+			agentPos_[i] = store.position[agents_[i]];
 		}
 
-		if (!agents_.empty()) {
+		ThreadPool& pool = sim_->threadPool_;
+		if (pool.numThreads() <= 1) {
 			buildAgentTreeRecursive(0, (int)agents_.size(), 0);
+			return;
+		}
+
+		/* Subtrees write to disjoint node and agent ranges so they can be built in parallel. */
+		int levels = 0;
+		while ((1 << levels) < pool.numThreads() * 4) {
+			++levels;
+		}
+		/* a subtree with few agents is a leaf before the last level, a build can have fewer tasks than a later one */
+		agentBuildTasks_.reserve((size_t)1 << levels);
+		agentBuildTasks_.clear();
+		splitAgentTreeTop(0, (int)agents_.size(), 0, levels);
+
+		pool.parallelFor((int)agentBuildTasks_.size(), 1, [this](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				const AgentBuildTask& t = agentBuildTasks_[i];
+				buildAgentTreeRecursive(t.begin, t.end, t.node);
+			}
+		});
+	}
+
+	void KdTree::splitAgentTreeTop(int begin, int end, int node, int levels)
+	{
+		if (levels == 0) {
+			agentBuildTasks_.push_back(AgentBuildTask{ begin, end, node });
+			return;
+		}
+
+		const int left = splitAgentNode(begin, end, node);
+
+		if (left >= 0) {
+			splitAgentTreeTop(begin, left, agentTree_[node].left, levels - 1);
+			splitAgentTreeTop(left, end, agentTree_[node].right, levels - 1);
 		}
 	}
 
 	void KdTree::buildAgentTreeRecursive(int begin, int end, int node)
+	{
+		const int left = splitAgentNode(begin, end, node);
+
+		if (left >= 0) {
+			buildAgentTreeRecursive(begin, left, agentTree_[node].left);
+			buildAgentTreeRecursive(left, end, agentTree_[node].right);
+		}
+	}
+
+	int KdTree::splitAgentNode(int begin, int end, int node)
 	{
 		agentTree_[node].begin = begin;
 		agentTree_[node].end = end;
-		agentTree_[node].minX = agentTree_[node].maxX = agents_[begin]->m_position.x;
-		agentTree_[node].minY = agentTree_[node].maxY = agents_[begin]->m_position.y;
+		agentTree_[node].minX = agentTree_[node].maxX = agentPos_[begin].x;
+		agentTree_[node].minY = agentTree_[node].maxY = agentPos_[begin].y;
 
 		for (auto i = begin + 1; i < end; ++i) {
-			agentTree_[node].maxX = std::max(agentTree_[node].maxX, agents_[i]->m_position.x);
-			agentTree_[node].minX = std::min(agentTree_[node].minX, agents_[i]->m_position.x);
-			agentTree_[node].maxY = std::max(agentTree_[node].maxY, agents_[i]->m_position.y);
-			agentTree_[node].minY = std::min(agentTree_[node].minY, agents_[i]->m_position.y);
+			agentTree_[node].maxX = std::max(agentTree_[node].maxX, agentPos_[i].x);
+			agentTree_[node].minX = std::min(agentTree_[node].minX, agentPos_[i].x);
+			agentTree_[node].maxY = std::max(agentTree_[node].maxY, agentPos_[i].y);
+			agentTree_[node].minY = std::min(agentTree_[node].minY, agentPos_[i].y);
 		}
 
 		if (end - begin > MAX_LEAF_SIZE) {
@@ -59,16 +119,17 @@ namespace RVO {
 			int right = end;
 
 			while (left < right) {
-				while (left < right && (isVertical ? agents_[left]->m_position.x : agents_[left]->m_position.y) < splitValue) {
+				while (left < right && (isVertical ? agentPos_[left].x : agentPos_[left].y) < splitValue) {
 					++left;
 				}
 
-				while (right > left && (isVertical ? agents_[right - 1]->m_position.x : agents_[right - 1]->m_position.y) >= splitValue) {
+				while (right > left && (isVertical ? agentPos_[right - 1].x : agentPos_[right - 1].y) >= splitValue) {
 					--right;
 				}
 
 				if (left < right) {
 					std::swap(agents_[left], agents_[right - 1]);
+					std::swap(agentPos_[left], agentPos_[right - 1]);
 					++left;
 					--right;
 				}
@@ -82,38 +143,48 @@ namespace RVO {
 			agentTree_[node].left = node + 1;
 			agentTree_[node].right = node + 2 * (left - begin);
 
-			buildAgentTreeRecursive(begin, left, agentTree_[node].left);
-			buildAgentTreeRecursive(left, end, agentTree_[node].right);
+			return left;
 		}
+
+		return -1;
 	}
 
 	void KdTree::buildObstacleTree()
 	{
-		deleteObstacleTree(obstacleTree_);
+		obstacleTree_.clear();
+		obstacleTree_.nodes.reserve(sim_->obstacles_.size() * 2);
 
-		std::vector<Obstacle *> obstacles(sim_->obstacles_.size());
-
-		for (size_t i = 0; i < sim_->obstacles_.size(); ++i) {
-			obstacles[i] = sim_->obstacles_[i];
-		}
+		obstacleBuildBuf_.assign(sim_->obstacles_.begin(), sim_->obstacles_.end());
 
-		obstacleTree_ = buildObstacleTreeRecursive(obstacles);
+		buildObstacleTreeRecursive(0, obstacleBuildBuf_.size(), 1);
+		obstacleBuildBuf_.clear();
 	}
 
 
-	KdTree::ObstacleTreeNode *KdTree::buildObstacleTreeRecursive(const std::vector<Obstacle *> &obstacles)
+	int KdTree::buildObstacleTreeRecursive(size_t begin, size_t end, int depth)
 	{
-		if (obstacles.empty()) {
-			return NULL;
+		if (begin == end) {
+			return -1;
 		}
 		else {
-			ObstacleTreeNode *const node = new ObstacleTreeNode;
+			const int node = (int)obstacleTree_.nodes.size();
+			obstacleTree_.nodes.push_back(ObstacleTreeNode());
+			obstacleTree_.depth = std::max(obstacleTree_.depth, depth);
 
-			size_t optimalSplit = 0;
-			size_t minLeft = obstacles.size();
-			size_t minRight = obstacles.size();
+			std::vector<Obstacle *> &obstacles = obstacleBuildBuf_;
 
-			for (size_t i = 0; i < obstacles.size(); ++i) {
+			size_t optimalSplit = begin;
+			size_t minLeft = end - begin;
+			size_t minRight = end - begin;
+
+			/*
+			 * Trying every obstacle is quadratic in the size of the node. Large nodes only
+			 * try evenly spaced candidates, the obstacles are in perimeter order so these
+			 * are spread over the node.
+			 */
+			const size_t stride = (obstacleSplitCandidates_ == 0) ? 1 : std::max<size_t>(1, (end - begin) / obstacleSplitCandidates_);
+
+			for (size_t i = begin; i < end; i += stride) {
 				size_t leftSize = 0;
 				size_t rightSize = 0;
 
@@ -121,7 +192,7 @@ namespace RVO {
 				const Obstacle *const obstacleI2 = obstacleI1->nextObstacle_;
 
 				/* Compute optimal split node. */
-				for (size_t j = 0; j < obstacles.size(); ++j) {
+				for (size_t j = begin; j < end; ++j) {
 					if (i == j) {
 						continue;
 					}
@@ -155,18 +226,19 @@ namespace RVO {
 				}
 			}
 
-			/* Build split node. */
-			std::vector<Obstacle *> leftObstacles(minLeft);
-			std::vector<Obstacle *> rightObstacles(minRight);
+			/* Build split node. The children are pushed to the end of the buffer and popped when done. */
+			const size_t leftBegin = obstacles.size();
+			const size_t rightBegin = leftBegin + minLeft;
+			obstacles.resize(rightBegin + minRight);
 
-			size_t leftCounter = 0;
-			size_t rightCounter = 0;
+			size_t leftCounter = leftBegin;
+			size_t rightCounter = rightBegin;
 			const size_t i = optimalSplit;
 
-			const Obstacle *const obstacleI1 = obstacles[i];
+			Obstacle *const obstacleI1 = obstacles[i];
 			const Obstacle *const obstacleI2 = obstacleI1->nextObstacle_;
 
-			for (size_t j = 0; j < obstacles.size(); ++j) {
+			for (size_t j = begin; j < end; ++j) {
 				if (i == j) {
 					continue;
 				}
@@ -178,10 +250,10 @@ namespace RVO {
 				const float j2LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_, obstacleJ2->point_);
 
 				if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
-					leftObstacles[leftCounter++] = obstacles[j];
+					obstacles[leftCounter++] = obstacleJ1;
 				}
 				else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
-					rightObstacles[rightCounter++] = obstacles[j];
+					obstacles[rightCounter++] = obstacleJ1;
 				}
 				else {
 					/* Split obstacle j. */
@@ -189,105 +261,201 @@ namespace RVO {
 
 					const Vec2 splitpoint = obstacleJ1->point_ + t * (obstacleJ2->point_ - obstacleJ1->point_);
 
-					Obstacle *const newObstacle = new Obstacle();
+					Obstacle *const newObstacle = sim_->newObstacle();
 					newObstacle->point_ = splitpoint;
 					newObstacle->prevObstacle_ = obstacleJ1;
 					newObstacle->nextObstacle_ = obstacleJ2;
 					newObstacle->isConvex_ = true;
 					newObstacle->unitDir_ = obstacleJ1->unitDir_;
 
-					newObstacle->id_ = (int)sim_->obstacles_.size();
-
-					sim_->obstacles_.push_back(newObstacle);
-
 					obstacleJ1->nextObstacle_ = newObstacle;
 					obstacleJ2->prevObstacle_ = newObstacle;
 
 					if (j1LeftOfI > 0.0f) {
-						leftObstacles[leftCounter++] = obstacleJ1;
-						rightObstacles[rightCounter++] = newObstacle;
+						obstacles[leftCounter++] = obstacleJ1;
+						obstacles[rightCounter++] = newObstacle;
 					}
 					else {
-						rightObstacles[rightCounter++] = obstacleJ1;
-						leftObstacles[leftCounter++] = newObstacle;
+						obstacles[rightCounter++] = obstacleJ1;
+						obstacles[leftCounter++] = newObstacle;
 					}
 				}
 			}
 
-			node->obstacle = obstacleI1;
-			node->left = buildObstacleTreeRecursive(leftObstacles);
-			node->right = buildObstacleTreeRecursive(rightObstacles);
+			obstacleTree_.nodes[node].point = obstacleI1->point_;
+			obstacleTree_.nodes[node].nextPoint = obstacleI2->point_;
+			obstacleTree_.nodes[node].obstacle = obstacleI1->id_;
+
+			/* Separate statements, the vector may grow in the call. */
+			const int left = buildObstacleTreeRecursive(leftBegin, rightBegin, depth + 1);
+			obstacleTree_.nodes[node].left = left;
+			const int right = buildObstacleTreeRecursive(rightBegin, rightCounter, depth + 1);
+			obstacleTree_.nodes[node].right = right;
+
+			obstacles.resize(leftBegin);
 			return node;
 		}
 	}
 
 	void KdTree::computeAgentNeighbors(Agent *agent, float &rangeSq) const
 	{
-		queryAgentTreeRecursive(agent, rangeSq, 0);
+		queryAgentTreeRecursive(agent->m_position, agent->id_, rangeSq, 0, [agent](int index, float distSq, float &rangeSq) {
+			agent->insertAgentNeighbor(index, distSq, rangeSq);
+		});
 	}
 
-	void KdTree::computeObstacleNeighbors(Agent *agent, float rangeSq) const
+	void KdTree::computeAgentCandidates(const Vec2 &position, int self, float rangeSq, std::vector<int> &out) const
 	{
-		queryObstacleTreeRecursive(agent, rangeSq, obstacleTree_);
+		queryAgentTreeRecursive(position, self, rangeSq, 0, [&out](int index, float, float &) {
+			out.push_back(index);
+		});
 	}
 
-	void KdTree::deleteObstacleTree(ObstacleTreeNode *node)
+	void KdTree::buildObstacleLists(float range)
 	{
-		if (node != NULL) {
-			deleteObstacleTree(node->left);
-			deleteObstacleTree(node->right);
-			delete node;
+		ObstacleLists &lists = obstacleTree_.lists;
+		lists.clear();
+		if (obstacleTree_.nodes.empty() || range <= 0.0f) {
+			return;
+		}
+
+		/* An agent outside of the grid is further than range from all obstacles */
+		Vec2 minP(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		Vec2 maxP(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		for (const ObstacleTreeNode &node: obstacleTree_.nodes) {
+			minP = Vec2(std::min(minP.x, std::min(node.point.x, node.nextPoint.x)), std::min(minP.y, std::min(node.point.y, node.nextPoint.y)));
+			maxP = Vec2(std::max(maxP.x, std::max(node.point.x, node.nextPoint.x)), std::max(maxP.y, std::max(node.point.y, node.nextPoint.y)));
+		}
+		minP -= Vec2(range, range);
+		maxP += Vec2(range, range);
+
+		const float extent = std::max(maxP.x - minP.x, maxP.y - minP.y);
+		const float cellSize = std::max(range * OBSTACLE_CELL_RANGE_FACTOR, extent / OBSTACLE_MAX_CELLS_SIDE);
+		const float halfDiagonal = cellSize * std::sqrt(0.5f);
+		lists.origin = minP;
+		lists.invCellSize = 1.0f / cellSize;
+		lists.width = std::max(1, (int)std::ceil((maxP.x - minP.x) * lists.invCellSize));
+		lists.height = std::max(1, (int)std::ceil((maxP.y - minP.y) * lists.invCellSize));
+		lists.range = range;
+
+		/* calls f(cell, dist) for the cells that may have a point within range of the node */
+		auto forCells = [&](const ObstacleTreeNode &node, const std::function<void(int, float)> &f) {
+			const float reach = range + halfDiagonal;
+			const int cx0 = std::max(0, (int)std::floor((std::min(node.point.x, node.nextPoint.x) - reach - lists.origin.x) * lists.invCellSize));
+			const int cy0 = std::max(0, (int)std::floor((std::min(node.point.y, node.nextPoint.y) - reach - lists.origin.y) * lists.invCellSize));
+			const int cx1 = std::min(lists.width - 1, (int)std::floor((std::max(node.point.x, node.nextPoint.x) + reach - lists.origin.x) * lists.invCellSize));
+			const int cy1 = std::min(lists.height - 1, (int)std::floor((std::max(node.point.y, node.nextPoint.y) + reach - lists.origin.y) * lists.invCellSize));
+			for (int cy = cy0; cy <= cy1; ++cy) {
+				for (int cx = cx0; cx <= cx1; ++cx) {
+					const Vec2 center = lists.origin + Vec2((cx + 0.5f) * cellSize, (cy + 0.5f) * cellSize);
+					const float dist = std::sqrt(distSqPointLineSegment(node.point, node.nextPoint, center)) - halfDiagonal;
+					if (dist < range) {
+						f(cy * lists.width + cx, std::max(0.0f, dist));
+					}
+				}
+			}
+		};
+
+		/* count, then fill the cells in place */
+		const int cells = lists.width * lists.height;
+		lists.cellStart.assign(cells + 1, 0);
+		for (const ObstacleTreeNode &node: obstacleTree_.nodes) {
+			forCells(node, [&](int c, float) {
+				++lists.cellStart[c + 1];
+			});
+		}
+		for (int c = 0; c < cells; ++c) {
+			lists.cellStart[c + 1] += lists.cellStart[c];
+		}
+		lists.entries.resize(lists.cellStart[cells]);
+		std::vector<int> fill(lists.cellStart.begin(), lists.cellStart.end() - 1);
+		for (int n = 0; n < static_cast<int>(obstacleTree_.nodes.size()); ++n) {
+			forCells(obstacleTree_.nodes[n], [&](int c, float dist) {
+				ObstacleLists::Entry &entry = lists.entries[fill[c]++];
+				entry.dist = dist;
+				entry.node = n;
+			});
+		}
+		for (int c = 0; c < cells; ++c) {
+			std::sort(lists.entries.begin() + lists.cellStart[c], lists.entries.begin() + lists.cellStart[c + 1],
+					  [](const ObstacleLists::Entry &a, const ObstacleLists::Entry &b) { return a.dist < b.dist; });
 		}
 	}
 
-	void KdTree::queryAgentTreeRecursive(Agent *agent, float &rangeSq, size_t node) const
+	void KdTree::computeObstacleNeighbors(const Agent *agent, float rangeSq, AgentScratch &scratch) const
 	{
-		if (agentTree_[node].end - agentTree_[node].begin <= MAX_LEAF_SIZE) {
-			for (size_t i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
-				agent->insertAgentNeighbor(agents_[i], rangeSq);
-			}
+		const ObstacleLists &lists = obstacleTree_.lists;
+		if (rangeSq > sqr(lists.range)) {
+			queryObstacleTree(agent, rangeSq, scratch);
+			return;
 		}
-		else {
-			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minX - agent->m_position.x)) + sqr(std::max(0.0f, agent->m_position.x - agentTree_[agentTree_[node].left].maxX)) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minY - agent->m_position.y)) + sqr(std::max(0.0f, agent->m_position.y - agentTree_[agentTree_[node].left].maxY));
 
-			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minX - agent->m_position.x)) + sqr(std::max(0.0f, agent->m_position.x - agentTree_[agentTree_[node].right].maxX)) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minY - agent->m_position.y)) + sqr(std::max(0.0f, agent->m_position.y - agentTree_[agentTree_[node].right].maxY));
+		/*
+		 * The same obstacles as the tree, the ones the agent is on the right side of that are in range.
+		 * The tree only skips a side of a node when the agent is further than range from its line.
+		 */
+		const Vec2 position = agent->m_position;
+		const int cx = (int)std::floor((position.x - lists.origin.x) * lists.invCellSize);
+		const int cy = (int)std::floor((position.y - lists.origin.y) * lists.invCellSize);
+		if (cx < 0 || cy < 0 || cx >= lists.width || cy >= lists.height) {
+			return;
+		}
 
-			if (distSqLeft < distSqRight) {
-				if (distSqLeft < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+		const float range = std::sqrt(rangeSq);
+		const int c = cy * lists.width + cx;
+		for (int i = lists.cellStart[c]; i < lists.cellStart[c + 1] && lists.entries[i].dist < range; ++i) {
+			const ObstacleTreeNode &node = obstacleTree_.nodes[lists.entries[i].node];
 
-					if (distSqRight < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
-					}
-				}
-			}
-			else {
-				if (distSqRight < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+			if (leftOf(node.point, node.nextPoint, position) < 0.0f) {
+				const float distSq = distSqPointLineSegment(node.point, node.nextPoint, position);
 
-					if (distSqLeft < rangeSq) {
-						queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
-					}
+				if (distSq < rangeSq) {
+					agent->insertObstacleNeighbor(scratch, sim_->obstacles_[node.obstacle], distSq);
 				}
 			}
-
 		}
 	}
 
-	void KdTree::queryObstacleTreeRecursive(Agent *agent, float rangeSq, const ObstacleTreeNode *node) const
+	void KdTree::queryObstacleTree(const Agent *agent, float rangeSq, AgentScratch &scratch) const
 	{
-		if (node == NULL) {
+		if (obstacleTree_.nodes.empty()) {
 			return;
 		}
-		else {
-			const Obstacle *const obstacle1 = node->obstacle;
-			const Obstacle *const obstacle2 = obstacle1->nextObstacle_;
 
-			const float agentLeftOfLine = leftOf(obstacle1->point_, obstacle2->point_, agent->m_position);
+		int localStack[OBSTACLE_STACK_SIZE];
+		std::vector<int> heapStack;
+		int *stack = localStack;
+		if (obstacleTree_.depth >= OBSTACLE_STACK_SIZE) {
+			heapStack.resize(obstacleTree_.depth + 1);
+			stack = heapStack.data();
+		}
+
+		/*
+		 * Same order as the recursion: the near side of a node, then the node itself and
+		 * its far side. Nodes are pushed as index for the near side and ~index for the rest.
+		 * At most one entry per level is on the stack.
+		 */
+		const Vec2 position = agent->m_position;
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0) {
+			const int entry = stack[--top];
+			const ObstacleTreeNode &node = obstacleTree_.nodes[entry >= 0 ? entry : ~entry];
+
+			const float agentLeftOfLine = leftOf(node.point, node.nextPoint, position);
+
+			if (entry >= 0) {
+				stack[top++] = ~entry;
 
-			queryObstacleTreeRecursive(agent, rangeSq, (agentLeftOfLine >= 0.0f ? node->left : node->right));
+				const int nearSide = (agentLeftOfLine >= 0.0f ? node.left : node.right);
+				if (nearSide >= 0) {
+					stack[top++] = nearSide;
+				}
+				continue;
+			}
 
-			const float distSqLine = sqr(agentLeftOfLine) / absSq(obstacle2->point_ - obstacle1->point_);
+			const float distSqLine = sqr(agentLeftOfLine) / absSq(node.nextPoint - node.point);
 
 			if (distSqLine < rangeSq) {
 				if (agentLeftOfLine < 0.0f) {
@@ -295,51 +463,116 @@ namespace RVO {
 					 * Try obstacle at this node only if agent is on right side of
 					 * obstacle (and can see obstacle).
 					 */
-					agent->insertObstacleNeighbor(node->obstacle, rangeSq);
+					const float distSq = distSqPointLineSegment(node.point, node.nextPoint, position);
+
+					if (distSq < rangeSq) {
+						agent->insertObstacleNeighbor(scratch, sim_->obstacles_[node.obstacle], distSq);
+					}
 				}
 
 				/* Try other side of line. */
-				queryObstacleTreeRecursive(agent, rangeSq, (agentLeftOfLine >= 0.0f ? node->right : node->left));
-
+				const int farSide = (agentLeftOfLine >= 0.0f ? node.right : node.left);
+				if (farSide >= 0) {
+					stack[top++] = farSide;
+				}
 			}
 		}
 	}
 
-	bool KdTree::queryVisibility(const Vec2 &q1, const Vec2 &q2, float radius) const
+	template<typename F>
+	void KdTree::queryAgentTreeRecursive(const Vec2 &position, int self, float &rangeSq, size_t node, const F &insert) const
 	{
-		return queryVisibilityRecursive(q1, q2, radius, obstacleTree_);
+		if (agentTree_[node].end - agentTree_[node].begin <= static_cast<int>(MAX_LEAF_SIZE)) {
+			for (int i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
+				const float distSq = absSq(position - agentPos_[i]);
+
+				if (distSq < rangeSq && agents_[i] != self) {
+					insert(agents_[i], distSq, rangeSq);
+				}
+			}
+		}
+		else {
+			const float distSqLeft = sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minX - position.x)) + sqr(std::max(0.0f, position.x - agentTree_[agentTree_[node].left].maxX)) + sqr(std::max(0.0f, agentTree_[agentTree_[node].left].minY - position.y)) + sqr(std::max(0.0f, position.y - agentTree_[agentTree_[node].left].maxY));
+
+			const float distSqRight = sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minX - position.x)) + sqr(std::max(0.0f, position.x - agentTree_[agentTree_[node].right].maxX)) + sqr(std::max(0.0f, agentTree_[agentTree_[node].right].minY - position.y)) + sqr(std::max(0.0f, position.y - agentTree_[agentTree_[node].right].maxY));
+
+			if (distSqLeft < distSqRight) {
+				if (distSqLeft < rangeSq) {
+					queryAgentTreeRecursive(position, self, rangeSq, agentTree_[node].left, insert);
+
+					if (distSqRight < rangeSq) {
+						queryAgentTreeRecursive(position, self, rangeSq, agentTree_[node].right, insert);
+					}
+				}
+			}
+			else {
+				if (distSqRight < rangeSq) {
+					queryAgentTreeRecursive(position, self, rangeSq, agentTree_[node].right, insert);
+
+					if (distSqLeft < rangeSq) {
+						queryAgentTreeRecursive(position, self, rangeSq, agentTree_[node].left, insert);
+					}
+				}
+			}
+
+		}
 	}
 
-	bool KdTree::queryVisibilityRecursive(const Vec2 &q1, const Vec2 &q2, float radius, const ObstacleTreeNode *node) const
+	bool KdTree::queryVisibility(const Vec2 &q1, const Vec2 &q2, float radius) const
 	{
-		if (node == NULL) {
+		if (obstacleTree_.nodes.empty()) {
 			return true;
 		}
-		else {
-			const Obstacle *const obstacle1 = node->obstacle;
-			const Obstacle *const obstacle2 = obstacle1->nextObstacle_;
 
-			const float q1LeftOfI = leftOf(obstacle1->point_, obstacle2->point_, q1);
-			const float q2LeftOfI = leftOf(obstacle1->point_, obstacle2->point_, q2);
-			const float invLengthI = 1.0f / absSq(obstacle2->point_ - obstacle1->point_);
+		int localStack[OBSTACLE_STACK_SIZE];
+		std::vector<int> heapStack;
+		int *stack = localStack;
+		if (obstacleTree_.depth >= OBSTACLE_STACK_SIZE) {
+			heapStack.resize(obstacleTree_.depth + 1);
+			stack = heapStack.data();
+		}
+
+		/* Visible if visible in every subtree that the segment needs, in any order. */
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0) {
+			const ObstacleTreeNode &node = obstacleTree_.nodes[stack[--top]];
+
+			const float q1LeftOfI = leftOf(node.point, node.nextPoint, q1);
+			const float q2LeftOfI = leftOf(node.point, node.nextPoint, q2);
+			const float invLengthI = 1.0f / absSq(node.nextPoint - node.point);
+
+			bool needLeft = true;
+			bool needRight = true;
 
 			if (q1LeftOfI >= 0.0f && q2LeftOfI >= 0.0f) {
-				return queryVisibilityRecursive(q1, q2, radius, node->left) && ((sqr(q1LeftOfI) * invLengthI >= sqr(radius) && sqr(q2LeftOfI) * invLengthI >= sqr(radius)) || queryVisibilityRecursive(q1, q2, radius, node->right));
+				needRight = !(sqr(q1LeftOfI) * invLengthI >= sqr(radius) && sqr(q2LeftOfI) * invLengthI >= sqr(radius));
 			}
 			else if (q1LeftOfI <= 0.0f && q2LeftOfI <= 0.0f) {
-				return queryVisibilityRecursive(q1, q2, radius, node->right) && ((sqr(q1LeftOfI) * invLengthI >= sqr(radius) && sqr(q2LeftOfI) * invLengthI >= sqr(radius)) || queryVisibilityRecursive(q1, q2, radius, node->left));
+				needLeft = !(sqr(q1LeftOfI) * invLengthI >= sqr(radius) && sqr(q2LeftOfI) * invLengthI >= sqr(radius));
 			}
 			else if (q1LeftOfI >= 0.0f && q2LeftOfI <= 0.0f) {
 				/* One can see through obstacle from left to right. */
-				return queryVisibilityRecursive(q1, q2, radius, node->left) && queryVisibilityRecursive(q1, q2, radius, node->right);
 			}
 			else {
-				const float point1LeftOfQ = leftOf(q1, q2, obstacle1->point_);
-				const float point2LeftOfQ = leftOf(q1, q2, obstacle2->point_);
+				const float point1LeftOfQ = leftOf(q1, q2, node.point);
+				const float point2LeftOfQ = leftOf(q1, q2, node.nextPoint);
 				const float invLengthQ = 1.0f / absSq(q2 - q1);
 
-				return (point1LeftOfQ * point2LeftOfQ >= 0.0f && sqr(point1LeftOfQ) * invLengthQ > sqr(radius) && sqr(point2LeftOfQ) * invLengthQ > sqr(radius) && queryVisibilityRecursive(q1, q2, radius, node->left) && queryVisibilityRecursive(q1, q2, radius, node->right));
+				if (!(point1LeftOfQ * point2LeftOfQ >= 0.0f && sqr(point1LeftOfQ) * invLengthQ > sqr(radius) && sqr(point2LeftOfQ) * invLengthQ > sqr(radius))) {
+					return false;
+				}
+			}
+
+			if (needRight && node.right >= 0) {
+				stack[top++] = node.right;
+			}
+			if (needLeft && node.left >= 0) {
+				stack[top++] = node.left;
 			}
 		}
+
+		return true;
 	}
 }
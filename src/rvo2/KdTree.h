@@ -3,14 +3,14 @@
 #define RVO_KD_TREE_H_
 
 
-#include "Definitions.h"
+#include "Broadphase.h"
 
 namespace RVO {
 	/**
 	 * \brief      Defines <i>k</i>d-trees for agents and static obstacles in the
 	 *             simulation.
 	 */
-	class KdTree 
+	class KdTree : public AgentBroadphase
     {
 	public:
 		class AgentTreeNode {
@@ -25,11 +25,66 @@ namespace RVO {
 			int right;
 		};
 
+		/**
+		 * \brief      A node of the obstacle tree, with the geometry of its obstacle
+		 *             so that the traversal does not touch the obstacles.
+		 */
 		class ObstacleTreeNode {
 		public:
-			ObstacleTreeNode *left;
-			const Obstacle *obstacle;
-			ObstacleTreeNode *right;
+			Vec2 point;
+			Vec2 nextPoint; // point of the next obstacle
+			int obstacle; // index in RVOSimulator::obstacles_
+			int left; // index in the node array, -1 for none
+			int right;
+		};
+
+		/**
+		 * \brief      The obstacle nodes near each cell of a grid over the obstacles.
+		 *             Covers agents whose obstacle range is up to range.
+		 */
+		class ObstacleLists {
+		public:
+			struct Entry {
+				float dist; // lower bound of the distance from a point in the cell, the entries of a cell are sorted by it
+				int node; // index in ObstacleTree::nodes
+			};
+
+			void clear() {
+				cellStart.clear();
+				entries.clear();
+				width = height = 0;
+				range = 0.0f;
+			}
+
+			Vec2 origin;
+			float invCellSize = 0.0f;
+			int width = 0;
+			int height = 0;
+			float range = 0.0f;
+			std::vector<int> cellStart; // entries of cell c are [cellStart[c], cellStart[c + 1])
+			std::vector<Entry> entries;
+		};
+
+		/**
+		 * \brief      The obstacle tree as a node array, the root is the first node.
+		 *             Children follow their parent.
+		 */
+		class ObstacleTree {
+		public:
+			void clear() {
+				nodes.clear();
+				depth = 0;
+				lists.clear();
+			}
+			void swap(ObstacleTree& other) {
+				nodes.swap(other.nodes);
+				std::swap(depth, other.depth);
+				std::swap(lists, other.lists);
+			}
+
+			std::vector<ObstacleTreeNode> nodes;
+			int depth = 0;
+			ObstacleLists lists;
 		};
 
 		explicit KdTree(RVOSimulator *sim);
@@ -37,10 +92,27 @@ namespace RVO {
 
 		~KdTree();
 		void buildAgentTree();
+		virtual void buildAgents() {
+			buildAgentTree();
+		}
 		void buildAgentTreeRecursive(int begin, int end, int node);
+		// sets the bounds of the node and partitions its agents. returns the split index or -1 for a leaf
+		int splitAgentNode(int begin, int end, int node);
+		// split the first levels and collect the subtrees below them to agentBuildTasks_
+		void splitAgentTreeTop(int begin, int end, int node, int levels);
 		void buildObstacleTree();
-
-		ObstacleTreeNode *buildObstacleTreeRecursive(const std::vector<Obstacle *> &obstacles);
+		// splitters tried in a large obstacle node, 0 tries all of them. for comparing the trees
+		void setObstacleSplitCandidates(size_t count) {
+			obstacleSplitCandidates_ = count;
+		}
+
+		// builds the subtree of the obstacles in [begin, end) of obstacleBuildBuf_, returns the index of its node
+		int buildObstacleTreeRecursive(size_t begin, size_t end, int depth);
+		// precomputes the obstacle neighbor candidates of agents with an obstacle range up to range
+		void buildObstacleLists(float range);
+		float obstacleListRange() const {
+			return obstacleTree_.lists.range;
+		}
 
 		/**
 		 * \brief      Computes the agent neighbors of the specified agent.
@@ -48,28 +120,25 @@ namespace RVO {
 		 *                             neighbors are to be computed.
 		 * \param      rangeSq         The squared range around the agent.
 		 */
-		void computeAgentNeighbors(Agent *agent, float &rangeSq) const;
+		virtual void computeAgentNeighbors(Agent *agent, float &rangeSq) const;
+		virtual void computeAgentCandidates(const Vec2 &position, int self, float rangeSq, std::vector<int> &out) const;
 
 		/**
 		 * \brief      Computes the obstacle neighbors of the specified agent.
+		 *             Scans the list of the cell of the agent when it covers the
+		 *             range and traverses the tree otherwise.
 		 * \param      agent           A pointer to the agent for which obstacle
 		 *                             neighbors are to be computed.
 		 * \param      rangeSq         The squared range around the agent.
+		 * \param      scratch         Receives the neighbors.
 		 */
-		void computeObstacleNeighbors(Agent *agent, float rangeSq) const;
-
-		/**
-		 * \brief      Deletes the specified obstacle tree node.
-		 * \param      node            A pointer to the obstacle tree node to be
-		 *                             deleted.
-		 */
-		void deleteObstacleTree(ObstacleTreeNode *node);
-
-		void queryAgentTreeRecursive(Agent *agent, float &rangeSq,
-									 size_t node) const;
+		void computeObstacleNeighbors(const Agent *agent, float rangeSq, AgentScratch &scratch) const;
+		void queryObstacleTree(const Agent *agent, float rangeSq, AgentScratch &scratch) const;
 
-		void queryObstacleTreeRecursive(Agent *agent, float rangeSq,
-										const ObstacleTreeNode *node) const;
+		// calls insert(index, distSq, rangeSq) for the agents in range, except self
+		template<typename F>
+		void queryAgentTreeRecursive(const Vec2 &position, int self, float &rangeSq,
+									 size_t node, const F &insert) const;
 
 		/**
 		 * \brief      Queries the visibility between two points within a
@@ -86,16 +155,31 @@ namespace RVO {
 		bool queryVisibility(const Vec2 &q1, const Vec2 &q2,
 							 float radius) const;
 
-		bool queryVisibilityRecursive(const Vec2 &q1, const Vec2 &q2,
-									  float radius,
-									  const ObstacleTreeNode *node) const;
-
-		std::vector<Agent *> agents_;
+		std::vector<int> agents_; // indices to RVOSimulator::agents_ in tree order
+		std::vector<Vec2> agentPos_; // positions of agents_, copied from the AgentStore when building
 		std::vector<AgentTreeNode> agentTree_;
-		ObstacleTreeNode *obstacleTree_;
+
+		struct AgentBuildTask {
+			int begin;
+			int end;
+			int node;
+		};
+		std::vector<AgentBuildTask> agentBuildTasks_; // subtrees that are built in parallel
+		ObstacleTree obstacleTree_;
 		RVOSimulator *sim_;
 
+		// the obstacles of the nodes on the current path of the build, children are pushed after their parent
+		std::vector<Obstacle *> obstacleBuildBuf_;
+		size_t obstacleSplitCandidates_ = OBSTACLE_SPLIT_CANDIDATES;
+
 		static const size_t MAX_LEAF_SIZE = 10;
+		// number of splitters that are tried in an obstacle node, all of them if there are less obstacles
+		static const size_t OBSTACLE_SPLIT_CANDIDATES = 32;
+		// traversal stack that covers the trees of any real map, deeper trees use the heap
+		static const int OBSTACLE_STACK_SIZE = 64;
+		// the cells of the obstacle lists are this part of the range, or larger to stay under the cell count
+		static constexpr float OBSTACLE_CELL_RANGE_FACTOR = 0.5f;
+		static const int OBSTACLE_MAX_CELLS_SIDE = 256;
 
 		friend class Agent;
 		friend class RVOSimulator;
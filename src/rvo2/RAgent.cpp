@@ -17,19 +17,42 @@ namespace RVO
     }
 
     size_t linearProgram2(const std::vector<Line> &lines, float radius, const Vec2 &optVelocity, bool directionOpt, Vec2 &result);
-    void linearProgram3(const std::vector<Line> &lines, size_t numObstLines, size_t beginLine, float radius, Vec2 &result);
+    void linearProgram3(const std::vector<Line> &lines, size_t numObstLines, size_t beginLine, float radius, Vec2 &result, std::vector<Line> &projLines);
 
-	void Agent::computeNeighbors(KdTree& kdTree)
+	void Agent::computeNeighbors(const RVOSimulator& sim, AgentScratch& scratch)
 	{
-		obstacleNeighbors_.clear();
-		float rangeSq = sqr(timeHorizonObst_ * maxSpeed_ + m_radius);
-		kdTree.computeObstacleNeighbors(this, rangeSq);
+		scratch.obstacleNeighbors.clear();
+		float rangeSq = sqr(obstacleRange());
+		sim.kdTree_.computeObstacleNeighbors(this, rangeSq, scratch);
 
 		agentNeighbors_.clear();
+		neighborLimit_ = (size_t)std::max(0, std::min(maxNeighbors_, sim.stepDetail_.maxNeighbors));
 
-		if (maxNeighbors_ > 0) {
-			rangeSq = sqr(neighborDist_);
-			kdTree.computeAgentNeighbors(this, rangeSq);
+		if (neighborLimit_ == 0) {
+			return;
+		}
+		const float range = neighborDist_ * sim.stepDetail_.neighborDistScale;
+		rangeSq = sqr(range);
+		if (sim.verletSkin_ <= 0.0f) {
+			sim.broadphase_->computeAgentNeighbors(this, rangeSq);
+			return;
+		}
+
+		/* prepareStep changes the epoch only when the broadphase was rebuilt */
+		candidatesGrew_ = false;
+		if (candidateEpoch_ != sim.verletEpoch_) {
+			const size_t capacity = agentCandidates_.capacity();
+			agentCandidates_.clear();
+			sim.broadphase_->computeAgentCandidates(m_position, id_, sqr(range + sim.verletSkin_), agentCandidates_);
+			candidateEpoch_ = sim.verletEpoch_;
+			candidateDist_ = range;
+			candidatesGrew_ = agentCandidates_.capacity() != capacity;
+		}
+		for (int index: agentCandidates_) {
+			const float distSq = absSq(sim.agentStore_.position[index] - m_position);
+			if (distSq < rangeSq) {
+				insertAgentNeighbor(index, distSq, rangeSq);
+			}
 		}
 	}
 
@@ -56,24 +79,26 @@ namespace RVO
 	    }*/
 
         prefVelocity_ = toGoal;
-		if (absSq(prefVelocity_) > 1.0f) {
-			prefVelocity_ = normalize(prefVelocity_);
+		if (absSq(prefVelocity_) > sqr(m_prefSpeed)) {
+			prefVelocity_ = normalize(prefVelocity_) * m_prefSpeed;
 		}
     }
 
 
 
 	/* Search for the best new velocity. */
-	void Agent::computeNewVelocity(float timeStep)
+	void Agent::computeNewVelocity(const AgentStore& store, float timeStep, AgentScratch& scratch)
 	{
-		orcaLines_.clear();
+		std::vector<Line>& orcaLines = scratch.orcaLines;
+		const std::vector<std::pair<float, const Obstacle *> >& obstacleNeighbors = scratch.obstacleNeighbors;
+		orcaLines.clear();
 
 		const float invTimeHorizonObst = 1.0f / timeHorizonObst_;
 
 		/* Create obstacle ORCA lines. */
-		for (size_t i = 0; i < obstacleNeighbors_.size(); ++i) {
+		for (size_t i = 0; i < obstacleNeighbors.size(); ++i) {
 
-			const Obstacle *obstacle1 = obstacleNeighbors_[i].second;
+			const Obstacle *obstacle1 = obstacleNeighbors[i].second;
 			const Obstacle *obstacle2 = obstacle1->nextObstacle_;
 
 			const Vec2 relativePosition1 = obstacle1->point_ - m_position;
@@ -85,8 +110,8 @@ namespace RVO
 			 */
 			bool alreadyCovered = false;
 
-			for (size_t j = 0; j < orcaLines_.size(); ++j) {
-				if (det(invTimeHorizonObst * relativePosition1 - orcaLines_[j].point, orcaLines_[j].direction) - invTimeHorizonObst * m_radius >= -RVO_EPSILON && det(invTimeHorizonObst * relativePosition2 - orcaLines_[j].point, orcaLines_[j].direction) - invTimeHorizonObst * m_radius >=  -RVO_EPSILON) {
+			for (size_t j = 0; j < orcaLines.size(); ++j) {
+				if (det(invTimeHorizonObst * relativePosition1 - orcaLines[j].point, orcaLines[j].direction) - invTimeHorizonObst * m_radius >= -RVO_EPSILON && det(invTimeHorizonObst * relativePosition2 - orcaLines[j].point, orcaLines[j].direction) - invTimeHorizonObst * m_radius >=  -RVO_EPSILON) {
 					alreadyCovered = true;
 					break;
 				}
@@ -114,7 +139,7 @@ namespace RVO
 				if (obstacle1->isConvex_) {
 					line.point = Vec2(0.0f, 0.0f);
 					line.direction = normalize(Vec2(-relativePosition1.y, relativePosition1.x));
-					orcaLines_.push_back(line);
+					orcaLines.push_back(line);
 				}
 
 				continue;
@@ -125,7 +150,7 @@ namespace RVO
 				if (obstacle2->isConvex_ && det(relativePosition2, obstacle2->unitDir_) >= 0.0f) {
 					line.point = Vec2(0.0f, 0.0f);
 					line.direction = normalize(Vec2(-relativePosition2.y, relativePosition2.x));
-					orcaLines_.push_back(line);
+					orcaLines.push_back(line);
 				}
 
 				continue;
@@ -134,7 +159,7 @@ namespace RVO
 				/* Collision with obstacle segment. */
 				line.point = Vec2(0.0f, 0.0f);
 				line.direction = -obstacle1->unitDir_;
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 
@@ -240,7 +265,7 @@ namespace RVO
 
 				line.direction = Vec2(unitW.y, -unitW.x);
 				line.point = leftCutoff + m_radius * invTimeHorizonObst * unitW;
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 			else if (t > 1.0f && tRight < 0.0f) {
@@ -249,7 +274,7 @@ namespace RVO
 
 				line.direction = Vec2(unitW.y, -unitW.x);
 				line.point = rightCutoff + m_radius * invTimeHorizonObst * unitW;
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 
@@ -265,7 +290,7 @@ namespace RVO
 				/* Project on cut-off line. */
 				line.direction = -obstacle1->unitDir_;
 				line.point = leftCutoff + m_radius * invTimeHorizonObst * Vec2(-line.direction.y, line.direction.x);
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 			else if (distSqLeft <= distSqRight) {
@@ -276,7 +301,7 @@ namespace RVO
 
 				line.direction = leftLegDirection;
 				line.point = leftCutoff + m_radius * invTimeHorizonObst * Vec2(-line.direction.y, line.direction.x);
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 			else {
@@ -287,23 +312,23 @@ namespace RVO
 
 				line.direction = -rightLegDirection;
 				line.point = rightCutoff + m_radius * invTimeHorizonObst * Vec2(-line.direction.y, line.direction.x);
-				orcaLines_.push_back(line);
+				orcaLines.push_back(line);
 				continue;
 			}
 		}
 
-		const size_t numObstLines = orcaLines_.size();
+		const size_t numObstLines = orcaLines.size();
 
 		const float invTimeHorizon = 1.0f / timeHorizon_;
 
 		/* Create agent ORCA lines. */
 		for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
-			const Agent *const other = agentNeighbors_[i].second;
+			const int other = agentNeighbors_[i].second;
 
-			const Vec2 relativePosition = other->m_position - m_position;
-			const Vec2 relativeVelocity = m_velocity - other->m_velocity;
+			const Vec2 relativePosition = store.position[other] - m_position;
+			const Vec2 relativeVelocity = m_velocity - store.velocity[other];
 			const float distSq = absSq(relativePosition);
-			const float combinedRadius = m_radius + other->m_radius;
+			const float combinedRadius = m_radius + store.radius[other];
 			const float combinedRadiusSq = sqr(combinedRadius);
 
 			Line line;
@@ -357,70 +382,70 @@ namespace RVO
 				u = (combinedRadius * invTimeStep - wLength) * unitW;
 			}
 
-			line.point = m_velocity + 0.5f * u;
-			orcaLines_.push_back(line);
+			/* The part of the avoidance this agent takes, see AgentStore::avoidShare. */
+			line.point = m_velocity + store.avoidShare[other] * u;
+			orcaLines.push_back(line);
 		}
 
-		size_t lineFail = linearProgram2(orcaLines_, maxSpeed_, prefVelocity_, false, newVelocity_);
+		size_t lineFail = linearProgram2(orcaLines, maxSpeed_, prefVelocity_, false, newVelocity_);
 
-		if (lineFail < orcaLines_.size()) {
-			linearProgram3(orcaLines_, numObstLines, lineFail, maxSpeed_, newVelocity_);
+		if (lineFail < orcaLines.size()) {
+			linearProgram3(orcaLines, numObstLines, lineFail, maxSpeed_, newVelocity_, scratch.projLines);
+			scratch.events->push(EVENT_LP3_FALLBACK, handle_, (float)orcaLines.size());
 		}
 	}
 
-	void Agent::insertAgentNeighbor(const Agent *agent, float &rangeSq)
+	void Agent::insertAgentNeighbor(int index, float distSq, float &rangeSq)
 	{
-		if (this != agent) {
-			const float distSq = absSq(m_position - agent->m_position);
-
-			if (distSq < rangeSq) {
-				if (agentNeighbors_.size() < maxNeighbors_) {
-					agentNeighbors_.push_back(std::make_pair(distSq, agent));
-				}
+		/* The caller checked that distSq < rangeSq and that it's not this agent. Equal distances
+		   are ordered by index, the order of the candidates changes when the Verlet lists are rebuilt. */
+		if (agentNeighbors_.size() < neighborLimit_) {
+			agentNeighbors_.push_back(std::make_pair(distSq, index));
+		}
+		else if (distSq == agentNeighbors_.back().first && index > agentNeighbors_.back().second) {
+			return; /* a tie with the farthest one, which the range let in */
+		}
 
-				size_t i = agentNeighbors_.size() - 1;
+		size_t i = agentNeighbors_.size() - 1;
 
-				while (i != 0 && distSq < agentNeighbors_[i - 1].first) {
-					agentNeighbors_[i] = agentNeighbors_[i - 1];
-					--i;
-				}
+		while (i != 0 && (distSq < agentNeighbors_[i - 1].first ||
+		                  (distSq == agentNeighbors_[i - 1].first && index < agentNeighbors_[i - 1].second))) {
+			agentNeighbors_[i] = agentNeighbors_[i - 1];
+			--i;
+		}
 
-				agentNeighbors_[i] = std::make_pair(distSq, agent);
+		agentNeighbors_[i] = std::make_pair(distSq, index);
 
-				if (agentNeighbors_.size() == maxNeighbors_) {
-					rangeSq = agentNeighbors_.back().first;
-				}
-			}
+		if (agentNeighbors_.size() == neighborLimit_) {
+			/* just above the farthest so that an agent at the same distance with a lower index still gets in */
+			rangeSq = std::nextafter(agentNeighbors_.back().first, std::numeric_limits<float>::max());
 		}
 	}
 
-	void Agent::insertObstacleNeighbor(const Obstacle *obstacle, float rangeSq)
+	void Agent::insertObstacleNeighbor(AgentScratch& scratch, const Obstacle *obstacle, float distSq) const
 	{
-		const Obstacle *const nextObstacle = obstacle->nextObstacle_;
-
-		const float distSq = distSqPointLineSegment(obstacle->point_, nextObstacle->point_, m_position);
+		/* The caller checked that distSq is in range. Equal distances are ordered by id so
+		   that the order does not depend on how the obstacles were found. */
+		std::vector<std::pair<float, const Obstacle *> >& obstacleNeighbors = scratch.obstacleNeighbors;
+		obstacleNeighbors.push_back(std::make_pair(distSq, obstacle));
 
-		if (distSq < rangeSq) {
-			obstacleNeighbors_.push_back(std::make_pair(distSq, obstacle));
+		size_t i = obstacleNeighbors.size() - 1;
 
-			size_t i = obstacleNeighbors_.size() - 1;
-
-			while (i != 0 && distSq < obstacleNeighbors_[i - 1].first) {
-				obstacleNeighbors_[i] = obstacleNeighbors_[i - 1];
-				--i;
-			}
-
-			obstacleNeighbors_[i] = std::make_pair(distSq, obstacle);
+		while (i != 0 && (distSq < obstacleNeighbors[i - 1].first ||
+		                  (distSq == obstacleNeighbors[i - 1].first && obstacle->id_ < obstacleNeighbors[i - 1].second->id_))) {
+			obstacleNeighbors[i] = obstacleNeighbors[i - 1];
+			--i;
 		}
+
+		obstacleNeighbors[i] = std::make_pair(distSq, obstacle);
 	}
 
 #define MAX_ANGULAR_SPEED 0.5f  // rad/sec
 #define I_PI (3.1415926535897932384626433832795)
 
-    void Agent::updateOrientation(float deltaTime)
+    void Agent::updateOrientation(float deltaTime, float nexto)
     {
         float prevo = m_orientation;
-	    float nexto = mtrig::atan2(m_velocity.y, m_velocity.x);
         float d = prevo - nexto;
         float maxd = MAX_ANGULAR_SPEED * deltaTime;
         float absd = iabs(d);
@@ -442,12 +467,28 @@ namespace RVO
         }
     }
 
-	bool Agent::update(float timeStep)
+    void Agent::updateOrientations(Agent* const* agents, int count, float deltaTime, AgentScratch& scratch)
+    {
+        scratch.velX.resize(count);
+        scratch.velY.resize(count);
+        scratch.headings.resize(count);
+        for (int i = 0; i < count; ++i) {
+            scratch.velX[i] = agents[i]->m_velocity.x;
+            scratch.velY[i] = agents[i]->m_velocity.y;
+        }
+        mtrig::atan2(scratch.velY.data(), scratch.velX.data(), scratch.headings.data(), count);
+        for (int i = 0; i < count; ++i) {
+            agents[i]->updateOrientation(deltaTime, scratch.headings[i]);
+        }
+    }
+
+	bool Agent::update(float timeStep, EventRing& events)
 	{
 		m_velocity = newVelocity_;
 		m_position += m_velocity * timeStep;
 
         // goal analysis
+        const bool wasReached = m_reached;
         bool reachedEnd = false;
         if (m_curGoalPos->isPassed(m_position)) 
         {
@@ -488,13 +529,9 @@ namespace RVO
                     else // update the distance of the touch towards the goal
                         myUpdate = mydist + m_radius; // goal min is with the agent radius
 
-                    if (myUpdate > m_endGoalId->minDistForStop) {
-                        m_endGoalId->minDistForStop = myUpdate;
-                        cout << this << " Stopped-And-Update my=" << mydist << " up=" << myUpdate << " minD=" << m_endGoalId->minDistForStop << " minChange=" << didChange << endl;
-                    }
-                    else {
-                        cout << this << " Stopped my=" << mydist << " minD=" << m_endGoalId->minDistForStop << " up=" << myUpdate << " minChange=" << didChange << endl;
-                    }
+                    // other agents of this goal may be updating in parallel so the goal itself is updated later
+                    m_stopUpdate = myUpdate;
+                    m_stopDist = mydist;
                 }
                 else
                     tooFar = true;
@@ -507,16 +544,52 @@ namespace RVO
                  "  minChange=" << b <<
                  "  minD=" << m_endGoalId->minDistForStop << " minDP=" << m_endGoalId->minDistForStop + m_radius + 1.0 << " tooFar=" << tooFar << endl;
   */      
+        if (!m_reached && !m_following) {
+            trackProgress(events);
+        }
+
         if (m_reached) {
             prefVelocity_ = Vec2(0,0);
+            reachedEnd = !wasReached;
+            if (reachedEnd && events.wants(EVENT_GOAL_REACHED)) {
+                events.push(EVENT_GOAL_REACHED, handle_, (m_endGoalId != nullptr) ? dist(m_position, m_endGoalId->def.p) : 0.0f);
+            }
         }
 
-        updateOrientation(timeStep);
-
         return reachedEnd;
 
 	}
 
+    void Agent::trackProgress(EventRing& events)
+    {
+        if (m_replanWait > 0) {
+            --m_replanWait;
+        }
+        const float d = dist(m_position, m_curGoalPos->representPoint());
+        if (m_progressIndex < 0 || m_indexInPlan != m_progressIndex || d < m_progressDist - m_radius) {
+            if (m_progressIndex >= 0) {
+                m_replanBackoff = 0; /* moving again, not just replanned */
+            }
+            m_progressIndex = m_indexInPlan;
+            m_progressDist = d;
+            m_stuckSteps = 0;
+            return;
+        }
+        if (++m_stuckSteps == STUCK_STEPS && events.wants(EVENT_STUCK)) {
+            events.push(EVENT_STUCK, handle_, d);
+        }
+    }
+
+    void Agent::commitGoalUpdate()
+    {
+        if (m_stopUpdate < 0.0f)
+            return;
+        if (m_stopUpdate > m_endGoalId->minDistForStop) {
+            m_endGoalId->minDistForStop = m_stopUpdate;
+        }
+        m_stopUpdate = -1.0f;
+    }
+
     	
     /**
 	 * \relates    Agent
@@ -657,13 +730,12 @@ namespace RVO
 	 * \param      beginLine     The line on which the 2-d linear program failed.
 	 * \param      radius        The radius of the circular constraint.
 	 * \param      result        A reference to the result of the linear program.
+	 * \param      projLines     Scratch buffer for the projected lines, reused between calls.
 	 */
-	void linearProgram3(const std::vector<Line> &lines, size_t numObstLines, size_t beginLine, float radius, Vec2 &result)
+	void linearProgram3(const std::vector<Line> &lines, size_t numObstLines, size_t beginLine, float radius, Vec2 &result, std::vector<Line> &projLines)
 	{
 		float distance = 0.0f;
-    	std::vector<Line> projLines;
-        projLines.reserve(numObstLines * 2); 
-        projLines.insert(projLines.begin(), lines.begin(), lines.begin() + static_cast<ptrdiff_t>(numObstLines));
+        projLines.assign(lines.begin(), lines.begin() + static_cast<ptrdiff_t>(numObstLines));
         int initProjSize = (int)projLines.size();        
 
 		for (size_t i = beginLine; i < lines.size(); ++i) 
@@ -4,12 +4,13 @@
 #include "Agent.h"
 #include "KdTree.h"
 #include "Obstacle.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
 
 namespace RVO {
-	RVOSimulator::RVOSimulator() :  globalTime_(0.0f), kdTree_(this)
+	RVOSimulator::RVOSimulator() :  globalTime_(0.0f), kdTree_(this), agentGrid_(this), broadphase_(&kdTree_), broadphaseType_(BROADPHASE_KDTREE)
 	{
 	}
 
@@ -21,10 +22,15 @@ namespace RVO {
 
     void RVOSimulator::clearObstacles()
     {
-        for (size_t i = 0; i < obstacles_.size(); ++i) {
-			delete obstacles_[i];
-		}
         obstacles_.clear();
+        obstacleStore_.clear();
+    }
+
+    void RVOSimulator::swapObstacles(std::deque<Obstacle>& store, std::vector<Obstacle*>& obstacles, KdTree::ObstacleTree& tree)
+    {
+        obstacleStore_.swap(store);
+        obstacles_.swap(obstacles);
+        kdTree_.obstacleTree_.swap(tree);
     }
 
     void RVOSimulator::clear()
@@ -33,17 +39,78 @@ namespace RVO {
 			delete agents_[i];
 		}
         agents_.clear();
+        /* the slots are kept so that handles from before the clear do not find new agents */
+        for (int i = 0; i < static_cast<int>(agentSlots_.size()); ++i) {
+            AgentSlot& slot = agentSlots_[i];
+            if (slot.index >= 0) {
+                slot.index = -1;
+                ++slot.generation;
+                slot.nextFree = freeSlot_;
+                freeSlot_ = i;
+            }
+        }
+        agentStore_.clear();
         clearObstacles();
 
         kdTree_.clear();
+        agentGrid_.clear();
+        verletAnchor_.clear();
+    }
+
+    void RVOSimulator::setBroadphase(BroadphaseType type)
+    {
+        broadphaseType_ = type;
+        broadphase_ = (type == BROADPHASE_GRID) ? static_cast<AgentBroadphase*>(&agentGrid_) : static_cast<AgentBroadphase*>(&kdTree_);
+        /* the other one was not built with the current positions */
+        verletAnchor_.clear();
     }
 
 
 
-    void RVOSimulator::addAgent(Agent* agent)
+    AgentHandle RVOSimulator::addAgent(Agent* agent)
     {
-		agent->id_ = (int)agents_.size();
+        int slotIndex = freeSlot_;
+        if (slotIndex >= 0) {
+            freeSlot_ = agentSlots_[slotIndex].nextFree;
+        }
+        else {
+            slotIndex = static_cast<int>(agentSlots_.size());
+            agentSlots_.push_back(AgentSlot());
+        }
+        AgentSlot& slot = agentSlots_[slotIndex];
+        slot.index = static_cast<int>(agents_.size());
+        slot.nextFree = -1;
+
+		agent->id_ = slot.index;
+        agent->handle_ = AgentHandle(slotIndex, slot.generation);
 		agents_.push_back(agent);
+        return agent->handle_;
+    }
+
+    bool RVOSimulator::removeAgent(AgentHandle handle)
+    {
+        Agent* agent = getAgent(handle);
+        if (agent == nullptr) {
+            return false;
+        }
+        /* the last agent takes the index of the removed one */
+        const int index = agent->id_;
+        Agent* last = agents_.back();
+        agents_[index] = last;
+        last->id_ = index;
+        agentSlots_[last->handle_.slot].index = index;
+        agents_.pop_back();
+
+        AgentSlot& slot = agentSlots_[handle.slot];
+        slot.index = -1;
+        ++slot.generation;
+        slot.nextFree = freeSlot_;
+        freeSlot_ = handle.slot;
+        delete agent;
+
+        /* the Verlet lists hold indices */
+        verletAnchor_.clear();
+        return true;
     }
 
 
@@ -54,14 +121,15 @@ namespace RVO {
 		}
 
 		const size_t obstacleNo = obstacles_.size();
+		obstacles_.reserve(obstacleNo + vertices.size());
 
 		for (size_t i = 0; i < vertices.size(); ++i) 
         {
-			Obstacle *obstacle = new Obstacle();
+			Obstacle *obstacle = newObstacle();
 			obstacle->point_ = vertices[i];
 
 			if (i != 0) {
-				obstacle->prevObstacle_ = obstacles_.back();
+				obstacle->prevObstacle_ = obstacles_[obstacleNo + i - 1];
 				obstacle->prevObstacle_->nextObstacle_ = obstacle;
 			}
 
@@ -78,42 +146,217 @@ namespace RVO {
 			else {
 				obstacle->isConvex_ = (leftOf(vertices[(i == 0 ? vertices.size() - 1 : i - 1)], vertices[i], vertices[(i == vertices.size() - 1 ? 0 : i + 1)]) >= 0.0f);
 			}
-
-			obstacle->id_ = (int)obstacles_.size();
-
-			obstacles_.push_back(obstacle);
 		}
 
 		return obstacleNo;
 	}
 
-	void RVOSimulator::doStep(float timeStep)
+	Obstacle* RVOSimulator::newObstacle()
 	{
-        //cout << "step " << timeStep << endl;
-		kdTree_.buildAgentTree();
+		obstacleStore_.push_back(Obstacle());
+		Obstacle *obstacle = &obstacleStore_.back();
+		obstacle->id_ = (int)obstacles_.size();
+		obstacles_.push_back(obstacle);
+		return obstacle;
+	}
 
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->computeNeighbors(kdTree_);
-			agents_[i]->computeNewVelocity(timeStep);
-		}
+    void RVOSimulator::setEventMask(unsigned int mask)
+    {
+        eventMask_ = mask;
+        if (eventRings_.empty()) {
+            eventRings_.emplace_back(new EventRing); /* for pushEvent before the first step */
+        }
+        for (auto& ring: eventRings_) {
+            ring->setMask(mask);
+        }
+    }
+
+    void RVOSimulator::drainEvents(unsigned int mask, std::vector<Event>& out)
+    {
+        const size_t begin = out.size();
+        for (auto& ring: eventRings_) {
+            ring->drain(mask, out);
+        }
+        /* which thread stepped an agent depends on the chunks the threads took */
+        std::stable_sort(out.begin() + begin, out.end(), [](const Event& a, const Event& b) {
+            if (a.step != b.step) {
+                return a.step < b.step;
+            }
+            return (a.agent.slot != b.agent.slot) ? a.agent.slot < b.agent.slot : a.type < b.type;
+        });
+    }
+
+    size_t RVOSimulator::droppedEvents() const
+    {
+        size_t dropped = 0;
+        for (const auto& ring: eventRings_) {
+            dropped += ring->dropped();
+        }
+        return dropped;
+    }
 
-		for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-			agents_[i]->update(timeStep);
+	void RVOSimulator::doStep(float timeStep)
+	{
+        //cout << "step " << timeStep << endl;
+		prepareStep();
+
+        /* sleeping agents are only read from the store */
+        threadPool_.parallelForWorker((int)activeAgents_.size(), AGENTS_CHUNK_SIZE, [&](int worker, int begin, int end) {
+		    AgentScratch& scratch = agentScratch_[worker];
+		    for (int i = begin; i < end; ++i) {
+			    Agent* agent = agents_[activeAgents_[i]];
+			    agent->computeNeighbors(*this, scratch);
+			    agent->computeNewVelocity(agentStore_, timeStep, scratch);
+		    }
+        });
+
+        threadPool_.parallelForWorker((int)activeAgents_.size(), AGENTS_CHUNK_SIZE, [&](int worker, int begin, int end) {
+		    AgentScratch& scratch = agentScratch_[worker];
+		    scratch.updated.clear();
+		    for (int i = begin; i < end; ++i) {
+			    Agent* agent = agents_[activeAgents_[i]];
+			    agent->update(timeStep, *scratch.events);
+			    scratch.updated.push_back(agent);
+		    }
+		    Agent::updateOrientations(scratch.updated.data(), (int)scratch.updated.size(), timeStep, scratch);
+        });
+		for (int index: activeAgents_) {
+			agents_[index]->commitGoalUpdate();
+			updateSleep(agents_[index]);
 		}
         
 		globalTime_ += timeStep;
 	}
 
 
+    void RVOSimulator::prepareStep()
+    {
+        agentStore_.resize(agents_.size());
+        activeAgents_.reserve(agents_.size());
+        activeAgents_.clear();
+        int maxNeighbors = 0;
+        float obstacleRange = 0.0f;
+        for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
+            const Agent* agent = agents_[i];
+            maxNeighbors = std::max(maxNeighbors, agent->maxNeighbors_);
+            if (agent->m_curGoalPos != nullptr && !agent->m_asleep) {
+                activeAgents_.push_back(i);
+                obstacleRange = std::max(obstacleRange, agent->obstacleRange());
+            }
+        }
+        /* an agent that is faster or larger than the ones the lists were built for */
+        if (obstacleRange > kdTree_.obstacleListRange()) {
+            kdTree_.buildObstacleLists(obstacleRange);
+        }
+        ++stepCount_;
+        agentScratch_.resize(threadPool_.numThreads());
+        while (eventRings_.size() < agentScratch_.size()) {
+            eventRings_.emplace_back(new EventRing);
+            eventRings_.back()->setMask(eventMask_);
+        }
+        for (size_t i = 0; i < agentScratch_.size(); ++i) {
+            agentScratch_[i].reserve(obstacles_.size(), maxNeighbors);
+            agentScratch_[i].events = eventRings_[i].get();
+            eventRings_[i]->setStep(stepCount_);
+        }
+
+        threadPool_.parallelFor((int)agents_.size(), AGENTS_CHUNK_SIZE, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const Agent* agent = agents_[i];
+                agentStore_.position[i] = agent->m_position;
+                agentStore_.velocity[i] = agent->m_velocity;
+                agentStore_.radius[i] = agent->m_radius;
+                agentStore_.neighborDist[i] = agent->neighborDist_;
+                agentStore_.avoidShare[i] = (agent->m_curGoalPos != nullptr && !agent->m_asleep) ? 0.5f : 1.0f;
+            }
+        });
+
+        /* An agent that is in range now was within range + skin when the lists were built if neither
+           moved more than half the skin. Agents that became active or need a longer range since then
+           have no list that covers them */
+        bool rebuild = verletSkinFactor_ <= 0.0f || verletAnchor_.size() != agents_.size();
+        for (int i = 0; !rebuild && i < static_cast<int>(activeAgents_.size()); ++i) {
+            const Agent* agent = agents_[activeAgents_[i]];
+            rebuild = agent->candidateEpoch_ != verletEpoch_ || agent->candidateDist_ < agent->neighborDist_ * stepDetail_.neighborDistScale;
+        }
+        const float maxMoveSq = sqr(0.5f * verletSkin_);
+        for (int i = 0; !rebuild && i < static_cast<int>(agents_.size()); ++i) {
+            rebuild = absSq(agentStore_.position[i] - verletAnchor_[i]) > maxMoveSq;
+        }
+        if (!rebuild) {
+            return;
+        }
+
+        broadphase_->buildAgents();
+        verletSkin_ = 0.0f;
+        if (verletSkinFactor_ > 0.0f && !agents_.empty()) {
+            float minDist = std::numeric_limits<float>::max();
+            for (const Agent* agent: agents_) {
+                minDist = std::min(minDist, agent->neighborDist_);
+            }
+            verletSkin_ = verletSkinFactor_ * minDist;
+        }
+        verletAnchor_ = agentStore_.position;
+        ++verletEpoch_;
+        ++verletRebuilds_;
+    }
+
+    bool RVOSimulator::candidateListsGrew() const
+    {
+        for (int index: activeAgents_) {
+            if (agents_[index]->candidatesGrew_) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RVOSimulator::setThrottle(int level)
+    {
+        /* fewer neighbors first, then only the close ones */
+        static const int maxNeighbors[MAX_THROTTLE + 1] = { std::numeric_limits<int>::max(), 6, 4, 2 };
+        static const float distScale[MAX_THROTTLE + 1] = { 1.0f, 1.0f, 0.75f, 0.5f };
+
+        throttle_ = std::max(0, std::min(level, MAX_THROTTLE));
+        stepDetail_.maxNeighbors = maxNeighbors[throttle_];
+        stepDetail_.neighborDistScale = distScale[throttle_];
+    }
+
+    void RVOSimulator::updateSleep(Agent* agent)
+    {
+        if (agent->m_reached) {
+            agent->sleep();
+            return;
+        }
+        /* the neighbors are of the start of the step, the sleeping ones did not move since */
+        for (const auto& neighbor: agent->agentNeighbors_) {
+            Agent* other = agents_[neighbor.second];
+            /* the ones that go to the same goal queue behind it and do not push it away */
+            if (!other->m_asleep || other->m_endGoalId == agent->m_endGoalId) {
+                continue;
+            }
+            const Vec2 toOther = other->m_position - agent->m_position;
+            if (absSq(toOther) < sqr(agent->m_radius + other->m_radius + WAKE_TOUCH_DIST) && toOther * agent->prefVelocity_ > 0.0f) {
+                other->wake();
+            }
+        }
+    }
+
 	void RVOSimulator::processObstacles()
 	{
 		kdTree_.buildObstacleTree();
+
+		float obstacleRange = 0.0f;
+		for (const Agent* agent: agents_) {
+			obstacleRange = std::max(obstacleRange, agent->obstacleRange());
+		}
+		kdTree_.buildObstacleLists(obstacleRange);
 	}
 
 
 void RVOSimulator::setupBlocks()
 {
-	std::srand(0);
+	rng_.seed(0);
 
 
 	/* Specify the global time step of the simulation. */
@@ -229,8 +472,9 @@ void RVOSimulator::setPreferredVelocities(bool rnd)
 		 * Perturb a little to avoid deadlocks due to perfect symmetry.
 		 */
         if (rnd) {
-		    float angle = std::rand() * 2.0f * M_PI / RAND_MAX;
-		    float dist = std::rand() * 0.0001f / RAND_MAX;
+		    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		    float angle = unit(rng_) * 2.0f * M_PI;
+		    float dist = unit(rng_) * 0.0001f;
 
             agents_[i]->prefVelocity_ = goalVector +  dist * Vec2(std::cos(angle), std::sin(angle));
         }
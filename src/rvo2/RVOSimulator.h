@@ -4,11 +4,19 @@
 
 
 #include <cstddef>
+#include <deque>
 #include <limits>
+#include <memory>
+#include <random>
 #include <vector>
 
 #include "../Vec2.h"
+#include "AgentGrid.h"
+#include "AgentStore.h"
+#include "EventRing.h"
 #include "KdTree.h"
+#include "Obstacle.h"
+#include "ThreadPool.h"
 
 namespace RVO {
 	/**
@@ -39,6 +47,43 @@ namespace RVO {
 	class KdTree;
 	class Obstacle;
 
+	/**
+	 * \brief      Buffers that an agent only uses while it computes its new velocity.
+	 *
+	 * There is one per thread and they are reserved for the worst case of the
+	 * current obstacles so that a step does not allocate.
+	 */
+	struct AgentScratch
+	{
+		void reserve(size_t numObstacles, size_t maxNeighbors) {
+			obstacleNeighbors.reserve(numObstacles);
+			/* an obstacle adds at most one line */
+			orcaLines.reserve(numObstacles + maxNeighbors);
+			projLines.reserve(numObstacles + maxNeighbors);
+			updated.reserve(AGENTS_CHUNK_SIZE);
+			velX.reserve(AGENTS_CHUNK_SIZE);
+			velY.reserve(AGENTS_CHUNK_SIZE);
+			headings.reserve(AGENTS_CHUNK_SIZE);
+		}
+
+		std::vector<std::pair<float, const Obstacle *> > obstacleNeighbors;
+		std::vector<Line> orcaLines;
+		std::vector<Line> projLines; // of linearProgram3
+		std::vector<Agent*> updated; // of a chunk, for Agent::updateOrientations
+		std::vector<float> velX, velY, headings;
+		EventRing* events = nullptr; // of the worker, set by prepareStep
+	};
+
+	/**
+	 * \brief      Detail of the agent avoidance. Lowered when the steps do not fit
+	 *             their time budget.
+	 */
+	struct StepDetail
+	{
+		int maxNeighbors = std::numeric_limits<int>::max(); // cap on Agent::maxNeighbors_
+		float neighborDistScale = 1.0f; // agents further than this part of Agent::neighborDist_ are not avoided
+	};
+
 	/**
 	 * \brief      Defines the simulation.
 	 *
@@ -46,6 +91,16 @@ namespace RVO {
 	 */
 	class RVOSimulator 
     {
+        /**
+         * \brief      Where an agent of a handle is, or the next free slot.
+         */
+        struct AgentSlot
+        {
+            int index = -1; // in agents_, -1 if free
+            unsigned int generation = 0; // incremented when the agent is removed
+            int nextFree = -1;
+        };
+
 	public:
 		RVOSimulator();
 		~RVOSimulator();
@@ -63,12 +118,98 @@ namespace RVO {
 		 */
 		size_t addObstacle(const std::vector<Vec2> &vertices);
         void clearObstacles();
-
-        void addAgent(Agent* agent);
+        // exchange the obstacles and their tree with a stashed set
+        void swapObstacles(std::deque<Obstacle>& store, std::vector<Obstacle*>& obstacles, KdTree::ObstacleTree& tree);
+        // appends a vertex to obstacles_, with its id set
+        Obstacle* newObstacle();
+
+        // takes ownership of the agent. O(1), a slot of a removed agent is reused
+        AgentHandle addAgent(Agent* agent);
+        // deletes the agent and moves the last agent to its index. O(1), the other handles stay valid
+        // but the indices of the last step, in agentNeighbors_ and activeAgents_, do not
+        bool removeAgent(AgentHandle handle);
+        // room for this many agents without reallocating, before adding many
+        void reserveAgents(size_t count) {
+            agents_.reserve(count);
+            agentSlots_.reserve(count);
+        }
+        // null if the agent was removed
+        Agent* getAgent(AgentHandle handle) const {
+            if (handle.slot < 0 || handle.slot >= static_cast<int>(agentSlots_.size())) {
+                return nullptr;
+            }
+            const AgentSlot& slot = agentSlots_[handle.slot];
+            return (slot.index >= 0 && slot.generation == handle.generation) ? agents_[slot.index] : nullptr;
+        }
 
 		void doStep(float timeStep);
 
-
+        // copy the agents to agentStore_, reserve agentScratch_ and collect activeAgents_.
+        // rebuilds the broadphase and the Verlet lists when they may have missed a neighbor. first thing of every step
+        void prepareStep();
+        // after the agent was updated and committed: puts it to sleep if it reached its goal,
+        // otherwise wakes the sleeping neighbors of other goals it pushes into. serially in agent order
+        void updateSleep(Agent* agent);
+        // a Verlet list of the last step needed more room than it ever had, the step allocated for it
+        bool candidateListsGrew() const;
+
+        void setBroadphase(BroadphaseType type);
+        BroadphaseType broadphaseType() const {
+            return broadphaseType_;
+        }
+
+        // lower the avoidance detail to make the step cheaper. 0 is full detail, up to MAX_THROTTLE
+        void setThrottle(int level);
+        int throttle() const {
+            return throttle_;
+        }
+
+        // the Verlet lists are rebuilt when an agent moved half the skin. factor of the smallest
+        // neighbor distance, 0 turns them off and the broadphase is rebuilt and queried every step
+        void setVerletSkin(float factor) {
+            verletSkinFactor_ = std::max(0.0f, factor);
+            verletAnchor_.clear();
+        }
+        // the agents were moved by something other than a step, the Verlet lists are rebuilt on the next one
+        void resetNeighborLists() {
+            verletAnchor_.clear();
+        }
+
+        // events of the types in mask are recorded in a ring per thread until they are drained, 0 records none
+        void setEventMask(unsigned int mask);
+        unsigned int eventMask() const {
+            return eventMask_;
+        }
+        // record an event outside of the parallel loops, on the ring of the calling thread
+        void pushEvent(EventType type, AgentHandle agent, float value) {
+            if ((eventMask_ & eventBit(type)) != 0) {
+                eventRings_[0]->setStep(stepCount_);
+                eventRings_[0]->push(type, agent, value);
+            }
+        }
+        // append the recorded events of the types in mask to out, by step, agent and type.
+        // the events of the other types are dropped as well
+        void drainEvents(unsigned int mask, std::vector<Event>& out);
+        size_t droppedEvents() const;
+        // steps prepared since the simulator was made
+        int stepCount() const {
+            return stepCount_;
+        }
+
+        // the step gives the same result with any number of threads
+        void setNumThreads(int n) {
+            threadPool_.setNumThreads(n);
+        }
+#ifdef NAV_COUNT_ALLOCS
+        // allocations of the worker threads of the steps, the calling thread is not included
+        size_t workerAllocCount() const {
+            return threadPool_.workerAllocCount();
+        }
+#endif
+
+
+		// builds the obstacle tree and the obstacle lists for the current agents. prepareStep
+		// extends the lists when an agent needs a longer range
 		void processObstacles();
 
 
@@ -77,10 +218,31 @@ namespace RVO {
         void setPreferredVelocities(bool rnd);
 
 		std::vector<Agent *> agents_;
+        std::vector<AgentSlot> agentSlots_; // by AgentHandle::slot
+        int freeSlot_ = -1; // first of the free slots of agentSlots_
+        AgentStore agentStore_; // same order as agents_
+        std::vector<AgentScratch> agentScratch_; // per thread of threadPool_
+        std::vector<int> activeAgents_; // indices of the agents that are stepped, awake and with a goal
+        StepDetail stepDetail_;
+        int throttle_ = 0;
+        float verletSkinFactor_ = VERLET_SKIN_FACTOR;
+        float verletSkin_ = 0.0f; // of the current lists
+        int verletEpoch_ = 0; // incremented when the lists are rebuilt
+        std::vector<Vec2> verletAnchor_; // agent positions when the lists were rebuilt
+        int verletRebuilds_ = 0; // for measuring how often the lists are reused
 		//Agent *defaultAgent_;
 		float globalTime_;
 		KdTree kdTree_;
+        AgentGrid agentGrid_;
+        AgentBroadphase* broadphase_; // kdTree_ or agentGrid_
+        BroadphaseType broadphaseType_;
 		std::vector<Obstacle*> obstacles_;
+        std::deque<Obstacle> obstacleStore_; // obstacles_ point to these, they do not move when it grows
+        ThreadPool threadPool_;
+        std::vector<std::unique_ptr<EventRing> > eventRings_; // per thread, agentScratch_ points to them
+        unsigned int eventMask_ = 0;
+        int stepCount_ = 0;
+        std::minstd_rand rng_; // of this simulator only so that simulators in different threads do not share state
 		//float timeStep_;
 
 
@@ -0,0 +1,155 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#ifdef NAV_COUNT_ALLOCS
+#include "../AllocCount.h"
+#endif
+
+namespace RVO {
+
+#ifdef RVO_USE_THREADS
+
+    ThreadPool::~ThreadPool()
+    {
+        stopWorkers();
+    }
+
+    void ThreadPool::stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_startCond.notify_all();
+        for(auto& t: m_threads)
+            t.join();
+        m_threads.clear();
+        m_stop = false;
+    }
+
+    int ThreadPool::hardwareThreads()
+    {
+        return std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    void ThreadPool::setNumThreads(int n)
+    {
+        n = std::max(1, n);
+        if (n == m_numThreads)
+            return;
+        stopWorkers();
+        m_numThreads = n;
+        m_shares.reset(new Share[n]);
+        for(int w = 1; w < n; ++w)
+            m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, w, m_generation));
+    }
+
+    void ThreadPool::run(int count, int chunkSize, TRangeFunc func, void* ctx)
+    {
+        int chunks = (count + chunkSize - 1) / chunkSize;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_func = func;
+            m_ctx = ctx;
+            m_count = count;
+            m_chunkSize = chunkSize;
+            for(int w = 0; w < m_numThreads; ++w) {
+                m_shares[w].next = (int)((long long)chunks * w / m_numThreads);
+                m_shares[w].end = (int)((long long)chunks * (w + 1) / m_numThreads);
+            }
+            m_busy = m_numThreads - 1;
+            m_failed = false;
+            m_error = nullptr;
+            ++m_generation;
+        }
+        m_startCond.notify_all();
+
+        runChunks(0);
+
+        // the workers use ctx, which is on the stack of the caller, until they are done
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_doneCond.wait(lock, [this]{ return m_busy == 0; });
+            std::swap(error, m_error);
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void ThreadPool::runChunks(int w)
+    {
+        try {
+            // own share first, then steal from the others
+            for(int k = 0; k < m_numThreads; ++k)
+            {
+                Share& s = m_shares[(w + k) % m_numThreads];
+                while (!m_failed) {
+                    int c = s.next.fetch_add(1);
+                    if (c >= s.end)
+                        break;
+                    int begin = c * m_chunkSize;
+                    m_func(m_ctx, w, begin, std::min(m_count, begin + m_chunkSize));
+                }
+            }
+        }
+        catch(...) {
+            // an exception that leaves a worker thread would terminate the process
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error)
+                m_error = std::current_exception();
+            m_failed = true;
+        }
+    }
+
+    void ThreadPool::workerLoop(int w, int seenGeneration)
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_startCond.wait(lock, [&]{ return m_stop || m_generation != seenGeneration; });
+                if (m_stop)
+                    return;
+                seenGeneration = m_generation;
+            }
+
+#ifdef NAV_COUNT_ALLOCS
+            size_t allocsBefore = navAllocCount();
+            runChunks(w);
+            size_t allocs = navAllocCount() - allocsBefore;
+#else
+            runChunks(w);
+#endif
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+#ifdef NAV_COUNT_ALLOCS
+            m_workerAllocs += allocs;
+#endif
+            if (--m_busy == 0)
+                m_doneCond.notify_one();
+        }
+    }
+
+#else // RVO_USE_THREADS
+
+    ThreadPool::~ThreadPool()
+    {}
+
+    int ThreadPool::hardwareThreads()
+    {
+        return 1;
+    }
+
+    void ThreadPool::setNumThreads(int)
+    {}
+
+    void ThreadPool::run(int count, int, TRangeFunc func, void* ctx)
+    {
+        func(ctx, 0, 0, count);
+    }
+
+#endif
+
+}
@@ -0,0 +1,134 @@
+#ifndef RVO_THREAD_POOL_H_
+#define RVO_THREAD_POOL_H_
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+// the web build has no pthreads, everything runs on the calling thread
+#ifndef EMSCRIPTEN
+#define RVO_USE_THREADS
+#endif
+
+#ifdef RVO_USE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace RVO {
+
+    /**
+     * \brief      Persistent worker threads for running loops over agents.
+     *
+     * The range of a loop is cut to chunks and every worker starts with a contiguous
+     * share of the chunks. A worker that finished its share steals the remaining chunks
+     * of the others. The calling thread is worker 0.
+     * Callers must only write to data owned by the index they get so that the result
+     * does not depend on the number of threads.
+     * An exception of a chunk stops the workers from taking more chunks. The first one is
+     * thrown on the calling thread once all the workers are done with the job.
+     */
+    class ThreadPool
+    {
+    public:
+        ThreadPool() {}
+        ~ThreadPool();
+
+        // including the calling thread. ignored (always 1) when there are no threads
+        void setNumThreads(int n);
+        int numThreads() const {
+            return m_numThreads;
+        }
+        // threads the machine runs at the same time, 1 when there are no threads
+        static int hardwareThreads();
+
+#ifdef NAV_COUNT_ALLOCS
+        // allocations of the other workers in all the jobs so far, the calling thread counts its own
+        size_t workerAllocCount() const {
+            return m_workerAllocs;
+        }
+#endif
+
+        // call f(begin, end) for chunks of [0,count) and wait for all of them to finish
+        template<typename F>
+        void parallelFor(int count, int chunkSize, const F& f)
+        {
+            if (count <= 0)
+                return;
+            if (m_numThreads <= 1 || count <= chunkSize) {
+                f(0, count);
+                return;
+            }
+            run(count, chunkSize, &callRange<F>, (void*)&f);
+        }
+
+        // same as parallelFor with f(worker, begin, end), worker < numThreads() is the one that runs the chunk.
+        // for indexing per thread scratch buffers
+        template<typename F>
+        void parallelForWorker(int count, int chunkSize, const F& f)
+        {
+            if (count <= 0)
+                return;
+            if (m_numThreads <= 1 || count <= chunkSize) {
+                f(0, 0, count);
+                return;
+            }
+            run(count, chunkSize, &callWorkerRange<F>, (void*)&f);
+        }
+
+    private:
+        typedef void (*TRangeFunc)(void* ctx, int worker, int begin, int end);
+
+        template<typename F>
+        static void callRange(void* ctx, int, int begin, int end) {
+            (*(const F*)ctx)(begin, end);
+        }
+        template<typename F>
+        static void callWorkerRange(void* ctx, int worker, int begin, int end) {
+            (*(const F*)ctx)(worker, begin, end);
+        }
+
+        void run(int count, int chunkSize, TRangeFunc func, void* ctx);
+
+        int m_numThreads = 1;
+#ifdef NAV_COUNT_ALLOCS
+        size_t m_workerAllocs = 0; // added under m_mutex when a worker finishes a job
+#endif
+
+#ifdef RVO_USE_THREADS
+        void stopWorkers();
+        void workerLoop(int w, int seenGeneration);
+        void runChunks(int w);
+
+        struct Share {
+            std::atomic<int> next; // next chunk to take, by the owner or by a thief
+            int end = 0;
+            char pad[64]; // keep the counters of different workers in different cache lines
+        };
+
+        std::vector<std::thread> m_threads;
+        std::unique_ptr<Share[]> m_shares;
+
+        std::mutex m_mutex;
+        std::condition_variable m_startCond, m_doneCond;
+        int m_generation = 0; // incremented for every job
+        int m_busy = 0; // workers that did not finish the current job
+        bool m_stop = false;
+        std::atomic<bool> m_failed{false}; // a chunk of the current job threw, the rest are skipped
+        std::exception_ptr m_error; // the first exception of the current job
+
+        // current job
+        TRangeFunc m_func = nullptr;
+        void* m_ctx = nullptr;
+        int m_count = 0;
+        int m_chunkSize = 1;
+#endif
+
+        ThreadPool(const ThreadPool&) = delete;
+        void operator=(const ThreadPool&) = delete;
+    };
+}
+
+#endif /* RVO_THREAD_POOL_H_ */